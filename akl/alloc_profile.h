@@ -0,0 +1,87 @@
+#ifndef AKL_ALLOC_PROFILE_H
+#define AKL_ALLOC_PROFILE_H
+
+#include "types.h"
+
+#ifdef __cplusplus
+extern "C" {
+
+#else
+#endif
+
+/* allocation profiling, live only in builds with AKL_ALLOC_PROFILE */
+
+//! power of two size classes: class k holds sizes in (2^(k-1), 2^k]
+#define AKL_ALLOC_PROFILE_CLASSES 32
+
+//! per-cpu counter slots, cpus beyond this share slots
+#define AKL_ALLOC_PROFILE_SLOTS 64
+
+//! sampled call sites kept in the ring, oldest are overwritten
+#define AKL_ALLOC_PROFILE_SAMPLES 128
+
+//! stack frames kept per sample
+#define AKL_ALLOC_PROFILE_DEPTH 8
+
+//! default sampling period in allocated bytes
+#define AKL_ALLOC_PROFILE_DEFAULT_RATE (512 * 1024)
+
+typedef struct {
+    akl_u64 allocs;
+    akl_u64 frees;
+    akl_u64 alloc_bytes;
+    akl_u64 free_bytes;
+} akl_alloc_class_stats_t;
+
+typedef struct {
+    //! size of the allocation that crossed the sampling period
+    akl_u64 size;
+    //! direct caller of akl_cmalloc or operator new
+    void* site;
+    unsigned int depth;
+    void* frames[AKL_ALLOC_PROFILE_DEPTH];
+} akl_alloc_sample_t;
+
+typedef struct {
+    akl_u64 sample_rate;
+    akl_u64 live_bytes;
+    akl_u64 live_allocs;
+    akl_alloc_class_stats_t classes[AKL_ALLOC_PROFILE_CLASSES];
+    unsigned int nsamples;
+    akl_alloc_sample_t samples[AKL_ALLOC_PROFILE_SAMPLES];
+} akl_alloc_profile_t;
+
+/**
+ * Sums the per-cpu slots into "out". Counters are read without stopping
+ * allocators, so the totals are a consistent view only when the module is
+ * quiescent. Returns -1 if profiling is not compiled in.
+ */
+int akl_alloc_profile_snapshot(akl_alloc_profile_t* out);
+
+//! Prints the current snapshot through akl_kern_log
+void akl_alloc_profile_dump(void);
+
+//! Clears all counters and samples
+void akl_alloc_profile_reset(void);
+
+//! Takes one sample every "bytes" allocated bytes, 0 disables sampling
+void akl_alloc_profile_set_sample_rate(akl_u64 bytes);
+
+#ifdef AKL_ALLOC_PROFILE
+
+//! akl_cmalloc that attributes the allocation to "site"
+void* akl_cmalloc_from(size_t size, void* site);
+
+/* hooks called by the allocator wrappers */
+
+void akl_alloc_profile_on_alloc(size_t size, void* site);
+
+void akl_alloc_profile_on_free(size_t size);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,273 @@
+#pragma once
+
+/* userspace only: needs the C++20 <coroutine> support header */
+
+#include <coroutine>
+
+#include "atomic.hpp"
+#include "kern_lib.h"
+#include "spinlock.hpp"
+#include "utility.hpp"
+
+namespace akl {
+
+class async_mutex;
+
+/// Holds an async_mutex until destroyed, from co_await mutex.scoped_lock()
+class async_mutex_lock {
+private:
+    async_mutex* m_mutex;
+
+    // not copyable
+    async_mutex_lock(const async_mutex_lock&);
+    async_mutex_lock& operator=(const async_mutex_lock&);
+
+public:
+    explicit async_mutex_lock(async_mutex& mutex)
+        : m_mutex(&mutex) {}
+
+    async_mutex_lock(async_mutex_lock&& other)
+        : m_mutex(other.m_mutex) {
+        other.m_mutex = NULL;
+    }
+
+    inline ~async_mutex_lock();
+};
+
+/**
+ * \ingroup util
+ *
+ * Mutex for coroutines: co_await mutex.lock() suspends the coroutine
+ * instead of blocking its thread, and unlock() hands the mutex straight
+ * to the longest waiting coroutine and resumes it on the unlocking
+ * thread.
+ *
+ * One state word says unlocked, locked, or points to the newest waiter;
+ * waiters push themselves with a CAS, and the holder takes them over in
+ * arrival order, so neither path takes a lock.
+ */
+class async_mutex {
+public:
+    class lock_operation {
+    protected:
+        friend class async_mutex;
+
+        async_mutex& m_mutex;
+        lock_operation* m_next;
+        std::coroutine_handle<> m_awaiter;
+
+    public:
+        explicit lock_operation(async_mutex& mutex)
+            : m_mutex(mutex), m_next(NULL) {}
+
+        bool await_ready() noexcept {
+            return m_mutex.try_lock();
+        }
+
+        //! Queues the coroutine, unless the mutex was released meanwhile
+        bool await_suspend(std::coroutine_handle<> awaiter) noexcept {
+            m_awaiter = awaiter;
+            size_t state = m_mutex.m_state.load_acquire();
+            while (true) {
+                if (state == NOT_LOCKED) {
+                    if (m_mutex.m_state.compare_and_swap(state, (size_t)LOCKED_NO_WAITERS)) {
+                        return false;
+                    }
+                } else {
+                    m_next = state == LOCKED_NO_WAITERS ? NULL : reinterpret_cast<lock_operation*>(state);
+                    if (m_mutex.m_state.compare_and_swap(state, reinterpret_cast<size_t>(this))) {
+                        return true;
+                    }
+                }
+                state = m_mutex.m_state.load_acquire();
+            }
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    class scoped_lock_operation : public lock_operation {
+    public:
+        explicit scoped_lock_operation(async_mutex& mutex)
+            : lock_operation(mutex) {}
+
+        async_mutex_lock await_resume() noexcept {
+            return async_mutex_lock(m_mutex);
+        }
+    };
+
+private:
+    enum { LOCKED_NO_WAITERS = 0, NOT_LOCKED = 1 };
+
+    //! NOT_LOCKED, LOCKED_NO_WAITERS, or the newest waiting lock_operation
+    atomic<size_t> m_state;
+    //! waiters in arrival order, only the holder touches them
+    lock_operation* m_waiters;
+
+    // not copyable
+    async_mutex(const async_mutex&);
+    async_mutex& operator=(const async_mutex&);
+
+public:
+    async_mutex()
+        : m_state((size_t)NOT_LOCKED), m_waiters(NULL) {}
+
+    ~async_mutex() {
+        size_t state = m_state.load_acquire();
+        ASSERT_TRUE(state == NOT_LOCKED || state == LOCKED_NO_WAITERS);
+        ASSERT_TRUE(m_waiters == NULL);
+    }
+
+    bool try_lock() {
+        return m_state.compare_and_swap((size_t)NOT_LOCKED, (size_t)LOCKED_NO_WAITERS);
+    }
+
+    /// co_await mutex.lock() returns once the coroutine holds the mutex
+    lock_operation lock() {
+        return lock_operation(*this);
+    }
+
+    /// Like lock(), returning an async_mutex_lock that unlocks when destroyed
+    scoped_lock_operation scoped_lock() {
+        return scoped_lock_operation(*this);
+    }
+
+    /**
+     * Releases the mutex, or passes it to the next waiter and resumes it
+     * before returning.
+     */
+    void unlock() {
+        ASSERT_TRUE(m_state.load_acquire() != NOT_LOCKED);
+        lock_operation* head = m_waiters;
+        if (!head) {
+            size_t state = LOCKED_NO_WAITERS;
+            if (m_state.compare_and_swap(state, (size_t)NOT_LOCKED)) {
+                return;
+            }
+            // take the waiters pushed so far, newest first, and reverse them
+            state = m_state.exchange((size_t)LOCKED_NO_WAITERS);
+            lock_operation* w = reinterpret_cast<lock_operation*>(state);
+            while (w) {
+                lock_operation* next = w->m_next;
+                w->m_next = head;
+                head = w;
+                w = next;
+            }
+        }
+        m_waiters = head->m_next;
+        head->m_awaiter.resume();
+    }
+};
+
+async_mutex_lock::~async_mutex_lock() {
+    if (m_mutex) {
+        m_mutex->unlock();
+    }
+}
+
+/**
+ * \ingroup util
+ *
+ * Counting semaphore for coroutines: co_await sem.acquire() takes a
+ * permit or suspends the coroutine until release() hands it one. The
+ * released permit goes to the longest waiting coroutine, which resumes
+ * on the releasing thread.
+ *
+ * Acquiring while permits are left is a CAS on the count; the waiter
+ * queue sits behind a spinlock held for a few stores.
+ */
+class async_semaphore {
+public:
+    class acquire_operation {
+        friend class async_semaphore;
+
+        async_semaphore& m_semaphore;
+        acquire_operation* m_next;
+        std::coroutine_handle<> m_awaiter;
+
+    public:
+        explicit acquire_operation(async_semaphore& semaphore)
+            : m_semaphore(semaphore), m_next(NULL) {}
+
+        bool await_ready() noexcept {
+            return m_semaphore.try_acquire();
+        }
+
+        bool await_suspend(std::coroutine_handle<> awaiter) noexcept {
+            m_awaiter = awaiter;
+            return m_semaphore.enqueue(this);
+        }
+
+        void await_resume() noexcept {}
+    };
+
+private:
+    atomic<long> m_count;
+    spinlock m_lock;
+    acquire_operation* m_head;
+    acquire_operation* m_tail;
+
+    // not copyable
+    async_semaphore(const async_semaphore&);
+    async_semaphore& operator=(const async_semaphore&);
+
+    //! Queues the waiter, unless a permit turned up meanwhile
+    bool enqueue(acquire_operation* op) {
+        m_lock.lock();
+        if (try_acquire()) {
+            m_lock.unlock();
+            return false;
+        }
+        if (m_tail) {
+            m_tail->m_next = op;
+        } else {
+            m_head = op;
+        }
+        m_tail = op;
+        m_lock.unlock();
+        return true;
+    }
+
+public:
+    explicit async_semaphore(long permits)
+        : m_count(permits), m_head(NULL), m_tail(NULL) {}
+
+    ~async_semaphore() {
+        ASSERT_TRUE(m_head == NULL);
+    }
+
+    bool try_acquire() {
+        long count = m_count.load_acquire();
+        while (count > 0) {
+            if (m_count.compare_and_swap(count, count - 1)) {
+                return true;
+            }
+            count = m_count.load_acquire();
+        }
+        return false;
+    }
+
+    /// co_await sem.acquire() returns once the coroutine holds a permit
+    acquire_operation acquire() {
+        return acquire_operation(*this);
+    }
+
+    /// Gives a permit back, to the first waiter if there is one
+    void release() {
+        m_lock.lock();
+        acquire_operation* op = m_head;
+        if (op) {
+            m_head = op->m_next;
+            if (!m_head) {
+                m_tail = NULL;
+            }
+            m_lock.unlock();
+            op->m_awaiter.resume();
+            return;
+        }
+        m_count.inc();
+        m_lock.unlock();
+    }
+};
+
+}  // namespace akl
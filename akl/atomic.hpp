@@ -1,24 +1,205 @@
 #pragma once
 
+#include "cache_line_pad.hpp"
 #include "double.h"
 #include "float.h"
+#include "hash.hpp"
 #include "kern_lib.h"
 #include "sync.h"
 
 namespace akl {
 
+//! Busy-wait hint: lets the sibling hyperthread run and saves power
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield" ::: "memory");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
 namespace details {
 
-/* int types @only@ */
+/* integer word the sync layer works on for a T of a given size */
+template <size_t Size>
+struct atomic_word;
+
+template <>
+struct atomic_word<4> {
+    using type = int;
+};
+
+template <>
+struct atomic_word<8> {
+    using type = akl_u64;
+};
+
+/* overloads routing every word size to its sync.h primitive */
+
+inline int sync_bool_compare_and_swap(volatile int* t, int expected, int desired) {
+    return akl_sync_bool_compare_and_swap(t, expected, desired);
+}
+
+inline int sync_bool_compare_and_swap(volatile akl_u64* t, akl_u64 expected, akl_u64 desired) {
+    return akl_sync_bool_compare_and_swap_u64(t, expected, desired);
+}
+
+inline int sync_add_and_fetch(volatile int* t, int val) {
+    return akl_sync_add_and_fetch(t, val);
+}
+
+inline akl_u64 sync_add_and_fetch(volatile akl_u64* t, akl_u64 val) {
+    return akl_sync_add_and_fetch_u64(t, val);
+}
+
+inline int sync_fetch_and_add(volatile int* t, int val) {
+    return akl_sync_fetch_and_add(t, val);
+}
+
+inline akl_u64 sync_fetch_and_add(volatile akl_u64* t, akl_u64 val) {
+    return akl_sync_fetch_and_add_u64(t, val);
+}
+
+inline int sync_sub_and_fetch(volatile int* t, int val) {
+    return akl_sync_sub_and_fetch(t, val);
+}
+
+inline akl_u64 sync_sub_and_fetch(volatile akl_u64* t, akl_u64 val) {
+    return akl_sync_sub_and_fetch_u64(t, val);
+}
+
+inline int sync_fetch_and_sub(volatile int* t, int val) {
+    return akl_sync_fetch_and_sub(t, val);
+}
+
+inline akl_u64 sync_fetch_and_sub(volatile akl_u64* t, akl_u64 val) {
+    return akl_sync_fetch_and_sub_u64(t, val);
+}
+
+inline int sync_lock_test_and_set(volatile int* t, int val) {
+    return akl_sync_lock_test_and_set(t, val);
+}
+
+inline akl_u64 sync_lock_test_and_set(volatile akl_u64* t, akl_u64 val) {
+    return akl_sync_lock_test_and_set_u64(t, val);
+}
+
+inline int sync_load_acquire(volatile int* t) {
+    return akl_sync_load_acquire(t);
+}
+
+inline akl_u64 sync_load_acquire(volatile akl_u64* t) {
+    return akl_sync_load_acquire_u64(t);
+}
+
+inline void sync_store_release(volatile int* t, int val) {
+    akl_sync_store_release(t, val);
+}
+
+inline void sync_store_release(volatile akl_u64* t, akl_u64 val) {
+    akl_sync_store_release_u64(t, val);
+}
+
+/* waiting for a value to change, behind atomic_impl::wait() and notify_*() */
+
+enum {
+    //! loads of the value before a wait goes to sleep
+    ATOMIC_WAIT_SPINS = 64,
+    //! buckets of the waiter table
+    ATOMIC_WAIT_BUCKETS = 64
+};
+
+/**
+ * Sleepers on the addresses hashing to one bucket. "waiters" lets a
+ * notify skip the wakeup while nobody sleeps. 8 byte values cannot be
+ * futex words, so their waiters sleep on "version" instead, which every
+ * notify of such a value in the bucket bumps.
+ */
+struct alignas(AKL_CACHE_LINE_SIZE) atomic_wait_bucket {
+    volatile int waiters;
+    volatile int version;
+};
+
+//! The table is zero initialized, so the kernel build needs no guard for it
+inline atomic_wait_bucket& atomic_wait_bucket_for(const volatile void* addr) {
+    static atomic_wait_bucket buckets[ATOMIC_WAIT_BUCKETS];
+    return buckets[hash_mix((akl_u64)(size_t)addr) & (ATOMIC_WAIT_BUCKETS - 1)];
+}
+
+//! Spins a while for "*word" to leave "old", true if it did
+template <typename W>
+bool atomic_wait_spin(volatile W* word, W old) {
+    for (int i = 0; i < ATOMIC_WAIT_SPINS; ++i) {
+        if (sync_load_acquire(word) != old) {
+            return true;
+        }
+        cpu_relax();
+    }
+    return false;
+}
+
+//! Returns once "*word" was seen to differ from "old", sleeping on the word itself
+inline void atomic_wait(volatile int* word, int old) {
+    if (atomic_wait_spin(word, old)) {
+        return;
+    }
+    atomic_wait_bucket& bucket = atomic_wait_bucket_for(word);
+    akl_sync_add_and_fetch(&bucket.waiters, 1);
+    while (akl_sync_load_acquire(word) == old) {
+        akl_sync_wait(word, old);
+    }
+    akl_sync_sub_and_fetch(&bucket.waiters, 1);
+}
+
+//! The same for 8 byte words, sleeping on their bucket's version
+inline void atomic_wait(volatile akl_u64* word, akl_u64 old) {
+    if (atomic_wait_spin(word, old)) {
+        return;
+    }
+    atomic_wait_bucket& bucket = atomic_wait_bucket_for(word);
+    akl_sync_add_and_fetch(&bucket.waiters, 1);
+    while (true) {
+        int version = akl_sync_load_acquire(&bucket.version);
+        if (akl_sync_load_acquire_u64(word) != old) {
+            break;
+        }
+        akl_sync_wait(&bucket.version, version);
+    }
+    akl_sync_sub_and_fetch(&bucket.waiters, 1);
+}
+
+//! Wakes up to "count" waiters of "word"
+inline void atomic_notify(volatile int* word, int count) {
+    atomic_wait_bucket& bucket = atomic_wait_bucket_for(word);
+    // orders the caller's store before the waiter check
+    akl_sync_synchronize();
+    if (akl_sync_load_acquire(&bucket.waiters) != 0) {
+        akl_sync_wake(word, count);
+    }
+}
+
+//! Wakes every waiter in the bucket of "word", they share one futex word
+inline void atomic_notify(volatile akl_u64* word, int) {
+    atomic_wait_bucket& bucket = atomic_wait_bucket_for(word);
+    akl_sync_synchronize();
+    if (akl_sync_load_acquire(&bucket.waiters) != 0) {
+        akl_sync_add_and_fetch(&bucket.version, 1);
+        akl_sync_wake(&bucket.version, 0x7fffffff);
+    }
+}
+
+/* int and 64 bit int types @only@ */
 template <typename T>
 class atomic_impl {
 public:
+    using W = typename atomic_word<sizeof(T)>::type;
+
     //! The current value of the atomic number
     volatile T value;
 
-#ifndef __KERNEL__
-    static_assert(sizeof(T) == sizeof(int));
-#endif
+    static_assert(sizeof(T) == sizeof(int) || sizeof(T) == sizeof(akl_u64));
 
     //! Creates an atomic number with value "value"
     atomic_impl(const T* value)
@@ -29,13 +210,13 @@ public:
 
     //! Performs an atomic increment by 1, returning the new value
     T inc() {
-        int res = akl_sync_add_and_fetch((volatile int*)&value, 1);
+        W res = sync_add_and_fetch((volatile W*)&value, 1);
         return *(T*)&res;
     }
 
     //! Performs an atomic decrement by 1, returning the new value
     T dec() {
-        int res = akl_sync_sub_and_fetch((volatile int*)&value, 1);
+        W res = sync_sub_and_fetch((volatile W*)&value, 1);
         return *(T*)&res;
     }
 
@@ -56,13 +237,13 @@ public:
 
     //! Performs an atomic increment by 'val', returning the new value
     T inc(const T val) {
-        int res = akl_sync_add_and_fetch((volatile int*)&value, *(int*)&val);
+        W res = sync_add_and_fetch((volatile W*)&value, *(W*)&val);
         return *(T*)&res;
     }
 
     //! Performs an atomic decrement by 'val', returning the new value
     T dec(const T val) {
-        int res = akl_sync_sub_and_fetch((volatile int*)&value, *(int*)&val);
+        W res = sync_sub_and_fetch((volatile W*)&value, *(W*)&val);
         return *(T*)&res;
     }
 
@@ -78,13 +259,13 @@ public:
 
     //! Performs an atomic increment by 1, returning the old value
     T inc_ret_last() {
-        int res = akl_sync_fetch_and_add((volatile int*)&value, 1);
+        W res = sync_fetch_and_add((volatile W*)&value, 1);
         return *(T*)&res;
     }
 
     //! Performs an atomic decrement by 1, returning the old value
     T dec_ret_last() {
-        int res = akl_sync_fetch_and_sub((volatile int*)&value, 1);
+        W res = sync_fetch_and_sub((volatile W*)&value, 1);
         return *(T*)&res;
     }
 
@@ -100,21 +281,114 @@ public:
 
     //! Performs an atomic increment by 'val', returning the old value
     T inc_ret_last(const T val) {
-        int res = akl_sync_fetch_and_add((volatile int*)&value, *(int*)&val);
+        W res = sync_fetch_and_add((volatile W*)&value, *(W*)&val);
         return *(T*)&res;
     }
 
     //! Performs an atomic decrement by 'val', returning the new value
     T dec_ret_last(const T val) {
-        int res = akl_sync_fetch_and_sub((volatile int*)&value, *(int*)&val);
+        W res = sync_fetch_and_sub((volatile W*)&value, *(W*)&val);
         return *(T*)&res;
     }
 
     //! Performs an atomic exchange with 'val', returning the previous value
     T exchange(const T val) {
-        int res = akl_sync_lock_test_and_set((volatile int*)&value, *(int*)&val);
+        W res = sync_lock_test_and_set((volatile W*)&value, *(W*)&val);
         return *(T*)&res;
     }
+
+    //! Replaces the value with 'desired' if it equals 'expected'
+    bool compare_and_swap(const T expected, const T desired) {
+        return sync_bool_compare_and_swap((volatile W*)&value, *(W*)&expected, *(W*)&desired);
+    }
+
+    //! Reads the value, later accesses are not reordered before it
+    T load_acquire() const {
+        W res = sync_load_acquire((volatile W*)&value);
+        return *(T*)&res;
+    }
+
+    //! Writes 'val', earlier accesses are not reordered after it
+    void store_release(const T val) {
+        sync_store_release((volatile W*)&value, *(W*)&val);
+    }
+
+    /**
+     * Returns once the value was seen to differ from 'old': spins on it
+     * for a while, then sleeps until a notify_one() or notify_all()
+     */
+    void wait(const T old) const {
+        atomic_wait((volatile W*)&value, *(W*)&old);
+    }
+
+    //! Wakes a thread in wait(), or all of them for 8 byte values
+    void notify_one() {
+        atomic_notify((volatile W*)&value, 1);
+    }
+
+    //! Wakes every thread in wait()
+    void notify_all() {
+        atomic_notify((volatile W*)&value, 0x7fffffff);
+    }
+};
+
+/* atomic for pointers */
+template <typename P>
+class atomic_impl<P*> {
+public:
+    using T = P*;
+    using W = typename atomic_word<sizeof(T)>::type;
+
+    //! The current pointer
+    T volatile value;
+
+    //! Creates an atomic pointer with value "value"
+    atomic_impl(const T* value)
+        : value(*value) {}
+
+    atomic_impl(T value)
+        : value(value) {}
+
+    //! Lvalue implicit cast
+    operator T() const {
+        return value;
+    }
+
+    //! Performs an atomic exchange with 'val', returning the previous value
+    T exchange(const T val) {
+        W res = sync_lock_test_and_set((volatile W*)&value, (W)val);
+        return (T)res;
+    }
+
+    //! Replaces the pointer with 'desired' if it equals 'expected'
+    bool compare_and_swap(const T expected, const T desired) {
+        return sync_bool_compare_and_swap((volatile W*)&value, (W)expected, (W)desired);
+    }
+
+    //! Reads the pointer, later accesses are not reordered before it
+    T load_acquire() const {
+        return (T)sync_load_acquire((volatile W*)&value);
+    }
+
+    //! Writes 'val', earlier accesses are not reordered after it
+    void store_release(const T val) {
+        sync_store_release((volatile W*)&value, (W)val);
+    }
+
+    //! Returns once the pointer was seen to differ from 'old', see atomic_impl::wait()
+    void wait(const T old) const {
+        atomic_wait((volatile W*)&value, (W)old);
+    }
+
+    //! Wakes a thread in wait(), or all of them for 8 byte pointers
+    void notify_one() {
+        atomic_notify((volatile W*)&value, 1);
+    }
+
+    //! Wakes every thread in wait()
+    void notify_all() {
+        atomic_notify((volatile W*)&value, 0x7fffffff);
+    }
 };
 
 /* atomic for int */
@@ -212,6 +486,40 @@ public:
     T exchange(const T val) {
         return akl_sync_lock_test_and_set(&value, val);
     }
+
+    //! Replaces the value with 'desired' if it equals 'expected'
+    bool compare_and_swap(const T expected, const T desired) {
+        return akl_sync_bool_compare_and_swap(&value, expected, desired);
+    }
+
+    //! Reads the value, later accesses are not reordered before it
+    T load_acquire() const {
+        return akl_sync_load_acquire(const_cast<volatile T*>(&value));
+    }
+
+    //! Writes 'val', earlier accesses are not reordered after it
+    void store_release(const T val) {
+        akl_sync_store_release(&value, val);
+    }
+
+    /**
+     * Returns once the value was seen to differ from 'old': spins on it
+     * for a while, then sleeps on the value itself until a notify_one()
+     * or notify_all()
+     */
+    void wait(const T old) const {
+        atomic_wait(const_cast<volatile T*>(&value), old);
+    }
+
+    //! Wakes a thread in wait()
+    void notify_one() {
+        atomic_notify(&value, 1);
+    }
+
+    //! Wakes every thread in wait()
+    void notify_all() {
+        atomic_notify(&value, 0x7fffffff);
+    }
 };
 
 /* atomic for floats */
@@ -333,6 +641,21 @@ public:
     T exchange(const T val) {
         return akl_sync_lock_test_and_set_float(&value, val);
     }
+
+    //! Returns once the bits of the value were seen to differ from those of 'old'
+    void wait(const T old) const {
+        atomic_wait((volatile int*)&value, (int)old.u);
+    }
+
+    //! Wakes a thread in wait()
+    void notify_one() {
+        atomic_notify((volatile int*)&value, 1);
+    }
+
+    //! Wakes every thread in wait()
+    void notify_all() {
+        atomic_notify((volatile int*)&value, 0x7fffffff);
+    }
 };
 
 /* atomic for doubles */
@@ -454,6 +777,21 @@ public:
     T exchange(const T val) {
         return akl_sync_lock_test_and_set_double(&value, val);
     }
+
+    //! Returns once the bits of the value were seen to differ from those of 'old'
+    void wait(const T old) const {
+        atomic_wait((volatile akl_u64*)&value, old.u);
+    }
+
+    //! Wakes a thread in wait(), or all of them as for every 8 byte value
+    void notify_one() {
+        atomic_notify((volatile akl_u64*)&value, 1);
+    }
+
+    //! Wakes every thread in wait()
+    void notify_all() {
+        atomic_notify((volatile akl_u64*)&value, 0x7fffffff);
+    }
 };
 
 }  // namespace details
@@ -461,6 +799,9 @@ public:
 template <typename T>
 class atomic : public details::atomic_impl<T> {
 public:
+    atomic()
+        : details::atomic_impl<T>(T()) {}
+
     atomic(const T* value)
         : details::atomic_impl<T>(value) {}
 
@@ -474,4 +815,9 @@ using atomic_float_ = atomic<akl_atomic_float_t>;
 
 using atomic_double_ = atomic<akl_atomic_double_t>;
 
+//! Full memory barrier
+inline void atomic_thread_fence() {
+    akl_sync_synchronize();
+}
+
 }  // namespace akl
\ No newline at end of file
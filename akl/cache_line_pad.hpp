@@ -0,0 +1,41 @@
+#pragma once
+
+#include "utility.hpp"
+
+#define AKL_CACHE_LINE_SIZE 64
+
+namespace akl {
+/**
+ * Used to prevent false cache sharing by padding T to its own cache line.
+ * Arrays of cache_line_pad keep every element on a separate line.
+ */
+template <typename T>
+struct alignas(AKL_CACHE_LINE_SIZE) cache_line_pad {
+    T value;
+
+    cache_line_pad()
+        : value() {}
+
+    /// Constructs the value from the arguments; copies and moves of the pad itself stay with the implicit ones
+    template <typename A, typename... Args,
+              typename = typename enable_if<!is_same<typename remove_cvref<A>::type, cache_line_pad>::value>::type>
+    explicit cache_line_pad(A&& a, Args&&... args)
+        : value(akl::forward<A>(a), akl::forward<Args>(args)...) {}
+
+    T& operator=(const T& other) {
+        return value = other;
+    }
+
+    operator T() const {
+        return value;
+    }
+
+    T* operator->() {
+        return &value;
+    }
+
+    const T* operator->() const {
+        return &value;
+    }
+};  // end of cache_line_pad
+}  // namespace akl
@@ -0,0 +1,264 @@
+#pragma once
+
+#include "atomic.hpp"
+#include "kern_lib.h"
+#include "mutex.hpp"
+#include "utility.hpp"
+
+namespace akl {
+
+/**
+ * \ingroup util
+ *
+ * Append-only vector with lock free push_back, the successor of
+ * lockfree_push_back.
+ *
+ * A push reserves its index with one atomic increment and constructs the
+ * element in place. Elements live in segments that double in size and are
+ * never moved or freed while the vector exists, so growing does not block
+ * readers or writers whose segment is already allocated. Only the first
+ * writer to reach an unallocated segment takes the mutex to allocate it,
+ * and writers halfway through a segment allocate the next one ahead of time.
+ *
+ * Every slot carries a published flag, set with release ordering once the
+ * element is constructed. query() returns only published elements, so it
+ * is safe to call concurrently with push_back().
+ *
+ * A push whose segment cannot be allocated returns size_t(-1) and leaves
+ * its index unpublished, a hole that query() skips.
+ */
+template <typename T>
+class concurrent_append_vector {
+public:
+    using value_type = T;
+
+    enum { MAX_SEGMENTS = 40 };
+
+    static_assert(alignof(T) <= 16, "segments are at most 16 byte aligned");
+
+private:
+    size_t m_first_shift;
+    atomic<size_t> m_reserved;
+    atomic<unsigned char*> m_segments[MAX_SEGMENTS];
+    mutex m_grow;
+
+    // not copyable
+    concurrent_append_vector(const concurrent_append_vector&);
+    concurrent_append_vector& operator=(const concurrent_append_vector&);
+
+    size_t segment_capacity(size_t seg) const {
+        return (size_t)1 << (m_first_shift + seg);
+    }
+
+    //! Maps a global index to its segment and the offset inside it
+    void locate(size_t idx, size_t& seg, size_t& offset) const {
+        size_t biased = idx + ((size_t)1 << m_first_shift);
+        size_t top = sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(biased);
+        seg = top - m_first_shift;
+        offset = biased - ((size_t)1 << top);
+    }
+
+    static T* items(unsigned char* segment) {
+        return reinterpret_cast<T*>(segment);
+    }
+
+    volatile int* flags(unsigned char* segment, size_t seg) const {
+        return reinterpret_cast<volatile int*>(segment + segment_bytes(seg));
+    }
+
+    //! Bytes used by the elements of a segment, rounded so the flags are aligned
+    size_t segment_bytes(size_t seg) const {
+        size_t bytes = segment_capacity(seg) * sizeof(T);
+        return (bytes + sizeof(int) - 1) & ~(sizeof(int) - 1);
+    }
+
+    //! Returns segment "seg", allocating it if needed. NULL if that failed
+    unsigned char* ensure_segment(size_t seg) {
+        unsigned char* segment = m_segments[seg].load_acquire();
+        if (segment) {
+            return segment;
+        }
+        m_grow.lock();
+        segment = m_segments[seg].load_acquire();
+        if (!segment) {
+            size_t nflags = segment_capacity(seg) * sizeof(int);
+            segment = static_cast<unsigned char*>(akl_cmalloc(segment_bytes(seg) + nflags));
+            if (segment) {
+                akl_memset(segment + segment_bytes(seg), 0, nflags);
+                m_segments[seg].store_release(segment);
+            }
+        }
+        m_grow.unlock();
+        return segment;
+    }
+
+    //! Returns the slot for "idx", allocating its segment if needed. NULL if there is none
+    T* claim(size_t idx, volatile int*& flag) {
+        size_t seg, offset;
+        locate(idx, seg, offset);
+        if (seg >= MAX_SEGMENTS) {
+            return NULL;
+        }
+        unsigned char* segment = ensure_segment(seg);
+        if (!segment) {
+            return NULL;
+        }
+        // allocate the next segment before anyone has to wait for it
+        if (offset == segment_capacity(seg) / 2 && seg + 1 < MAX_SEGMENTS) {
+            ensure_segment(seg + 1);
+        }
+        flag = flags(segment, seg) + offset;
+        return items(segment) + offset;
+    }
+
+    //! Returns the published element at "idx" or NULL
+    T* published(size_t idx) const {
+        if (idx >= m_reserved.load_acquire()) {
+            return NULL;
+        }
+        size_t seg, offset;
+        locate(idx, seg, offset);
+        unsigned char* segment = m_segments[seg].load_acquire();
+        if (!segment || !akl_sync_load_acquire(flags(segment, seg) + offset)) {
+            return NULL;
+        }
+        return items(segment) + offset;
+    }
+
+public:
+    /**
+     * Creates an empty vector. The first segment holds "first_segment"
+     * elements, rounded up to a power of two.
+     */
+    explicit concurrent_append_vector(size_t first_segment = 64)
+        : m_first_shift(0) {
+        while (((size_t)1 << m_first_shift) < first_segment) {
+            ++m_first_shift;
+        }
+    }
+
+    //! Destroys the published elements. No push may be in flight
+    ~concurrent_append_vector() {
+        for (size_t seg = 0; seg < MAX_SEGMENTS; ++seg) {
+            unsigned char* segment = m_segments[seg];
+            if (!segment) {
+                continue;
+            }
+            if (!is_trivially_destructible<T>::value) {
+                volatile int* flag = flags(segment, seg);
+                for (size_t i = 0; i < segment_capacity(seg); ++i) {
+                    if (flag[i]) {
+                        items(segment)[i].~T();
+                    }
+                }
+            }
+            akl_cfree(segment);
+        }
+    }
+
+    /// Number of reserved slots. Slots below it may still be under construction
+    size_t size() const {
+        return m_reserved.load_acquire();
+    }
+
+    /**
+     * Allocates segments up front so that the first "n" pushes never
+     * allocate. Returns false if a segment could not be allocated.
+     */
+    bool reserve(size_t n) {
+        if (n == 0) {
+            return true;
+        }
+        size_t last, offset;
+        locate(n - 1, last, offset);
+        if (last >= MAX_SEGMENTS) {
+            return false;
+        }
+        for (size_t seg = 0; seg <= last; ++seg) {
+            if (!ensure_segment(seg)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Constructs an element at the end, returning its index or size_t(-1)
+    template <typename... Args>
+    size_t emplace_back(Args&&... args) {
+        size_t idx = m_reserved.inc_ret_last();
+        volatile int* flag;
+        T* slot = claim(idx, flag);
+        if (!slot) {
+            return size_t(-1);
+        }
+        new (slot) T(akl::forward<Args>(args)...);
+        akl_sync_store_release(flag, 1);
+        return idx;
+    }
+
+    /// Appends a copy of "t", returning its index or size_t(-1)
+    size_t push_back(const T& t) {
+        return emplace_back(t);
+    }
+
+    /// Appends "t" by move, returning its index or size_t(-1)
+    size_t push_back(T&& t) {
+        return emplace_back(akl::move(t));
+    }
+
+    /**
+     * Appends [begin, end) at consecutive indices with a single
+     * reservation. Returns the index one past the last element, or
+     * size_t(-1) if some elements found no slot.
+     */
+    template <typename Iterator>
+    size_t push_back(Iterator begin, Iterator end) {
+        size_t numel = 0;
+        for (Iterator it = begin; it != end; ++it) {
+            ++numel;
+        }
+        size_t putpos = m_reserved.inc_ret_last(numel);
+        bool stored = true;
+        for (; begin != end; ++begin, ++putpos) {
+            volatile int* flag;
+            T* slot = claim(putpos, flag);
+            if (!slot) {
+                stored = false;
+                continue;
+            }
+            new (slot) T(*begin);
+            akl_sync_store_release(flag, 1);
+        }
+        return stored ? putpos : size_t(-1);
+    }
+
+    /// Copies element "item" into "value" if it has been published
+    bool query(size_t item, T& value) const {
+        T* ptr = published(item);
+        if (!ptr) {
+            return false;
+        }
+        value = *ptr;
+        return true;
+    }
+
+    /// Returns element "item", or NULL if it has not been published yet
+    T* query(size_t item) {
+        return published(item);
+    }
+
+    /// Unchecked access, "idx" must have been published
+    T& operator[](size_t idx) {
+        size_t seg, offset;
+        locate(idx, seg, offset);
+        return items(m_segments[seg])[offset];
+    }
+
+    const T& operator[](size_t idx) const {
+        size_t seg, offset;
+        locate(idx, seg, offset);
+        return items(m_segments[seg])[offset];
+    }
+};
+
+}  // namespace akl
@@ -0,0 +1,457 @@
+#pragma once
+
+#include "cache_line_pad.hpp"
+#include "hash.hpp"
+#include "kern_lib.h"
+#include "spinlock.hpp"
+#include "utility.hpp"
+
+namespace akl {
+
+namespace details {
+
+//! Maps the read/write locking used by concurrent_hash_map onto a lock type
+template <typename Lock>
+struct stripe_lock_traits {
+    static void read_lock(const Lock& l) {
+        l.readlock();
+    }
+
+    static void read_unlock(const Lock& l) {
+        l.rdunlock();
+    }
+
+    static void write_lock(const Lock& l) {
+        l.writelock();
+    }
+
+    static void write_unlock(const Lock& l) {
+        l.wrunlock();
+    }
+};
+
+//! Exclusive locks serve readers the same way as writers
+template <>
+struct stripe_lock_traits<spinlock> {
+    static void read_lock(const spinlock& l) {
+        l.lock();
+    }
+
+    static void read_unlock(const spinlock& l) {
+        l.unlock();
+    }
+
+    static void write_lock(const spinlock& l) {
+        l.lock();
+    }
+
+    static void write_unlock(const spinlock& l) {
+        l.unlock();
+    }
+};
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * Hash map split into independently locked stripes.
+ *
+ * The high bits of a key's hash pick the stripe, the low bits the slot in
+ * the stripe's open addressing table (linear probing, tombstones on
+ * erase). Every stripe sits on its own cache line with its lock, so
+ * threads working on different stripes never touch the same line. Lock is
+ * spin_rwlock by default, which lets lookups in one stripe run in
+ * parallel; spinlock is cheaper when writes dominate.
+ *
+ * Growing never stops the world: a full stripe allocates a bigger table
+ * and keeps the old one, lookups probe both, and every write to the
+ * stripe moves a few old slots over until the old table is empty and
+ * freed. Apart from those table allocations no operation allocates; an
+ * insert whose stripe cannot get a bigger table fails. A map whose
+ * stripes cannot be allocated runs on one stripe kept in the object.
+ *
+ * Values are copied out under the lock; there are no references into the
+ * table that outlive a call.
+ */
+template <typename K, typename V, typename Hash = hash<K>, typename Lock = spin_rwlock>
+class concurrent_hash_map {
+private:
+    using lock_traits = details::stripe_lock_traits<Lock>;
+
+    enum { EMPTY = 0, FULL = 1, DELETED = 2 };
+
+    //! old slots moved per write while a stripe is growing
+    enum { MIGRATE_STEP = 16 };
+
+    enum { MIN_CAPACITY = 8 };
+
+    struct entry {
+        K key;
+        V value;
+    };
+
+    struct table {
+        entry* entries;
+        unsigned char* ctrl;
+        size_t mask;
+        //! FULL slots
+        size_t live;
+        //! FULL and DELETED slots
+        size_t used;
+
+        table()
+            : entries(NULL), ctrl(NULL), mask(0), live(0), used(0) {}
+
+        size_t capacity() const {
+            return entries ? mask + 1 : 0;
+        }
+    };
+
+    struct stripe {
+        Lock lock;
+        table current;
+        //! table being drained into current, empty when not growing
+        table old;
+        //! next slot of old to move
+        size_t migrated;
+
+        stripe()
+            : migrated(0) {}
+    };
+
+    static_assert(alignof(entry) <= 16, "entries are at most 16 byte aligned");
+
+    cache_line_pad<stripe>* m_stripes;
+    void* m_stripes_block;
+    //! the only stripe when the block could not be allocated
+    cache_line_pad<stripe> m_fallback;
+    size_t m_stripe_bits;
+    Hash m_hash;
+
+    // not copyable
+    concurrent_hash_map(const concurrent_hash_map&);
+    concurrent_hash_map& operator=(const concurrent_hash_map&);
+
+    stripe& stripe_for(akl_u64 h) const {
+        size_t idx = m_stripe_bits ? (size_t)(h >> (64 - m_stripe_bits)) : 0;
+        return m_stripes[idx].value;
+    }
+
+    //! Gives "t" an empty table of "capacity" slots, leaves it alone if that failed
+    static bool allocate(table& t, size_t capacity) {
+        size_t bytes = capacity * sizeof(entry);
+        unsigned char* block = static_cast<unsigned char*>(akl_cmalloc(bytes + capacity));
+        if (!block) {
+            return false;
+        }
+        t.entries = reinterpret_cast<entry*>(block);
+        t.ctrl = block + bytes;
+        akl_memset(t.ctrl, EMPTY, capacity);
+        t.mask = capacity - 1;
+        t.live = 0;
+        t.used = 0;
+        return true;
+    }
+
+    static void release(table& t) {
+        if (!is_trivially_destructible<entry>::value) {
+            for (size_t i = 0; i < t.capacity(); ++i) {
+                if (t.ctrl[i] == FULL) {
+                    t.entries[i].~entry();
+                }
+            }
+        }
+        akl_cfree(t.entries);
+        t = table();
+    }
+
+    //! Slot holding "key" in "t", or -1
+    long find_in(const table& t, const K& key, akl_u64 h) const {
+        if (!t.entries) {
+            return -1;
+        }
+        for (size_t i = h & t.mask;; i = (i + 1) & t.mask) {
+            unsigned char c = t.ctrl[i];
+            if (c == EMPTY) {
+                return -1;
+            }
+            if (c == FULL && t.entries[i].key == key) {
+                return (long)i;
+            }
+        }
+    }
+
+    //! Finds "key" in either table of "s", setting "where" to its table
+    entry* find_entry(stripe& s, const K& key, akl_u64 h, table*& where) const {
+        long i = find_in(s.current, key, h);
+        if (i >= 0) {
+            where = &s.current;
+            return &s.current.entries[i];
+        }
+        i = find_in(s.old, key, h);
+        if (i >= 0) {
+            where = &s.old;
+            return &s.old.entries[i];
+        }
+        return NULL;
+    }
+
+    //! Constructs a new entry in "t", which must not hold "key" and have room
+    template <typename KArg, typename VArg>
+    static void place(table& t, akl_u64 h, KArg&& key, VArg&& value) {
+        size_t i = h & t.mask;
+        while (t.ctrl[i] == FULL) {
+            i = (i + 1) & t.mask;
+        }
+        if (t.ctrl[i] == EMPTY) {
+            ++t.used;
+        }
+        t.ctrl[i] = FULL;
+        ++t.live;
+        new (&t.entries[i]) entry{akl::forward<KArg>(key), akl::forward<VArg>(value)};
+    }
+
+    static void remove_at(table& t, size_t i) {
+        t.entries[i].~entry();
+        t.ctrl[i] = DELETED;
+        --t.live;
+    }
+
+    //! Moves up to "n" slots of the old table into the current one
+    void migrate(stripe& s, size_t n) {
+        if (!s.old.entries) {
+            return;
+        }
+        size_t end = akl::min(s.migrated + n, s.old.capacity());
+        for (; s.migrated < end; ++s.migrated) {
+            size_t i = s.migrated;
+            if (s.old.ctrl[i] != FULL) {
+                continue;
+            }
+            entry& e = s.old.entries[i];
+            place(s.current, m_hash(e.key), akl::move(e.key), akl::move(e.value));
+            remove_at(s.old, i);
+        }
+        if (s.migrated == s.old.capacity()) {
+            release(s.old);
+            s.migrated = 0;
+        }
+    }
+
+    //! Makes room for one more entry, starting a new table if needed. False if that failed
+    bool reserve_one(stripe& s) {
+        size_t cap = s.current.capacity();
+        if ((s.current.used + 1) * 8 <= cap * 7) {
+            return true;
+        }
+        // a second grow before the first finished: drain it first
+        migrate(s, s.old.capacity());
+        size_t next = cap ? cap * 2 : (size_t)MIN_CAPACITY;
+        if (s.current.live * 2 < cap) {
+            // mostly tombstones: rebuild at the same size
+            next = cap;
+        }
+        table fresh;
+        if (!allocate(fresh, next)) {
+            return false;
+        }
+        s.old = s.current;
+        s.migrated = 0;
+        s.current = fresh;
+        return true;
+    }
+
+    //! Begins a write on the stripe of "h": locks it and advances growing
+    stripe& write_begin(akl_u64 h) {
+        stripe& s = stripe_for(h);
+        lock_traits::write_lock(s.lock);
+        migrate(s, MIGRATE_STEP);
+        return s;
+    }
+
+    template <typename VArg>
+    bool insert_impl(const K& key, VArg&& value, bool assign) {
+        akl_u64 h = m_hash(key);
+        stripe& s = write_begin(h);
+        table* where;
+        entry* e = find_entry(s, key, h, where);
+        if (e) {
+            if (assign) {
+                e->value = akl::forward<VArg>(value);
+            }
+            lock_traits::write_unlock(s.lock);
+            return false;
+        }
+        bool room = reserve_one(s);
+        if (room) {
+            place(s.current, h, key, akl::forward<VArg>(value));
+        }
+        lock_traits::write_unlock(s.lock);
+        return room;
+    }
+
+public:
+    /**
+     * Creates a map split into "stripes" stripes (rounded up to a power of
+     * two) sized so that "expected" entries fit without growing.
+     */
+    explicit concurrent_hash_map(size_t expected = 0, size_t stripes = 64)
+        : m_stripe_bits(0) {
+        while (((size_t)1 << m_stripe_bits) < stripes) {
+            ++m_stripe_bits;
+        }
+        size_t count = (size_t)1 << m_stripe_bits;
+
+        // akl_cmalloc aligns to 16 only
+        size_t bytes = count * sizeof(cache_line_pad<stripe>) + AKL_CACHE_LINE_SIZE - 1;
+        m_stripes_block = akl_cmalloc(bytes);
+        if (m_stripes_block) {
+            size_t addr = ((size_t)m_stripes_block + AKL_CACHE_LINE_SIZE - 1) & ~(size_t)(AKL_CACHE_LINE_SIZE - 1);
+            m_stripes = reinterpret_cast<cache_line_pad<stripe>*>(addr);
+            for (size_t i = 0; i < count; ++i) {
+                new (&m_stripes[i]) cache_line_pad<stripe>();
+            }
+        } else {
+            m_stripe_bits = 0;
+            count = 1;
+            m_stripes = &m_fallback;
+        }
+
+        size_t per_stripe = expected / count * 8 / 7 + 1;
+        size_t capacity = MIN_CAPACITY;
+        while (capacity < per_stripe) {
+            capacity <<= 1;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            // a stripe left without a table gets one on its first insert
+            allocate(m_stripes[i].value.current, capacity);
+        }
+    }
+
+    //! No other thread may use the map
+    ~concurrent_hash_map() {
+        for (size_t i = 0; i < stripe_count(); ++i) {
+            stripe& s = m_stripes[i].value;
+            release(s.current);
+            if (s.old.entries) {
+                release(s.old);
+            }
+            if (m_stripes_block) {
+                m_stripes[i].~cache_line_pad<stripe>();
+            }
+        }
+        akl_cfree(m_stripes_block);
+    }
+
+    size_t stripe_count() const {
+        return (size_t)1 << m_stripe_bits;
+    }
+
+    /// Number of entries; stripes are counted one after another
+    size_t size() const {
+        size_t total = 0;
+        for (size_t i = 0; i < stripe_count(); ++i) {
+            stripe& s = m_stripes[i].value;
+            lock_traits::read_lock(s.lock);
+            total += s.current.live + s.old.live;
+            lock_traits::read_unlock(s.lock);
+        }
+        return total;
+    }
+
+    /// Copies the value of "key" into "out". Returns false if absent
+    bool find(const K& key, V& out) const {
+        akl_u64 h = m_hash(key);
+        stripe& s = stripe_for(h);
+        lock_traits::read_lock(s.lock);
+        table* where;
+        entry* e = find_entry(s, key, h, where);
+        if (e) {
+            out = e->value;
+        }
+        lock_traits::read_unlock(s.lock);
+        return e != NULL;
+    }
+
+    bool contains(const K& key) const {
+        akl_u64 h = m_hash(key);
+        stripe& s = stripe_for(h);
+        lock_traits::read_lock(s.lock);
+        table* where;
+        bool found = find_entry(s, key, h, where) != NULL;
+        lock_traits::read_unlock(s.lock);
+        return found;
+    }
+
+    /// Adds "key" if it is absent. Returns false if it was already there or found no room
+    bool insert(const K& key, const V& value) {
+        return insert_impl(key, value, false);
+    }
+
+    bool insert(const K& key, V&& value) {
+        return insert_impl(key, akl::move(value), false);
+    }
+
+    /// Adds "key" or overwrites its value. Returns true if it was added, false if assigned or out of room
+    bool insert_or_assign(const K& key, const V& value) {
+        return insert_impl(key, value, true);
+    }
+
+    bool insert_or_assign(const K& key, V&& value) {
+        return insert_impl(key, akl::move(value), true);
+    }
+
+    /**
+     * Calls fn(V&) on the value of "key" under the stripe's write lock.
+     * Returns false if the key is absent. fn must not use the map.
+     */
+    template <typename Fn>
+    bool update(const K& key, Fn fn) {
+        akl_u64 h = m_hash(key);
+        stripe& s = write_begin(h);
+        table* where;
+        entry* e = find_entry(s, key, h, where);
+        if (e) {
+            fn(e->value);
+        }
+        lock_traits::write_unlock(s.lock);
+        return e != NULL;
+    }
+
+    /// Removes "key". Returns false if it was absent
+    bool erase(const K& key) {
+        akl_u64 h = m_hash(key);
+        stripe& s = write_begin(h);
+        table* where;
+        entry* e = find_entry(s, key, h, where);
+        if (e) {
+            remove_at(*where, e - where->entries);
+        }
+        lock_traits::write_unlock(s.lock);
+        return e != NULL;
+    }
+
+    /// Removes every entry, keeping each stripe's current table
+    void clear() {
+        for (size_t i = 0; i < stripe_count(); ++i) {
+            stripe& s = m_stripes[i].value;
+            lock_traits::write_lock(s.lock);
+            if (s.old.entries) {
+                release(s.old);
+                s.migrated = 0;
+            }
+            for (size_t j = 0; j < s.current.capacity(); ++j) {
+                if (s.current.ctrl[j] == FULL) {
+                    s.current.entries[j].~entry();
+                }
+            }
+            akl_memset(s.current.ctrl, EMPTY, s.current.capacity());
+            s.current.live = 0;
+            s.current.used = 0;
+            lock_traits::write_unlock(s.lock);
+        }
+    }
+};
+
+}  // namespace akl
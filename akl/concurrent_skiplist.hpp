@@ -0,0 +1,460 @@
+#pragma once
+
+#include "atomic.hpp"
+#include "epoch.hpp"
+#include "hash.hpp"
+#include "kern_lib.h"
+#include "lockfree_stack.hpp"
+#include "spinlock.hpp"
+#include "utility.hpp"
+
+namespace akl {
+
+namespace details {
+
+enum {
+    //! tallest tower, enough for 4^16 entries at p = 1/4
+    SKIPLIST_MAX_LEVEL = 16,
+    //! bytes carved out of one pool allocation
+    SKIPLIST_CHUNK_BYTES = 16384
+};
+
+//! Fast per-thread generator for tower heights (xorshift64)
+inline akl_u64 skiplist_random() {
+#ifdef __KERNEL_MODULE__
+    // no thread_local in the kernel: a shared counter, mixed
+    static atomic<akl_u64> counter;
+    return hash_mix(counter.inc());
+#else
+    static thread_local akl_u64 state = 0;
+    if (state == 0) {
+        state = hash_mix((akl_u64)(size_t)&state) | 1;
+    }
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+#endif
+}
+
+//! Height in [1, SKIPLIST_MAX_LEVEL], each extra level with probability 1/4
+inline int skiplist_random_height() {
+    akl_u64 bits = skiplist_random();
+    int height = 1;
+    while (height < SKIPLIST_MAX_LEVEL && (bits & 3) == 0) {
+        ++height;
+        bits >>= 2;
+    }
+    return height;
+}
+
+/**
+ * Fixed size blocks for one tower height, carved from large chunks.
+ * Free blocks sit on a lock free stack; blocks return to the allocator
+ * only when the pool dies, which also keeps the stack's stale link reads
+ * on live memory.
+ *
+ * Every block starts with its free list link. Users keep the link in
+ * place and never write to it, since pop() may still read it after the
+ * block was handed out.
+ */
+class skiplist_pool {
+public:
+    struct block : lockfree_stack_hook {};
+
+private:
+    struct chunk {
+        chunk* next;
+    };
+
+    size_t m_block_size;
+    intrusive_lockfree_stack<block> m_free;
+    spinlock m_chunks_lock;
+    chunk* m_chunks;
+
+    // not copyable
+    skiplist_pool(const skiplist_pool&);
+    skiplist_pool& operator=(const skiplist_pool&);
+
+    //! Carves a new chunk into free blocks. False if it could not be allocated
+    bool refill() {
+        size_t header = (sizeof(chunk) + 15) & ~(size_t)15;
+        size_t count = akl::max((size_t)4, (size_t)SKIPLIST_CHUNK_BYTES / m_block_size);
+        unsigned char* raw = static_cast<unsigned char*>(akl_cmalloc(header + count * m_block_size));
+        if (!raw) {
+            return false;
+        }
+        chunk* c = reinterpret_cast<chunk*>(raw);
+        m_chunks_lock.lock();
+        c->next = m_chunks;
+        m_chunks = c;
+        m_chunks_lock.unlock();
+
+        // link the blocks into one chain and push it with a single cas
+        block* first = NULL;
+        block* last = NULL;
+        for (size_t i = 0; i < count; ++i) {
+            block* b = new (raw + header + i * m_block_size) block();
+            if (!first) {
+                first = b;
+            } else {
+                last->next.store_release(b);
+            }
+            last = b;
+        }
+        m_free.push_list(first, last);
+        return true;
+    }
+
+public:
+    skiplist_pool()
+        : m_block_size(0), m_chunks(NULL) {}
+
+    ~skiplist_pool() {
+        while (m_chunks) {
+            chunk* next = m_chunks->next;
+            akl_cfree(m_chunks);
+            m_chunks = next;
+        }
+    }
+
+    void init(size_t block_size) {
+        m_block_size = (block_size + 15) & ~(size_t)15;
+    }
+
+    //! A free block, NULL if none is left and no chunk could be allocated
+    block* get() {
+        while (true) {
+            block* b = m_free.pop();
+            if (b) {
+                return b;
+            }
+            if (!refill()) {
+                return NULL;
+            }
+        }
+    }
+
+    void put(block* b) {
+        m_free.push(b);
+    }
+};
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * Ordered map for concurrent inserts, lookups and range scans (the lazy
+ * skip list of Herlihy, Lev, Luchangco and Shavit).
+ *
+ * Searches and scans take no locks: they walk the towers inside an
+ * akl::epoch reader section. insert() locks only the predecessors of the
+ * new tower, re-validates them and links bottom up; the node becomes
+ * visible once fully linked. erase() is lazy: it marks the node first,
+ * which removes it logically, then unlinks it under the predecessors'
+ * locks and retires it to the epoch domain.
+ *
+ * Tower heights come from a per-thread xorshift generator (p = 1/4).
+ * Nodes come from one pool per height that carves chunks of
+ * SKIPLIST_CHUNK_BYTES, so inserts do not call akl_cmalloc per node.
+ *
+ * Values are immutable once inserted; K needs < and ==.
+ */
+template <typename K, typename V>
+class concurrent_skiplist {
+private:
+    struct node {
+        //! owned by the pool, see skiplist_pool
+        details::skiplist_pool::block link;
+        K key;
+        V value;
+        //! pool the node returns to when it is reclaimed
+        details::skiplist_pool* pool;
+        spinlock lock;
+        atomic<int> marked;
+        atomic<int> fully_linked;
+        int top_level;
+        //! really top_level + 1 entries, allocated with the node
+        atomic<node*> next[1];
+    };
+
+    static_assert(alignof(node) <= 16, "pool blocks are 16 byte aligned");
+
+    details::skiplist_pool m_pools[details::SKIPLIST_MAX_LEVEL];
+    node* m_head;
+    //! the head's tower lives in the object, so construction cannot fail
+    alignas(node) unsigned char m_head_block[sizeof(node) + (details::SKIPLIST_MAX_LEVEL - 1) * sizeof(atomic<node*>)];
+    atomic<size_t> m_size;
+    //! declared after the pools, so retired nodes go back before they die
+    epoch m_epoch;
+
+    // not copyable
+    concurrent_skiplist(const concurrent_skiplist&);
+    concurrent_skiplist& operator=(const concurrent_skiplist&);
+
+    static size_t node_size(int height) {
+        return sizeof(node) + (height - 1) * sizeof(atomic<node*>);
+    }
+
+    //! A node of "height" levels with empty links, NULL if the pool ran dry
+    node* create(int height) {
+        node* n = reinterpret_cast<node*>(m_pools[height - 1].get());
+        if (!n) {
+            return NULL;
+        }
+        n->pool = &m_pools[height - 1];
+        new (&n->lock) spinlock();
+        new (&n->marked) atomic<int>();
+        new (&n->fully_linked) atomic<int>();
+        n->top_level = height - 1;
+        for (int i = 0; i < height; ++i) {
+            new (&n->next[i]) atomic<node*>();
+        }
+        return n;
+    }
+
+    //! Also the deleter of retired nodes
+    static void destroy(void* p) {
+        node* n = static_cast<node*>(p);
+        n->key.~K();
+        n->value.~V();
+        n->pool->put(&n->link);
+    }
+
+    /**
+     * Fills preds/succs for "key" on every level. Returns the highest
+     * level on which a node with "key" was seen, or -1.
+     */
+    int find(const K& key, node** preds, node** succs) const {
+        int found = -1;
+        node* pred = m_head;
+        for (int level = details::SKIPLIST_MAX_LEVEL - 1; level >= 0; --level) {
+            node* curr = pred->next[level].load_acquire();
+            while (curr && curr->key < key) {
+                pred = curr;
+                curr = pred->next[level].load_acquire();
+            }
+            if (found == -1 && curr && curr->key == key) {
+                found = level;
+            }
+            preds[level] = pred;
+            succs[level] = curr;
+        }
+        return found;
+    }
+
+    //! Unlocks the distinct predecessors on levels [0, highest]
+    static void unlock_preds(node** preds, int highest) {
+        node* prev = NULL;
+        for (int level = 0; level <= highest; ++level) {
+            if (preds[level] != prev) {
+                preds[level]->lock.unlock();
+                prev = preds[level];
+            }
+        }
+    }
+
+    /**
+     * Locks the predecessors on levels [0, top] and checks that each still
+     * links to succs (or to "victim"), none being removed. Returns the
+     * highest level locked in "highest"; on failure everything is unlocked.
+     */
+    static bool lock_preds(node** preds, node** succs, int top, node* victim) {
+        node* prev = NULL;
+        int highest = -1;
+        bool valid = true;
+        for (int level = 0; valid && level <= top; ++level) {
+            node* pred = preds[level];
+            node* succ = victim ? victim : succs[level];
+            if (pred != prev) {
+                pred->lock.lock();
+                highest = level;
+                prev = pred;
+            }
+            valid = !pred->marked.load_acquire() && pred->next[level].load_acquire() == succ &&
+                    (victim || !succ || !succ->marked.load_acquire());
+        }
+        if (!valid) {
+            unlock_preds(preds, highest);
+        }
+        return valid;
+    }
+
+    template <typename VArg>
+    bool insert_impl(const K& key, VArg&& value) {
+        int top = details::skiplist_random_height() - 1;
+        node* preds[details::SKIPLIST_MAX_LEVEL];
+        node* succs[details::SKIPLIST_MAX_LEVEL];
+        epoch::guard g(m_epoch);
+        while (true) {
+            int found = find(key, preds, succs);
+            if (found != -1) {
+                node* existing = succs[found];
+                if (!existing->marked.load_acquire()) {
+                    // another insert of the same key, wait until it is visible
+                    unsigned spins = 0;
+                    while (!existing->fully_linked.load_acquire()) {
+                        details::spin_wait(spins);
+                    }
+                    return false;
+                }
+                // being erased, retry once it is unlinked
+                continue;
+            }
+            if (!lock_preds(preds, succs, top, NULL)) {
+                continue;
+            }
+            node* n = create(top + 1);
+            if (!n) {
+                unlock_preds(preds, top);
+                return false;
+            }
+            new (&n->key) K(key);
+            new (&n->value) V(akl::forward<VArg>(value));
+            for (int level = 0; level <= top; ++level) {
+                n->next[level].store_release(succs[level]);
+            }
+            for (int level = 0; level <= top; ++level) {
+                preds[level]->next[level].store_release(n);
+            }
+            n->fully_linked.store_release(1);
+            unlock_preds(preds, top);
+            m_size.inc();
+            return true;
+        }
+    }
+
+public:
+    concurrent_skiplist() {
+        for (int h = 1; h <= details::SKIPLIST_MAX_LEVEL; ++h) {
+            m_pools[h - 1].init(node_size(h));
+        }
+        // the head never holds a key, only its links are used
+        m_head = reinterpret_cast<node*>(m_head_block);
+        new (&m_head->lock) spinlock();
+        new (&m_head->marked) atomic<int>();
+        new (&m_head->fully_linked) atomic<int>(1);
+        m_head->top_level = details::SKIPLIST_MAX_LEVEL - 1;
+        for (int i = 0; i < details::SKIPLIST_MAX_LEVEL; ++i) {
+            new (&m_head->next[i]) atomic<node*>();
+        }
+    }
+
+    //! No other thread may use the list
+    ~concurrent_skiplist() {
+        node* n = m_head->next[0].load_acquire();
+        while (n) {
+            node* next = n->next[0].load_acquire();
+            destroy(n);
+            n = next;
+        }
+    }
+
+    /// Number of entries, approximate while inserts or erases run
+    size_t size() const {
+        return m_size.load_acquire();
+    }
+
+    /// Adds "key" if it is absent. Returns false if it was already there or no node was left
+    bool insert(const K& key, const V& value) {
+        return insert_impl(key, value);
+    }
+
+    bool insert(const K& key, V&& value) {
+        return insert_impl(key, akl::move(value));
+    }
+
+    /// Copies the value of "key" into "out". Returns false if absent
+    bool find(const K& key, V& out) {
+        node* preds[details::SKIPLIST_MAX_LEVEL];
+        node* succs[details::SKIPLIST_MAX_LEVEL];
+        epoch::guard g(m_epoch);
+        int found = find(key, preds, succs);
+        if (found == -1) {
+            return false;
+        }
+        node* n = succs[found];
+        if (!n->fully_linked.load_acquire() || n->marked.load_acquire()) {
+            return false;
+        }
+        out = n->value;
+        return true;
+    }
+
+    bool contains(const K& key) {
+        node* preds[details::SKIPLIST_MAX_LEVEL];
+        node* succs[details::SKIPLIST_MAX_LEVEL];
+        epoch::guard g(m_epoch);
+        int found = find(key, preds, succs);
+        return found != -1 && succs[found]->fully_linked.load_acquire() && !succs[found]->marked.load_acquire();
+    }
+
+    /// Removes "key". Returns false if it was absent
+    bool erase(const K& key) {
+        node* preds[details::SKIPLIST_MAX_LEVEL];
+        node* succs[details::SKIPLIST_MAX_LEVEL];
+        node* victim = NULL;
+        epoch::guard g(m_epoch);
+        while (true) {
+            int found = find(key, preds, succs);
+            if (!victim) {
+                if (found == -1) {
+                    return false;
+                }
+                node* n = succs[found];
+                // only a fully linked node found at its own top level is stable
+                if (!n->fully_linked.load_acquire() || n->top_level != found || n->marked.load_acquire()) {
+                    return false;
+                }
+                n->lock.lock();
+                if (n->marked.load_acquire()) {
+                    n->lock.unlock();
+                    return false;
+                }
+                n->marked.store_release(1);
+                victim = n;
+            }
+            if (!lock_preds(preds, succs, victim->top_level, victim)) {
+                continue;
+            }
+            for (int level = victim->top_level; level >= 0; --level) {
+                preds[level]->next[level].store_release(victim->next[level].load_acquire());
+            }
+            victim->lock.unlock();
+            unlock_preds(preds, victim->top_level);
+            m_size.dec();
+            m_epoch.retire(victim, &destroy);
+            return true;
+        }
+    }
+
+    /**
+     * Calls fn(const K&, const V&) for the entries with keys in
+     * [from, to), in order, and returns how many there were. Inserts and
+     * erases may run concurrently; the scan sees each entry that is present
+     * for its whole duration, and may or may not see the others.
+     */
+    template <typename Fn>
+    size_t scan(const K& from, const K& to, Fn fn) {
+        epoch::guard g(m_epoch);
+        node* pred = m_head;
+        for (int level = details::SKIPLIST_MAX_LEVEL - 1; level >= 0; --level) {
+            node* curr = pred->next[level].load_acquire();
+            while (curr && curr->key < from) {
+                pred = curr;
+                curr = pred->next[level].load_acquire();
+            }
+        }
+        size_t count = 0;
+        for (node* n = pred->next[0].load_acquire(); n && n->key < to; n = n->next[0].load_acquire()) {
+            if (n->fully_linked.load_acquire() && !n->marked.load_acquire()) {
+                fn(const_cast<const K&>(n->key), const_cast<const V&>(n->value));
+                ++count;
+            }
+        }
+        return count;
+    }
+};
+
+}  // namespace akl
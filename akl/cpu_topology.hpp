@@ -0,0 +1,333 @@
+#pragma once
+
+#ifndef __KERNEL_MODULE__
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+#include "kern_lib.h"
+#include "utility.hpp"
+#include "vector.hpp"
+
+namespace akl {
+
+/// Where thread_pool and thread_group put their threads
+enum cpu_placement {
+    //! no pinning, the scheduler decides
+    CPU_PLACEMENT_NONE,
+    //! fills the hyperthreads of a core, then the next core of the same L3
+    CPU_PLACEMENT_COMPACT,
+    //! one thread per physical core, round robin over the L3 domains,
+    //! before any core gets a second hyperthread
+    CPU_PLACEMENT_SCATTER_CORES,
+    //! fills one L3 domain at a time, its physical cores before their
+    //! hyperthreads, so neighbouring threads share a cache
+    CPU_PLACEMENT_PER_L3
+};
+
+namespace details {
+
+#ifndef __KERNEL_MODULE__
+//! Reads a small sysfs file into "buf", returns false if it is missing
+inline bool read_sys_file(const char* path, char* buf, size_t size) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    size_t len = fread(buf, 1, size - 1, f);
+    fclose(f);
+    buf[len] = '\0';
+    return len > 0;
+}
+
+//! Calls fn(cpu) for every cpu of a sysfs list such as "0-3,8,10-11"
+template <typename Fn>
+void parse_cpu_list(const char* s, Fn fn) {
+    while (*s >= '0' && *s <= '9') {
+        int first = 0;
+        while (*s >= '0' && *s <= '9') {
+            first = first * 10 + (*s++ - '0');
+        }
+        int last = first;
+        if (*s == '-') {
+            ++s;
+            last = 0;
+            while (*s >= '0' && *s <= '9') {
+                last = last * 10 + (*s++ - '0');
+            }
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            fn(cpu);
+        }
+        if (*s == ',') {
+            ++s;
+        }
+    }
+}
+
+//! Lowest cpu of the list in the sysfs file "path", or "fallback"
+inline int first_listed_cpu(const char* path, int fallback) {
+    char buf[256];
+    int first = -1;
+    if (read_sys_file(path, buf, sizeof(buf))) {
+        parse_cpu_list(buf, [&first](int cpu) {
+            if (first < 0) {
+                first = cpu;
+            }
+        });
+    }
+    return first < 0 ? fallback : first;
+}
+#endif
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * Online cpus grouped by package, physical core and last level (L3)
+ * cache, read once at construction: from /sys/devices/system/cpu in
+ * userspace, from the topology_* helpers in the kernel. cpu_for() turns
+ * a thread index into a cpu under a cpu_placement.
+ *
+ * Machines without topology information look like one L3 domain of
+ * single threaded cores.
+ */
+class cpu_topology {
+public:
+    struct cpu_info {
+        int cpu;
+        int package;
+        //! lowest cpu of the physical core
+        int core;
+        //! the same for every cpu of one L3 domain
+        int llc;
+        //! rank among the hyperthreads of its core
+        int smt;
+        //! rank of its core within the L3 domain
+        int core_rank;
+        //! rank of the L3 domain
+        int llc_rank;
+    };
+
+private:
+    vector<cpu_info> m_cpus;
+    vector<int> m_online;
+    vector<int> m_compact;
+    vector<int> m_scatter;
+    vector<int> m_per_l3;
+    size_t m_cores;
+    size_t m_llcs;
+
+    // not copyable
+    cpu_topology(const cpu_topology&);
+    cpu_topology& operator=(const cpu_topology&);
+
+    void add_cpu(int cpu, int package, int core, int llc) {
+        cpu_info info = {cpu, package, core, llc, 0, 0, 0};
+        // a cpu that finds no room is left out, threads are never pinned to it
+        m_cpus.push_back(info);
+    }
+
+    void read() {
+#ifdef __KERNEL_MODULE__
+        for (int cpu = akl_next_online_cpu(-1); cpu >= 0; cpu = akl_next_online_cpu(cpu)) {
+            int package, core, llc;
+            akl_cpu_topology(cpu, &package, &core, &llc);
+            add_cpu(cpu, package, core, llc);
+        }
+#else
+        char buf[1024];
+        if (details::read_sys_file("/sys/devices/system/cpu/online", buf, sizeof(buf))) {
+            details::parse_cpu_list(buf, [this](int cpu) {
+                char path[128];
+                char id[32];
+                snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+                int package = details::read_sys_file(path, id, sizeof(id)) ? atoi(id) : 0;
+                snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+                int core = details::first_listed_cpu(path, cpu);
+                // the L3, or the package for machines that do not list one
+                int llc = -1 - package;
+                for (int index = 0; index < 8; ++index) {
+                    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, index);
+                    if (!details::read_sys_file(path, id, sizeof(id))) {
+                        break;
+                    }
+                    if (atoi(id) == 3) {
+                        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list",
+                                 cpu, index);
+                        llc = details::first_listed_cpu(path, llc);
+                        break;
+                    }
+                }
+                add_cpu(cpu, package, core, llc);
+            });
+        }
+        if (m_cpus.size() == 0) {
+            long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+            for (int cpu = 0; cpu < (ncpus > 0 ? (int)ncpus : 1); ++cpu) {
+                add_cpu(cpu, 0, cpu, 0);
+            }
+        }
+#endif
+    }
+
+    //! Ranks each cpu among the hyperthreads of its core, its core and its L3 domain
+    void rank() {
+        m_cores = 0;
+        m_llcs = 0;
+        for (size_t i = 0; i < m_cpus.size(); ++i) {
+            cpu_info& c = m_cpus[i];
+            bool first_of_core = true;
+            bool first_of_llc = true;
+            for (size_t j = 0; j < i; ++j) {
+                const cpu_info& o = m_cpus[j];
+                if (o.core == c.core) {
+                    ++c.smt;
+                    first_of_core = false;
+                }
+                if (o.llc == c.llc) {
+                    first_of_llc = false;
+                    c.llc_rank = o.llc_rank;
+                    if (o.core != c.core && o.smt == 0) {
+                        ++c.core_rank;
+                    }
+                }
+            }
+            if (!first_of_core) {
+                // siblings take their core's rank
+                for (size_t j = 0; j < i; ++j) {
+                    if (m_cpus[j].core == c.core) {
+                        c.core_rank = m_cpus[j].core_rank;
+                        break;
+                    }
+                }
+            }
+            if (first_of_llc) {
+                c.llc_rank = (int)m_llcs++;
+            }
+            m_cores += first_of_core;
+        }
+    }
+
+    //! Cpu ids sorted by "less" over their cpu_info, an insertion sort
+    //! since machines have a few hundred cpus at most
+    template <typename Less>
+    void order(vector<int>& out, Less less) const {
+        vector<const cpu_info*> sorted;
+        // with room for every cpu up front the push_back()s below cannot fail
+        if (!sorted.reserve(m_cpus.size()) || !out.reserve(m_cpus.size())) {
+            return;
+        }
+        for (size_t i = 0; i < m_cpus.size(); ++i) {
+            const cpu_info* c = &m_cpus[i];
+            size_t j = sorted.size();
+            sorted.push_back(c);
+            while (j > 0 && less(*c, *sorted[j - 1])) {
+                sorted[j] = sorted[j - 1];
+                --j;
+            }
+            sorted[j] = c;
+        }
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            out.push_back(sorted[i]->cpu);
+        }
+    }
+
+public:
+    cpu_topology() {
+        read();
+        rank();
+        if (m_online.reserve(m_cpus.size())) {
+            for (size_t i = 0; i < m_cpus.size(); ++i) {
+                m_online.push_back(m_cpus[i].cpu);
+            }
+        }
+        order(m_compact, [](const cpu_info& a, const cpu_info& b) {
+            if (a.llc_rank != b.llc_rank) {
+                return a.llc_rank < b.llc_rank;
+            }
+            if (a.core_rank != b.core_rank) {
+                return a.core_rank < b.core_rank;
+            }
+            return a.smt < b.smt;
+        });
+        order(m_scatter, [](const cpu_info& a, const cpu_info& b) {
+            if (a.smt != b.smt) {
+                return a.smt < b.smt;
+            }
+            if (a.core_rank != b.core_rank) {
+                return a.core_rank < b.core_rank;
+            }
+            return a.llc_rank < b.llc_rank;
+        });
+        order(m_per_l3, [](const cpu_info& a, const cpu_info& b) {
+            if (a.llc_rank != b.llc_rank) {
+                return a.llc_rank < b.llc_rank;
+            }
+            if (a.smt != b.smt) {
+                return a.smt < b.smt;
+            }
+            return a.core_rank < b.core_rank;
+        });
+    }
+
+#ifndef __KERNEL_MODULE__
+    /// The topology of this machine, read on first use
+    static const cpu_topology& system() {
+        static cpu_topology topology;
+        return topology;
+    }
+#endif
+
+    /// Number of online cpus
+    size_t size() const {
+        return m_cpus.size();
+    }
+
+    /// Number of physical cores
+    size_t cores() const {
+        return m_cores;
+    }
+
+    /// Number of L3 domains
+    size_t l3_domains() const {
+        return m_llcs;
+    }
+
+    /// The i-th online cpu, by cpu id
+    const cpu_info& operator[](size_t i) const {
+        return m_cpus[i];
+    }
+
+    /// Ids of the online cpus
+    const vector<int>& online() const {
+        return m_online;
+    }
+
+    /**
+     * The cpu for thread "index" under "placement", or -1 for
+     * CPU_PLACEMENT_NONE. Indices past size() wrap around.
+     */
+    int cpu_for(cpu_placement placement, size_t index) const {
+        const vector<int>* cpus;
+        switch (placement) {
+            case CPU_PLACEMENT_COMPACT:
+                cpus = &m_compact;
+                break;
+            case CPU_PLACEMENT_SCATTER_CORES:
+                cpus = &m_scatter;
+                break;
+            case CPU_PLACEMENT_PER_L3:
+                cpus = &m_per_l3;
+                break;
+            default:
+                return -1;
+        }
+        // empty only if the tables could not be allocated, then nothing is pinned
+        return cpus->empty() ? -1 : (*cpus)[index % cpus->size()];
+    }
+};
+
+}  // namespace akl
@@ -0,0 +1,316 @@
+#pragma once
+
+#ifndef __KERNEL_MODULE__
+#include <sched.h>
+#endif
+
+#include "atomic.hpp"
+#include "cache_line_pad.hpp"
+#include "kern_lib.h"
+#include "spinlock.hpp"
+#include "vector.hpp"
+
+#ifndef __KERNEL_MODULE__
+#include "thread_record.hpp"
+#endif
+
+namespace akl {
+
+namespace details {
+
+//! A pointer waiting for its readers to leave
+struct epoch_retired {
+    void* ptr;
+    void (*deleter)(void*);
+};
+
+template <typename T>
+void epoch_delete(void* ptr) {
+    delete static_cast<T*>(ptr);
+}
+
+#ifndef __KERNEL_MODULE__
+
+enum {
+    //! reader announcement slots, cpus beyond this share slots
+    EPOCH_SLOTS = 64,
+    //! retires between two collection attempts
+    EPOCH_BATCH = 64
+};
+
+//! Readers on one cpu, counted by the parity of the epoch they entered in
+struct epoch_reader_slot {
+    atomic<int> active[2];
+};
+
+/**
+ * Limbo lists of one thread, one per epoch that may still have readers:
+ * list i holds what was retired in the epoch tagged[i], which is
+ * congruent to i mod 3.
+ */
+struct epoch_bag : thread_record {
+    akl_u64 tagged[3];
+    vector<epoch_retired> limbo[3];
+    size_t since_collect;
+
+    epoch_bag()
+        : since_collect(0) {
+        tagged[0] = tagged[1] = tagged[2] = 0;
+    }
+};
+
+inline unsigned epoch_current_slot() {
+    int cpu = sched_getcpu();
+    return cpu < 0 ? 0 : (unsigned)cpu % EPOCH_SLOTS;
+}
+
+#endif
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * Epoch based reclamation domain for lock free structures.
+ *
+ * Readers bracket every access to shared nodes with enter()/exit() (or an
+ * epoch::guard). A writer that unlinks a node passes it to retire(), and
+ * the node is freed only after every reader that could still hold it has
+ * left. Readers never wait and never write shared lines other than their
+ * cpu's announcement slot.
+ *
+ * Userspace: a global epoch counter plus, per cpu, a cache-line padded
+ * count of readers for each epoch parity. A reader bumps the count for
+ * the epoch it saw and re-checks the epoch, so a reader is counted under
+ * the epoch it actually runs in. The epoch advances once no reader of the
+ * previous epoch is left, and anything retired in epoch e is freed, a
+ * batch at a time, once the epoch reaches e + 2. Retired pointers wait in
+ * per-thread limbo lists; a thread that exits hands its lists to the next
+ * thread that retires into the domain. Threads whose lists could not be
+ * allocated share one set kept in the domain, under a spinlock.
+ *
+ * Kernel: readers are rcu read-side sections and retire() is call_rcu(),
+ * so deleters run in softirq context there.
+ */
+class epoch {
+    // not copyable
+    epoch(const epoch&);
+    epoch& operator=(const epoch&);
+
+public:
+    //! What exit() needs to undo one enter()
+    struct reader_token {
+        unsigned slot;
+        unsigned parity;
+    };
+
+    //! Reader section for the lifetime of the guard
+    class guard {
+        epoch& m_domain;
+        reader_token m_token;
+
+        // not copyable
+        guard(const guard&);
+        guard& operator=(const guard&);
+
+    public:
+        explicit guard(epoch& domain)
+            : m_domain(domain), m_token(domain.enter()) {}
+
+        ~guard() {
+            m_domain.exit(m_token);
+        }
+    };
+
+#ifdef __KERNEL_MODULE__
+
+    epoch() {}
+
+    //! Waits for the callbacks of this module; no retire may be in flight
+    ~epoch() {
+        akl_rcu_barrier();
+    }
+
+    reader_token enter() {
+        akl_rcu_read_lock();
+        reader_token token = {0, 0};
+        return token;
+    }
+
+    void exit(reader_token) {
+        akl_rcu_read_unlock();
+    }
+
+    /// Calls deleter(ptr) once no reader can hold "ptr"
+    void retire(void* ptr, void (*deleter)(void*)) {
+        if (akl_call_rcu(ptr, deleter) != 0) {
+            // out of memory for the callback, wait in place
+            akl_synchronize_rcu();
+            deleter(ptr);
+        }
+    }
+
+    /// Frees everything retired so far. Sleeps, never call it from a reader
+    void synchronize() {
+        akl_rcu_barrier();
+    }
+
+#else
+
+private:
+    cache_line_pad<atomic<akl_u64> > m_global;
+    cache_line_pad<details::epoch_reader_slot> m_slots[details::EPOCH_SLOTS];
+    details::thread_record_list<details::epoch_bag> m_bags;
+    //! shared by threads whose own bag could not be allocated
+    details::epoch_bag m_fallback;
+    spinlock m_fallback_lock;
+
+    static void free_batch(vector<details::epoch_retired>& list) {
+        for (size_t i = 0; i < list.size(); ++i) {
+            list[i].deleter(list[i].ptr);
+        }
+        list.clear();
+    }
+
+    //! Frees the lists of "bag" whose readers are all gone
+    void free_expired(details::epoch_bag* bag) {
+        akl_u64 now = m_global.value.load_acquire();
+        for (size_t i = 0; i < 3; ++i) {
+            if (!bag->limbo[i].empty() && bag->tagged[i] + 2 <= now) {
+                free_batch(bag->limbo[i]);
+            }
+        }
+    }
+
+    void collect(details::epoch_bag* bag) {
+        try_advance();
+        free_expired(bag);
+        bag->since_collect = 0;
+    }
+
+    void defer(details::epoch_bag* bag, void* ptr, void (*deleter)(void*)) {
+        akl_u64 e = m_global.value.load_acquire();
+        size_t idx = (size_t)(e % 3);
+        if (bag->tagged[idx] != e) {
+            // congruent mod 3 and older, so at least three epochs old
+            free_batch(bag->limbo[idx]);
+            bag->tagged[idx] = e;
+        }
+        details::epoch_retired r = {ptr, deleter};
+        if (!bag->limbo[idx].push_back(r)) {
+            // freeing what expired may make room; failing that "ptr" leaks
+            // rather than being freed under a reader
+            collect(bag);
+            bag->limbo[idx].push_back(r);
+        } else if (++bag->since_collect >= details::EPOCH_BATCH) {
+            collect(bag);
+        }
+    }
+
+public:
+    epoch() {}
+
+    /**
+     * Frees everything still retired. No thread may use the domain; bags
+     * still cached by live threads are left for those threads to free.
+     */
+    ~epoch() {
+        for (details::epoch_bag* bag = m_bags.first(); bag; bag = m_bags.next(bag)) {
+            for (size_t i = 0; i < 3; ++i) {
+                free_batch(bag->limbo[i]);
+            }
+        }
+        for (size_t i = 0; i < 3; ++i) {
+            free_batch(m_fallback.limbo[i]);
+        }
+    }
+
+    /// Starts a reader section, pass the result to exit()
+    reader_token enter() {
+        reader_token token;
+        token.slot = details::epoch_current_slot();
+        details::epoch_reader_slot& slot = m_slots[token.slot].value;
+        while (true) {
+            akl_u64 e = m_global.value.load_acquire();
+            token.parity = (unsigned)(e & 1);
+            // fully fenced, so the re-check below cannot pass it
+            slot.active[token.parity].inc();
+            if (m_global.value.load_acquire() == e) {
+                return token;
+            }
+            slot.active[token.parity].dec();
+        }
+    }
+
+    /// Ends the reader section started by the matching enter()
+    void exit(reader_token token) {
+        m_slots[token.slot].value.active[token.parity].dec();
+    }
+
+    /**
+     * Moves the epoch on if no reader of the previous epoch is left.
+     * Returns true if the epoch moved, by this call or a concurrent one.
+     */
+    bool try_advance() {
+        akl_u64 e = m_global.value.load_acquire();
+        atomic_thread_fence();
+        // readers of e - 1 share the parity of e + 1
+        unsigned parity = (unsigned)((e + 1) & 1);
+        for (size_t i = 0; i < details::EPOCH_SLOTS; ++i) {
+            if (m_slots[i].value.active[parity].load_acquire() != 0) {
+                return false;
+            }
+        }
+        m_global.value.compare_and_swap(e, e + 1);
+        return true;
+    }
+
+    /// Calls deleter(ptr) once no reader can hold "ptr". Never blocks
+    void retire(void* ptr, void (*deleter)(void*)) {
+        bool cached;
+        details::epoch_bag* bag = m_bags.acquire(cached);
+        if (!bag) {
+            m_fallback_lock.lock();
+            defer(&m_fallback, ptr, deleter);
+            m_fallback_lock.unlock();
+            return;
+        }
+        defer(bag, ptr, deleter);
+        m_bags.release(bag, cached);
+    }
+
+    /**
+     * Waits until every reader that was active at the call has left and
+     * frees what this thread retired before the call. Spins, and never returns if
+     * called from inside a reader section.
+     */
+    void synchronize() {
+        akl_u64 target = m_global.value.load_acquire() + 2;
+        unsigned spins = 0;
+        while (m_global.value.load_acquire() < target) {
+            if (!try_advance()) {
+                details::spin_wait(spins);
+            }
+        }
+        bool cached;
+        details::epoch_bag* bag = m_bags.acquire(cached);
+        if (!bag) {
+            m_fallback_lock.lock();
+            free_expired(&m_fallback);
+            m_fallback_lock.unlock();
+            return;
+        }
+        free_expired(bag);
+        m_bags.release(bag, cached);
+    }
+
+#endif
+
+    /// retire() for objects from new, freed with delete
+    template <typename T>
+    void retire(T* ptr) {
+        retire(static_cast<void*>(ptr), &details::epoch_delete<T>);
+    }
+};
+
+}  // namespace akl
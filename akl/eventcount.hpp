@@ -0,0 +1,125 @@
+#pragma once
+
+#include "atomic.hpp"
+#include "kern_lib.h"
+#include "pthread.h"
+#include "utility.hpp"
+
+namespace akl {
+
+/**
+ * \ingroup util
+ *
+ * Lets threads sleep until a lock free structure changes, without a
+ * mutex on the fast path. A waiter calls prepare_wait(), checks its
+ * condition once more, then either cancel_wait()s or commit_wait()s;
+ * the thread that makes the condition true calls notify_one() or
+ * notify_all() afterwards. A notify costs a fence and a load while
+ * nobody waits.
+ *
+ * The low 16 bits of the state count waiters, the rest is an epoch. A
+ * notify removes the waiters it wakes from the count as it bumps the
+ * epoch, so further notifies skip the wakeup until someone waits again.
+ * commit_wait() sleeps only while the epoch it prepared under is current,
+ * so a notify landing between the last check and the sleep is not lost.
+ * A waiter that sees the epoch move leaves without touching the count;
+ * when that was not the waiter the notify removed, the count stays one
+ * too high until the next notify spends it.
+ *
+ * Waiters sleep on an akl_wait_queue_t: a futex on the state in
+ * userspace, a kernel wait queue whose idle sleepers do not trip the
+ * hung task check.
+ */
+class eventcount {
+private:
+    enum { WAITER = 1, EPOCH = 1 << 16, WAITER_MASK = EPOCH - 1 };
+
+    atomic<int> m_state;
+    akl_wait_queue_t m_queue;
+
+    // not copyable
+    eventcount(const eventcount&);
+    eventcount& operator=(const eventcount&);
+
+public:
+    eventcount() {
+        akl_wait_queue_init(&m_queue);
+    }
+
+    /// Wakes up to "count" waiters
+    void notify(int count) {
+        // orders the caller's publication before the waiter check
+        atomic_thread_fence();
+        int state = m_state.load_acquire();
+        while (true) {
+            int waiters = state & WAITER_MASK;
+            if (waiters == 0) {
+                return;
+            }
+            int woken = count < waiters ? count : waiters;
+            // the epoch wraps, so count in unsigned
+            int next = (int)((unsigned)state + EPOCH - woken * WAITER);
+            if (m_state.compare_and_swap(state, next)) {
+                break;
+            }
+            state = m_state.load_acquire();
+        }
+        akl_wait_queue_wake(&m_queue, &m_state.value, count);
+    }
+
+    void notify_one() {
+        notify(1);
+    }
+
+    void notify_all() {
+        notify(0x7fffffff);
+    }
+
+    /// Registers the caller as a waiter, returns the key for commit_wait()
+    int prepare_wait() {
+        return m_state.inc_ret_last(WAITER) & ~WAITER_MASK;
+    }
+
+    /// Withdraws a prepare_wait() whose condition turned out true
+    void cancel_wait(int key) {
+        while (true) {
+            int state = m_state.load_acquire();
+            if ((state & ~WAITER_MASK) != key) {
+                // a notify already took this waiter off the count
+                return;
+            }
+            if (m_state.compare_and_swap(state, state - WAITER)) {
+                return;
+            }
+        }
+    }
+
+    /// Sleeps until a notify after the prepare_wait() that returned "key"
+    void commit_wait(int key) {
+        while (true) {
+            int state = m_state.load_acquire();
+            if ((state & ~WAITER_MASK) != key) {
+                return;
+            }
+            akl_wait_queue_wait(&m_queue, &m_state.value, state);
+        }
+    }
+
+    /**
+     * Sleeps until ready() holds, checking it around every wakeup. ready()
+     * may itself take what it waits for, as the queues' pop() does.
+     */
+    template <typename Pred>
+    void wait(Pred ready) {
+        while (!ready()) {
+            int key = prepare_wait();
+            if (ready()) {
+                cancel_wait(key);
+                return;
+            }
+            commit_wait(key);
+        }
+    }
+};
+
+}  // namespace akl
@@ -0,0 +1,405 @@
+#pragma once
+
+/* the kernel may not touch vector registers outside kernel_fpu_begin() */
+#if defined(__SSE2__) && !defined(__KERNEL_MODULE__)
+#include <emmintrin.h>
+#define AKL_FLAT_HASH_SSE2 1
+#else
+#define AKL_FLAT_HASH_SSE2 0
+#endif
+
+#include "hash.hpp"
+#include "kern_lib.h"
+#include "utility.hpp"
+
+namespace akl {
+
+namespace details {
+
+/* control byte values: a full slot stores the low 7 bits of its hash */
+enum : unsigned char { CTRL_EMPTY = 0x80, CTRL_DELETED = 0xfe };
+
+enum { GROUP_WIDTH = 16 };
+
+//! Set bits of a group mask, lowest slot first
+class group_mask {
+    unsigned m_bits;
+
+public:
+    explicit group_mask(unsigned bits)
+        : m_bits(bits) {}
+
+    bool any() const {
+        return m_bits != 0;
+    }
+
+    //! Removes and returns the lowest set slot
+    unsigned next() {
+        unsigned slot = __builtin_ctz(m_bits);
+        m_bits &= m_bits - 1;
+        return slot;
+    }
+};
+
+//! GROUP_WIDTH control bytes compared at once
+class ctrl_group {
+#if AKL_FLAT_HASH_SSE2
+    __m128i m_ctrl;
+
+public:
+    explicit ctrl_group(const unsigned char* ctrl)
+        : m_ctrl(_mm_load_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+
+    group_mask match(unsigned char h2) const {
+        __m128i eq = _mm_cmpeq_epi8(m_ctrl, _mm_set1_epi8((char)h2));
+        return group_mask((unsigned)_mm_movemask_epi8(eq));
+    }
+
+    group_mask match_empty() const {
+        return match(CTRL_EMPTY);
+    }
+
+    //! Empty and deleted slots: the only control bytes with the top bit set
+    group_mask match_free() const {
+        return group_mask((unsigned)_mm_movemask_epi8(m_ctrl));
+    }
+#else
+    const unsigned char* m_ctrl;
+
+public:
+    explicit ctrl_group(const unsigned char* ctrl)
+        : m_ctrl(ctrl) {}
+
+    group_mask match(unsigned char h2) const {
+        unsigned bits = 0;
+        for (unsigned i = 0; i < GROUP_WIDTH; ++i) {
+            bits |= (unsigned)(m_ctrl[i] == h2) << i;
+        }
+        return group_mask(bits);
+    }
+
+    group_mask match_empty() const {
+        return match(CTRL_EMPTY);
+    }
+
+    group_mask match_free() const {
+        unsigned bits = 0;
+        for (unsigned i = 0; i < GROUP_WIDTH; ++i) {
+            bits |= (unsigned)(m_ctrl[i] >> 7) << i;
+        }
+        return group_mask(bits);
+    }
+#endif
+};
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * Open addressing hash map in the SwissTable style, for single-threaded
+ * or per-cpu use.
+ *
+ * Slots are split into groups of 16. Each slot has a control byte: empty,
+ * deleted, or the low 7 bits of the hash of its key. A lookup hashes once,
+ * picks a group from the remaining bits and compares all 16 control bytes
+ * against the 7 bit tag at once (SSE2 in userspace, a byte loop in the
+ * kernel build), so keys are only compared on a tag match, which is
+ * almost always the right key. Groups are probed quadratically.
+ *
+ * Control bytes, keys and values live in three flat arrays of one
+ * akl_cmalloc block. Growth rehashes everything at once; pointers
+ * returned by find() are invalidated by any insert.
+ */
+template <typename K, typename V, typename Hash = hash<K> >
+class flat_hash_map {
+private:
+    //! The table is rehashed beyond 7/8 load
+    enum { MAX_LOAD_NUM = 7, MAX_LOAD_DEN = 8 };
+
+    static_assert(alignof(K) <= 16 && alignof(V) <= 16, "slots are at most 16 byte aligned");
+
+    unsigned char* m_ctrl;
+    K* m_keys;
+    V* m_values;
+    size_t m_group_mask;
+    size_t m_size;
+    //! inserts left before the table has to be rehashed
+    size_t m_growth_left;
+    Hash m_hash;
+
+    // not copyable
+    flat_hash_map(const flat_hash_map&);
+    flat_hash_map& operator=(const flat_hash_map&);
+
+    static unsigned char h2(akl_u64 h) {
+        return (unsigned char)(h & 0x7f);
+    }
+
+    static size_t h1(akl_u64 h) {
+        return (size_t)(h >> 7);
+    }
+
+    static size_t align16(size_t bytes) {
+        return (bytes + 15) & ~(size_t)15;
+    }
+
+    size_t group_count() const {
+        return m_ctrl ? m_group_mask + 1 : 0;
+    }
+
+    //! Slot of "key", or -1
+    long find_slot(const K& key, akl_u64 h) const {
+        if (!m_ctrl) {
+            return -1;
+        }
+        size_t group = h1(h) & m_group_mask;
+        for (size_t step = 1;; ++step) {
+            size_t base = group * details::GROUP_WIDTH;
+            details::ctrl_group ctrl(m_ctrl + base);
+            details::group_mask match = ctrl.match(h2(h));
+            while (match.any()) {
+                size_t slot = base + match.next();
+                if (m_keys[slot] == key) {
+                    return (long)slot;
+                }
+            }
+            if (ctrl.match_empty().any()) {
+                return -1;
+            }
+            group = (group + step) & m_group_mask;
+        }
+    }
+
+    //! First empty or deleted slot on the probe sequence of "h"
+    size_t find_free(akl_u64 h) const {
+        size_t group = h1(h) & m_group_mask;
+        for (size_t step = 1;; ++step) {
+            size_t base = group * details::GROUP_WIDTH;
+            details::group_mask free = details::ctrl_group(m_ctrl + base).match_free();
+            if (free.any()) {
+                return base + free.next();
+            }
+            group = (group + step) & m_group_mask;
+        }
+    }
+
+    //! Points the map at a new empty table, leaves it alone if that failed
+    bool allocate(size_t groups) {
+        size_t slots = groups * details::GROUP_WIDTH;
+        size_t keys_at = align16(slots);
+        size_t values_at = keys_at + align16(slots * sizeof(K));
+        unsigned char* block = static_cast<unsigned char*>(akl_cmalloc(values_at + slots * sizeof(V)));
+        if (!block) {
+            return false;
+        }
+        akl_memset(block, details::CTRL_EMPTY, slots);
+        m_ctrl = block;
+        m_keys = reinterpret_cast<K*>(block + keys_at);
+        m_values = reinterpret_cast<V*>(block + values_at);
+        m_group_mask = groups - 1;
+        m_growth_left = slots * MAX_LOAD_NUM / MAX_LOAD_DEN;
+        return true;
+    }
+
+    //! Rebuilds the table with "groups" groups, dropping tombstones. False if it kept the old one
+    bool rehash(size_t groups) {
+        unsigned char* old_ctrl = m_ctrl;
+        K* old_keys = m_keys;
+        V* old_values = m_values;
+        size_t old_slots = group_count() * details::GROUP_WIDTH;
+
+        if (!allocate(groups)) {
+            return false;
+        }
+        for (size_t i = 0; i < old_slots; ++i) {
+            if (old_ctrl[i] & 0x80) {
+                continue;
+            }
+            akl_u64 h = m_hash(old_keys[i]);
+            size_t slot = find_free(h);
+            m_ctrl[slot] = h2(h);
+            new (m_keys + slot) K(akl::move(old_keys[i]));
+            new (m_values + slot) V(akl::move(old_values[i]));
+            old_keys[i].~K();
+            old_values[i].~V();
+        }
+        m_growth_left -= m_size;
+        akl_cfree(old_ctrl);
+        return true;
+    }
+
+    //! Makes room for one insert. False if the table could not grow
+    bool prepare_insert() {
+        if (m_growth_left > 0) {
+            return true;
+        }
+        size_t groups = group_count();
+        if (groups == 0) {
+            return rehash(1);
+        }
+        if (m_size * 2 * MAX_LOAD_DEN <= groups * details::GROUP_WIDTH * MAX_LOAD_NUM) {
+            // at least half of the used slots are tombstones
+            return rehash(groups);
+        }
+        return rehash(groups * 2);
+    }
+
+    //! Inserts an absent key, returns its value or NULL if there was no room
+    template <typename KArg, typename... VArgs>
+    V* insert_new(akl_u64 h, KArg&& key, VArgs&&... value) {
+        if (!prepare_insert()) {
+            return NULL;
+        }
+        size_t slot = find_free(h);
+        if (m_ctrl[slot] == details::CTRL_EMPTY) {
+            --m_growth_left;
+        }
+        m_ctrl[slot] = h2(h);
+        new (m_keys + slot) K(akl::forward<KArg>(key));
+        V* value_slot = new (m_values + slot) V(akl::forward<VArgs>(value)...);
+        ++m_size;
+        return value_slot;
+    }
+
+    void destroy_all() {
+        size_t slots = group_count() * details::GROUP_WIDTH;
+        for (size_t i = 0; i < slots; ++i) {
+            if (!(m_ctrl[i] & 0x80)) {
+                m_keys[i].~K();
+                m_values[i].~V();
+            }
+        }
+    }
+
+public:
+    flat_hash_map()
+        : m_ctrl(NULL), m_keys(NULL), m_values(NULL), m_group_mask(0), m_size(0), m_growth_left(0) {}
+
+    ~flat_hash_map() {
+        if (m_ctrl) {
+            destroy_all();
+            akl_cfree(m_ctrl);
+        }
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    bool empty() const {
+        return m_size == 0;
+    }
+
+    size_t capacity() const {
+        return group_count() * details::GROUP_WIDTH;
+    }
+
+    /// Sizes the table so that "n" entries fit without a rehash. Returns false if the allocation failed
+    bool reserve(size_t n) {
+        size_t slots = n * MAX_LOAD_DEN / MAX_LOAD_NUM + 1;
+        size_t groups = 1;
+        while (groups * details::GROUP_WIDTH < slots) {
+            groups <<= 1;
+        }
+        return groups <= group_count() || rehash(groups);
+    }
+
+    /// Value of "key", or NULL if absent
+    V* find(const K& key) {
+        long slot = find_slot(key, m_hash(key));
+        return slot < 0 ? NULL : m_values + slot;
+    }
+
+    const V* find(const K& key) const {
+        long slot = find_slot(key, m_hash(key));
+        return slot < 0 ? NULL : m_values + slot;
+    }
+
+    bool contains(const K& key) const {
+        return find_slot(key, m_hash(key)) >= 0;
+    }
+
+    /// Adds "key" if it is absent. Returns false if it was already there or found no room
+    bool insert(const K& key, const V& value) {
+        akl_u64 h = m_hash(key);
+        if (find_slot(key, h) >= 0) {
+            return false;
+        }
+        return insert_new(h, key, value) != NULL;
+    }
+
+    bool insert(K&& key, V&& value) {
+        akl_u64 h = m_hash(key);
+        if (find_slot(key, h) >= 0) {
+            return false;
+        }
+        return insert_new(h, akl::move(key), akl::move(value)) != NULL;
+    }
+
+    /// Adds "key" or overwrites its value. Returns true if it was added, false if assigned or out of room
+    bool insert_or_assign(const K& key, const V& value) {
+        akl_u64 h = m_hash(key);
+        long slot = find_slot(key, h);
+        if (slot >= 0) {
+            m_values[slot] = value;
+            return false;
+        }
+        return insert_new(h, key, value) != NULL;
+    }
+
+    /// Value of "key", value-initialized first if absent. NULL if it found no room
+    V* find_or_insert(const K& key) {
+        akl_u64 h = m_hash(key);
+        long slot = find_slot(key, h);
+        if (slot >= 0) {
+            return m_values + slot;
+        }
+        return insert_new(h, key);
+    }
+
+    /// Removes "key". Returns false if it was absent
+    bool erase(const K& key) {
+        long slot = find_slot(key, m_hash(key));
+        if (slot < 0) {
+            return false;
+        }
+        m_keys[slot].~K();
+        m_values[slot].~V();
+        size_t base = (size_t)slot & ~(size_t)(details::GROUP_WIDTH - 1);
+        // groups are aligned, so one that still has an empty slot was never
+        // full and no probe sequence ever went past it
+        if (details::ctrl_group(m_ctrl + base).match_empty().any()) {
+            m_ctrl[slot] = details::CTRL_EMPTY;
+            ++m_growth_left;
+        } else {
+            m_ctrl[slot] = details::CTRL_DELETED;
+        }
+        --m_size;
+        return true;
+    }
+
+    /// Removes every entry, keeping the table
+    void clear() {
+        if (!m_ctrl) {
+            return;
+        }
+        destroy_all();
+        akl_memset(m_ctrl, details::CTRL_EMPTY, capacity());
+        m_size = 0;
+        m_growth_left = capacity() * MAX_LOAD_NUM / MAX_LOAD_DEN;
+    }
+
+    /// Calls fn(const K&, V&) for every entry in table order
+    template <typename Fn>
+    void for_each(Fn fn) {
+        size_t slots = capacity();
+        for (size_t i = 0; i < slots; ++i) {
+            if (!(m_ctrl[i] & 0x80)) {
+                fn(const_cast<const K&>(m_keys[i]), m_values[i]);
+            }
+        }
+    }
+};
+
+}  // namespace akl
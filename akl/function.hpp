@@ -0,0 +1,206 @@
+#pragma once
+
+#include "kern_lib.h"
+#include "utility.hpp"
+
+namespace akl {
+
+namespace details {
+
+//! Picks the inline or heap constructor at compile time
+template <bool Inline>
+struct function_placement {};
+
+//! Per callable type operations, one static table per type
+template <typename R, typename... Args>
+struct function_ops {
+    R (*invoke)(void* storage, Args&&... args);
+    //! move constructs into "dst" and destroys the source
+    void (*relocate)(void* dst, void* src);
+    void (*destroy)(void* storage);
+};
+
+//! Callable stored inside the function object
+template <typename F, typename R, typename... Args>
+struct inline_callable {
+    static F* get(void* storage) {
+        return static_cast<F*>(storage);
+    }
+
+    static R invoke(void* storage, Args&&... args) {
+        return (*get(storage))(akl::forward<Args>(args)...);
+    }
+
+    static void relocate(void* dst, void* src) {
+        new (dst) F(akl::move(*get(src)));
+        get(src)->~F();
+    }
+
+    static void destroy(void* storage) {
+        get(storage)->~F();
+    }
+
+    static constexpr function_ops<R, Args...> ops = {&invoke, &relocate, &destroy};
+};
+
+template <typename F, typename R, typename... Args>
+constexpr function_ops<R, Args...> inline_callable<F, R, Args...>::ops;
+
+//! Callable too big for the buffer, the buffer holds a pointer to it
+template <typename F, typename R, typename... Args>
+struct heap_callable {
+    static F*& get(void* storage) {
+        return *static_cast<F**>(storage);
+    }
+
+    static R invoke(void* storage, Args&&... args) {
+        return (*get(storage))(akl::forward<Args>(args)...);
+    }
+
+    static void relocate(void* dst, void* src) {
+        *static_cast<F**>(dst) = get(src);
+    }
+
+    static void destroy(void* storage) {
+        F* f = get(storage);
+        f->~F();
+        akl_cfree(f);
+    }
+
+    static constexpr function_ops<R, Args...> ops = {&invoke, &relocate, &destroy};
+};
+
+template <typename F, typename R, typename... Args>
+constexpr function_ops<R, Args...> heap_callable<F, R, Args...>::ops;
+
+}  // namespace details
+
+template <typename Signature, size_t InlineBytes = 32>
+class function;
+
+/**
+ * \ingroup util
+ *
+ * Move-only type erased callable, the replacement for std::function and
+ * boost::function in task queues and in the kernel build.
+ *
+ * Callables of up to InlineBytes bytes (and at most 16 byte aligned) are
+ * stored inside the object, so wrapping a lambda with a few captures
+ * never allocates. Larger ones go to a block from akl_cmalloc; without
+ * one the function is left empty and the callable untouched. Type
+ * erasure is one static table of function pointers per callable type; it
+ * needs neither RTTI nor exceptions. Being move-only, it also holds
+ * callables that capture move-only state.
+ */
+template <typename R, typename... Args, size_t InlineBytes>
+class function<R(Args...), InlineBytes> {
+private:
+    typedef details::function_ops<R, Args...> ops_type;
+
+    static_assert(InlineBytes >= sizeof(void*), "the buffer must fit the heap pointer");
+
+    const ops_type* m_ops;
+    alignas(16) unsigned char m_storage[InlineBytes];
+
+    // not copyable
+    function(const function&);
+    function& operator=(const function&);
+
+    template <typename F>
+    struct fits_inline {
+        static constexpr bool value = sizeof(F) <= InlineBytes && alignof(F) <= 16;
+    };
+
+    template <typename F>
+    void construct(F&& f) {
+        typedef typename remove_cvref<F>::type callable;
+        construct<callable>(akl::forward<F>(f), details::function_placement<fits_inline<callable>::value>());
+    }
+
+    template <typename C, typename F>
+    void construct(F&& f, details::function_placement<true>) {
+        new (m_storage) C(akl::forward<F>(f));
+        m_ops = &details::inline_callable<C, R, Args...>::ops;
+    }
+
+    template <typename C, typename F>
+    void construct(F&& f, details::function_placement<false>) {
+        static_assert(alignof(C) <= 16, "akl_cmalloc blocks are at most 16 byte aligned");
+        void* block = akl_cmalloc(sizeof(C));
+        if (!block) {
+            // "f" is left as it was
+            m_ops = NULL;
+            return;
+        }
+        *reinterpret_cast<C**>(m_storage) = new (block) C(akl::forward<F>(f));
+        m_ops = &details::heap_callable<C, R, Args...>::ops;
+    }
+
+    void take(function& other) {
+        m_ops = other.m_ops;
+        if (m_ops) {
+            m_ops->relocate(m_storage, other.m_storage);
+            other.m_ops = NULL;
+        }
+    }
+
+public:
+    function()
+        : m_ops(NULL) {}
+
+    /// Wraps "f", inline if it fits
+    template <typename F, typename = typename enable_if<!is_same<typename remove_cvref<F>::type, function>::value>::type>
+    function(F&& f) {
+        construct(akl::forward<F>(f));
+    }
+
+    function(function&& other) noexcept {
+        take(other);
+    }
+
+    ~function() {
+        reset();
+    }
+
+    function& operator=(function&& other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    /// Replaces the callable, constructing the new one in place
+    template <typename F, typename = typename enable_if<!is_same<typename remove_cvref<F>::type, function>::value>::type>
+    function& operator=(F&& f) {
+        reset();
+        construct(akl::forward<F>(f));
+        return *this;
+    }
+
+    /// Destroys the callable, leaving the function empty
+    void reset() {
+        if (m_ops) {
+            m_ops->destroy(m_storage);
+            m_ops = NULL;
+        }
+    }
+
+    explicit operator bool() const {
+        return m_ops != NULL;
+    }
+
+    /// Calls the callable, which must be set
+    R operator()(Args... args) {
+        ASSERT_TRUE(m_ops != NULL);
+        return m_ops->invoke(m_storage, akl::forward<Args>(args)...);
+    }
+
+    /// True if a callable of type F is stored without allocating
+    template <typename F>
+    static constexpr bool stores_inline() {
+        return fits_inline<typename remove_cvref<F>::type>::value;
+    }
+};
+
+}  // namespace akl
@@ -0,0 +1,576 @@
+#pragma once
+
+#include "atomic.hpp"
+#include "function.hpp"
+#include "kern_lib.h"
+#include "spinlock.hpp"
+#include "sync.h"
+#include "utility.hpp"
+#include "vector.hpp"
+
+namespace akl {
+
+template <typename T>
+class future;
+template <typename T>
+class promise;
+
+namespace details {
+
+enum {
+    //! the value is in place
+    FUTURE_READY = 1,
+    //! some thread sleeps on the state word
+    FUTURE_WAITERS = 2,
+    //! a continuation waits for the value
+    FUTURE_CONTINUATION = 4,
+    //! polls of the state word before a waiter sleeps
+    FUTURE_SPIN_ROUNDS = 128,
+    //! capture bytes a continuation stores without allocating
+    FUTURE_THEN_INLINE = 64
+};
+
+//! What a future<void> holds
+struct future_unit {};
+
+template <typename T>
+struct future_storage {
+    typedef T type;
+};
+
+template <>
+struct future_storage<void> {
+    typedef future_unit type;
+};
+
+/**
+ * State shared by a promise, its future and the future's continuation:
+ * the value in place, a reference count and one state word that waiters
+ * sleep on.
+ */
+template <typename T>
+struct future_state {
+    typedef typename future_storage<T>::type value_type;
+
+    //! FUTURE_READY, FUTURE_WAITERS and FUTURE_CONTINUATION
+    atomic<int> flags;
+    atomic<int> refs;
+    function<void(), FUTURE_THEN_INLINE> then;
+    alignas(value_type) unsigned char storage[sizeof(value_type)];
+
+    static_assert(alignof(value_type) <= 16, "values are at most 16 byte aligned");
+
+    future_state()
+        : refs(1) {}
+
+    //! NULL if the state could not be allocated
+    static future_state* create() {
+        void* p = akl_cmalloc(sizeof(future_state));
+        if (!p) {
+            return NULL;
+        }
+        return new (p) future_state();
+    }
+
+    value_type* value() {
+        return reinterpret_cast<value_type*>(storage);
+    }
+
+    bool ready() const {
+        return flags.load_acquire() & FUTURE_READY;
+    }
+
+    void run_then() {
+        // the continuation may drop the last reference to this state
+        function<void(), FUTURE_THEN_INLINE> fn = akl::move(then);
+        fn();
+    }
+
+    template <typename... Args>
+    void set(Args&&... args) {
+        ASSERT_TRUE(!ready());
+        new (storage) value_type(akl::forward<Args>(args)...);
+        int f = flags.load_acquire();
+        while (!flags.compare_and_swap(f, f | FUTURE_READY)) {
+            f = flags.load_acquire();
+        }
+        if (f & FUTURE_WAITERS) {
+            akl_sync_wake(&flags.value, 0x7fffffff);
+        }
+        if (f & FUTURE_CONTINUATION) {
+            run_then();
+        }
+    }
+
+    /**
+     * Runs "fn" once the value is in place, right away if it already is.
+     * False, with "fn" untouched, if it needed a block that could not be
+     * allocated.
+     */
+    template <typename Fn>
+    bool attach(Fn&& fn) {
+        then = akl::forward<Fn>(fn);
+        if (!then) {
+            return false;
+        }
+        int f = flags.load_acquire();
+        while (true) {
+            if (f & FUTURE_READY) {
+                run_then();
+                return true;
+            }
+            if (flags.compare_and_swap(f, f | FUTURE_CONTINUATION)) {
+                return true;
+            }
+            f = flags.load_acquire();
+        }
+    }
+
+    void wait() {
+        for (int round = 0; round < FUTURE_SPIN_ROUNDS; ++round) {
+            if (ready()) {
+                return;
+            }
+            cpu_relax();
+        }
+        while (true) {
+            int f = flags.load_acquire();
+            if (f & FUTURE_READY) {
+                return;
+            }
+            if (!(f & FUTURE_WAITERS)) {
+                if (!flags.compare_and_swap(f, f | FUTURE_WAITERS)) {
+                    continue;
+                }
+                f |= FUTURE_WAITERS;
+            }
+            akl_sync_wait(&flags.value, f);
+        }
+    }
+
+    void release() {
+        if (refs.dec() == 0) {
+            if (ready()) {
+                value()->~value_type();
+            }
+            this->~future_state();
+            akl_cfree(this);
+        }
+    }
+};
+
+//! Moves the value out of a ready state and drops the reference
+template <typename T>
+struct future_take {
+    static T take(future_state<T>* s) {
+        T v = akl::move(*s->value());
+        s->release();
+        return v;
+    }
+};
+
+template <>
+struct future_take<void> {
+    static void take(future_state<void>* s) {
+        s->release();
+    }
+};
+
+//! Type fn returns when called on the value of a future<T>
+template <typename T, typename Fn>
+struct continuation_result {
+    typedef decltype(declval<Fn&>()(declval<T>())) type;
+};
+
+template <typename Fn>
+struct continuation_result<void, Fn> {
+    typedef decltype(declval<Fn&>()()) type;
+};
+
+template <typename T, typename R>
+struct future_invoke;
+
+//! What when_all() of futures of T yields
+template <typename T>
+struct when_all_result {
+    typedef vector<T> type;
+};
+
+template <>
+struct when_all_result<void> {
+    typedef void type;
+};
+
+template <typename T>
+struct when_all_state;
+
+//! Fulfils the promise of a when_all() with the gathered values
+template <typename T>
+struct when_all_finish {
+    static void run(when_all_state<T>* join);
+};
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * The value a promise<T> will hold. The value lives inline in a shared
+ * state next to one atomic state word: no lock is taken, and get() or
+ * wait() spin briefly, then sleep on the state word (a futex in
+ * userspace, a wait queue in the kernel).
+ *
+ * then() attaches one continuation, run by whichever thread fulfils the
+ * promise; then(pool, fn) launches it on a pool instead, so from a pool
+ * worker it goes to that worker's own deque, next to the data the
+ * producer just wrote. A future is move only and gives up its value to
+ * get() or then(), after which it is no longer valid(). Futures whose
+ * state could not be allocated come back invalid as well.
+ */
+template <typename T>
+class future {
+private:
+    details::future_state<T>* m_state;
+
+    explicit future(details::future_state<T>* state)
+        : m_state(state) {}
+
+    void drop() {
+        if (m_state) {
+            m_state->release();
+            m_state = NULL;
+        }
+    }
+
+    friend class promise<T>;
+
+    template <typename U>
+    friend future<typename details::when_all_result<U>::type> when_all(vector<future<U> >&& futures);
+
+    // not copyable
+    future(const future&);
+    future& operator=(const future&);
+
+public:
+    future()
+        : m_state(NULL) {}
+
+    future(future&& other)
+        : m_state(other.m_state) {
+        other.m_state = NULL;
+    }
+
+    future& operator=(future&& other) {
+        if (this != &other) {
+            drop();
+            m_state = other.m_state;
+            other.m_state = NULL;
+        }
+        return *this;
+    }
+
+    ~future() {
+        drop();
+    }
+
+    /// True until get() or then() took the value
+    bool valid() const {
+        return m_state != NULL;
+    }
+
+    /// True once the value is in place
+    bool ready() const {
+        ASSERT_TRUE(valid());
+        return m_state->ready();
+    }
+
+    /**
+     * Waits until the value is in place. A pool task that waits blocks
+     * its worker; tasks should rather chain with then().
+     */
+    void wait() const {
+        ASSERT_TRUE(valid());
+        m_state->wait();
+    }
+
+    /// Waits for the value and moves it out
+    T get() {
+        ASSERT_TRUE(valid());
+        m_state->wait();
+        details::future_state<T>* s = m_state;
+        m_state = NULL;
+        return details::future_take<T>::take(s);
+    }
+
+    /**
+     * Calls fn(value), or fn() for a future<void>, on the thread that
+     * fulfils the promise, or right away if the value is already there.
+     * Returns the future of what fn returns. Meant for short functions;
+     * then(pool, fn) runs longer ones as tasks. If the continuation
+     * cannot be allocated the result is invalid and this future keeps
+     * its value.
+     */
+    template <typename Fn>
+    future<typename details::continuation_result<T, Fn>::type> then(Fn&& fn) {
+        typedef typename details::continuation_result<T, Fn>::type result_type;
+        ASSERT_TRUE(valid());
+        promise<result_type> p;
+        future<result_type> next = p.get_future();
+        if (!next.valid()) {
+            return next;
+        }
+        details::future_state<T>* s = m_state;
+        auto continuation = [s, p = akl::move(p), f = akl::forward<Fn>(fn)]() mutable {
+            details::future_invoke<T, result_type>::run(f, s, p);
+            s->release();
+        };
+        m_state = NULL;
+        if (!s->attach(akl::move(continuation))) {
+            // the promise goes with the continuation, nobody may wait on it
+            next = future<result_type>();
+            m_state = s;
+        }
+        return next;
+    }
+
+    /**
+     * Like then(fn), launching fn as a task of "pool" once the value is
+     * there. If the pool cannot take the task, fn runs as with then(fn).
+     */
+    template <typename Pool, typename Fn>
+    future<typename details::continuation_result<T, Fn>::type> then(Pool& pool, Fn&& fn) {
+        typedef typename details::continuation_result<T, Fn>::type result_type;
+        ASSERT_TRUE(valid());
+        promise<result_type> p;
+        future<result_type> next = p.get_future();
+        if (!next.valid()) {
+            return next;
+        }
+        details::future_state<T>* s = m_state;
+        Pool* target = &pool;
+        auto continuation = [target, s, p = akl::move(p), f = akl::forward<Fn>(fn)]() mutable {
+            auto task = [s, p = akl::move(p), f = akl::move(f)]() mutable {
+                details::future_invoke<T, result_type>::run(f, s, p);
+                s->release();
+            };
+            if (!target->launch(akl::move(task))) {
+                task();
+            }
+        };
+        m_state = NULL;
+        if (!s->attach(akl::move(continuation))) {
+            next = future<result_type>();
+            m_state = s;
+        }
+        return next;
+    }
+};
+
+/**
+ * \ingroup util
+ *
+ * Producer side of a future<T>. set_value() is called once; a promise
+ * whose future was taken must be fulfilled before it is destroyed, unless
+ * that future is gone. A promise whose state could not be allocated is
+ * not valid(): its future is invalid and set_value() does nothing.
+ */
+template <typename T>
+class promise {
+private:
+    details::future_state<T>* m_state;
+    bool m_retrieved;
+
+    // not copyable
+    promise(const promise&);
+    promise& operator=(const promise&);
+
+public:
+    promise()
+        : m_state(details::future_state<T>::create()), m_retrieved(false) {}
+
+    promise(promise&& other)
+        : m_state(other.m_state), m_retrieved(other.m_retrieved) {
+        other.m_state = NULL;
+    }
+
+    promise& operator=(promise&& other) {
+        if (this != &other) {
+            this->~promise();
+            m_state = other.m_state;
+            m_retrieved = other.m_retrieved;
+            other.m_state = NULL;
+        }
+        return *this;
+    }
+
+    ~promise() {
+        if (m_state) {
+            // nothing reports a broken promise, its waiters would hang
+            ASSERT_TRUE(!m_retrieved || m_state->ready() || m_state->refs.load_acquire() == 1);
+            m_state->release();
+        }
+    }
+
+    bool valid() const {
+        return m_state != NULL;
+    }
+
+    /// The future of this promise, taken once
+    future<T> get_future() {
+        ASSERT_TRUE(!m_retrieved);
+        m_retrieved = true;
+        if (!m_state) {
+            return future<T>();
+        }
+        m_state->refs.inc();
+        return future<T>(m_state);
+    }
+
+    /**
+     * Constructs the value from "args" (none for a promise<void>), wakes
+     * the waiters and runs the continuation, if any, on this thread.
+     */
+    template <typename... Args>
+    void set_value(Args&&... args) {
+        if (m_state) {
+            m_state->set(akl::forward<Args>(args)...);
+        }
+    }
+};
+
+namespace details {
+
+/**
+ * Calls fn on the value of "s", or with no argument when T is void, and
+ * fulfils "p" with the result.
+ */
+template <typename T, typename R>
+struct future_invoke {
+    template <typename Fn>
+    static void run(Fn& fn, future_state<T>* s, promise<R>& p) {
+        p.set_value(fn(akl::move(*s->value())));
+    }
+};
+
+template <typename T>
+struct future_invoke<T, void> {
+    template <typename Fn>
+    static void run(Fn& fn, future_state<T>* s, promise<void>& p) {
+        fn(akl::move(*s->value()));
+        p.set_value();
+    }
+};
+
+template <typename R>
+struct future_invoke<void, R> {
+    template <typename Fn>
+    static void run(Fn& fn, future_state<void>*, promise<R>& p) {
+        p.set_value(fn());
+    }
+};
+
+template <>
+struct future_invoke<void, void> {
+    template <typename Fn>
+    static void run(Fn& fn, future_state<void>*, promise<void>& p) {
+        fn();
+        p.set_value();
+    }
+};
+
+//! Gathers the values of when_all(), the last one in fulfils the promise
+template <typename T>
+struct when_all_state {
+    atomic<size_t> remaining;
+    vector<typename future_storage<T>::type> values;
+    promise<typename when_all_result<T>::type> done;
+
+    void arrive() {
+        if (remaining.dec() == 0) {
+            when_all_finish<T>::run(this);
+            this->~when_all_state();
+            akl_cfree(this);
+        }
+    }
+};
+
+template <typename T>
+void when_all_finish<T>::run(when_all_state<T>* join) {
+    join->done.set_value(akl::move(join->values));
+}
+
+template <>
+inline void when_all_finish<void>::run(when_all_state<void>* join) {
+    join->done.set_value();
+}
+
+}  // namespace details
+
+/**
+ * Waits for every future of "futures" without blocking a thread: yields
+ * the future of their values in order, or a future<void> for futures of
+ * void. Each input future hands its value over on the thread that
+ * fulfils it; T must be default constructible. If the join cannot be
+ * allocated the result is invalid and "futures" are left as they were.
+ */
+template <typename T>
+future<typename details::when_all_result<T>::type> when_all(vector<future<T> >&& futures) {
+    typedef details::when_all_state<T> join_type;
+    void* p = akl_cmalloc(sizeof(join_type));
+    if (!p) {
+        return future<typename details::when_all_result<T>::type>();
+    }
+    join_type* join = new (p) join_type();
+    future<typename details::when_all_result<T>::type> result;
+    if (join->values.resize(futures.size())) {
+        result = join->done.get_future();
+    }
+    if (!result.valid()) {
+        join->~join_type();
+        akl_cfree(join);
+        return result;
+    }
+
+    // one extra count, so the join cannot finish while it is being set up
+    join->remaining.inc(futures.size() + 1);
+    for (size_t i = 0; i < futures.size(); ++i) {
+        details::future_state<T>* s = futures[i].m_state;
+        ASSERT_TRUE(s != NULL);
+        futures[i].m_state = NULL;
+        auto arrive = [join, i, s]() {
+            join->values[i] = akl::move(*s->value());
+            s->release();
+            join->arrive();
+        };
+        static_assert(function<void(), details::FUTURE_THEN_INLINE>::stores_inline<decltype(arrive)>(),
+                      "attaching the arrival never allocates");
+        s->attach(akl::move(arrive));
+    }
+    join->arrive();
+    futures.clear();
+    return result;
+}
+
+/**
+ * Runs fn() as a task of "pool", or right away if the pool cannot take
+ * it, and returns the future of its result. An invalid future means the
+ * state could not be allocated and fn() was not run.
+ */
+template <typename Pool, typename Fn>
+future<typename details::continuation_result<void, Fn>::type> async(Pool& pool, Fn&& fn) {
+    typedef typename details::continuation_result<void, Fn>::type result_type;
+    promise<result_type> p;
+    future<result_type> result = p.get_future();
+    if (!result.valid()) {
+        return result;
+    }
+    auto task = [p = akl::move(p), f = akl::forward<Fn>(fn)]() mutable {
+        details::future_invoke<void, result_type>::run(f, NULL, p);
+    };
+    if (!pool.launch(akl::move(task))) {
+        task();
+    }
+    return result;
+}
+
+}  // namespace akl
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "types.h"
+
+namespace akl {
+
+namespace details {
+
+//! 64 bit finalizer (splitmix64), spreads every input bit over the result
+inline akl_u64 hash_mix(akl_u64 x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * Hash functor for the akl hash tables. Provided for integers and
+ * pointers; specialize it for other key types. Results are mixed well
+ * in all bits, so tables may index with the low and the high bits alike.
+ */
+template <typename T>
+struct hash;
+
+#define AKL_INTEGER_HASH(type)                               \
+    template <>                                              \
+    struct hash<type> {                                      \
+        akl_u64 operator()(type value) const {               \
+            return details::hash_mix((akl_u64)value);        \
+        }                                                    \
+    };
+
+AKL_INTEGER_HASH(char)
+AKL_INTEGER_HASH(signed char)
+AKL_INTEGER_HASH(unsigned char)
+AKL_INTEGER_HASH(short)
+AKL_INTEGER_HASH(unsigned short)
+AKL_INTEGER_HASH(int)
+AKL_INTEGER_HASH(unsigned int)
+AKL_INTEGER_HASH(long)
+AKL_INTEGER_HASH(unsigned long)
+AKL_INTEGER_HASH(long long)
+AKL_INTEGER_HASH(unsigned long long)
+
+#undef AKL_INTEGER_HASH
+
+template <typename T>
+struct hash<T*> {
+    akl_u64 operator()(T* value) const {
+        return details::hash_mix((akl_u64)value);
+    }
+};
+
+}  // namespace akl
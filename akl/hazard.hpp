@@ -0,0 +1,303 @@
+#pragma once
+
+/* userspace only: per-thread records live behind a thread_local cache */
+
+#include "atomic.hpp"
+#include "kern_lib.h"
+#include "thread_record.hpp"
+#include "vector.hpp"
+
+namespace akl {
+
+namespace details {
+
+enum {
+    //! hazard slots per record, a thread's holders past them take a spare record
+    HAZARD_SLOTS = 4,
+    //! retired pointers a thread gathers before its first scan
+    HAZARD_SCAN_MIN = 64
+};
+
+template <typename T>
+void hazard_delete(void* ptr) {
+    delete static_cast<T*>(ptr);
+}
+
+struct hazard_record : thread_record {
+    struct retired {
+        void* ptr;
+        void (*deleter)(void*);
+    };
+
+    //! published hazards, read by every scanning thread
+    atomic<void*> slots[HAZARD_SLOTS];
+    //! slots in use by holders, owner only
+    unsigned used;
+    vector<retired> retired_list;
+    //! retired_list size that triggers the next scan
+    size_t scan_at;
+    //! scratch space for the sorted hazard snapshot
+    vector<void*> snapshot;
+
+    hazard_record()
+        : used(0), scan_at(HAZARD_SCAN_MIN) {}
+};
+
+//! In-place heapsort, the snapshot must be sorted without the STL
+inline void sort_pointers(void** data, size_t n) {
+    struct heap {
+        static void sift_down(void** d, size_t root, size_t end) {
+            while (2 * root + 1 < end) {
+                size_t child = 2 * root + 1;
+                if (child + 1 < end && d[child] < d[child + 1]) {
+                    ++child;
+                }
+                if (!(d[root] < d[child])) {
+                    return;
+                }
+                akl::swap(d[root], d[child]);
+                root = child;
+            }
+        }
+    };
+    for (size_t i = n / 2; i-- > 0;) {
+        heap::sift_down(data, i, n);
+    }
+    for (size_t end = n; end > 1; --end) {
+        akl::swap(data[0], data[end - 1]);
+        heap::sift_down(data, 0, end - 1);
+    }
+}
+
+inline bool contains_pointer(void* const* sorted, size_t n, void* ptr) {
+    size_t lo = 0;
+    size_t hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (sorted[mid] < ptr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < n && sorted[lo] == ptr;
+}
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * Hazard pointer reclamation domain.
+ *
+ * A reader announces every node it is about to dereference in one of its
+ * thread's hazard slots (holder::protect), and a retired node is freed
+ * only once no slot holds it. Unlike akl::epoch, a reader that stalls
+ * pins just the nodes it announced, so memory stays bounded by the number
+ * of slots no matter how long a reader sleeps. The price is a full fence
+ * per protected pointer on the read side.
+ *
+ * Retired pointers collect in per-thread lists. A list is scanned once it
+ * reaches twice the number of hazards seen by the last scan (at least
+ * HAZARD_SCAN_MIN), so every scan frees a batch proportional to its cost:
+ * the scan copies all slots into a sorted snapshot and binary searches it
+ * for each retired pointer.
+ */
+class hazard_domain {
+private:
+    details::thread_record_list<details::hazard_record> m_records;
+
+    // not copyable
+    hazard_domain(const hazard_domain&);
+    hazard_domain& operator=(const hazard_domain&);
+
+    //! True if some slot holds "ptr", fenced like a scan
+    bool held(void* ptr) {
+        atomic_thread_fence();
+        for (details::hazard_record* r = m_records.first(); r; r = m_records.next(r)) {
+            for (size_t i = 0; i < details::HAZARD_SLOTS; ++i) {
+                if (r->slots[i].load_acquire() == ptr) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    static void free_all(details::hazard_record* r) {
+        for (size_t i = 0; i < r->retired_list.size(); ++i) {
+            r->retired_list[i].deleter(r->retired_list[i].ptr);
+        }
+        r->retired_list.clear();
+    }
+
+    //! Frees the retired pointers of "mine" that no slot holds
+    void scan(details::hazard_record* mine) {
+        // pairs with the fence in protect(): a slot set before it is seen
+        atomic_thread_fence();
+        vector<void*>& snapshot = mine->snapshot;
+        snapshot.clear();
+        for (details::hazard_record* r = m_records.first(); r; r = m_records.next(r)) {
+            for (size_t i = 0; i < details::HAZARD_SLOTS; ++i) {
+                void* p = r->slots[i].load_acquire();
+                if (p && !snapshot.push_back(p)) {
+                    // without every hazard nothing is known to be free, retry later
+                    mine->scan_at = mine->retired_list.size() + details::HAZARD_SCAN_MIN;
+                    return;
+                }
+            }
+        }
+        details::sort_pointers(snapshot.data(), snapshot.size());
+
+        vector<details::hazard_record::retired>& list = mine->retired_list;
+        size_t kept = 0;
+        for (size_t i = 0; i < list.size(); ++i) {
+            if (details::contains_pointer(snapshot.data(), snapshot.size(), list[i].ptr)) {
+                list[kept++] = list[i];
+            } else {
+                list[i].deleter(list[i].ptr);
+            }
+        }
+        list.resize(kept);
+        mine->scan_at = kept + akl::max((size_t)details::HAZARD_SCAN_MIN, 2 * snapshot.size());
+    }
+
+public:
+    /**
+     * One hazard slot of the calling thread, held for the holder's
+     * lifetime. A thread's first HAZARD_SLOTS holders share its record;
+     * each one past them claims a record of its own from the domain. A
+     * holder whose record could not be allocated is not valid() and must
+     * not protect anything.
+     */
+    class holder {
+        hazard_domain& m_domain;
+        details::hazard_record* m_record;
+        bool m_cached;
+        unsigned m_slot;
+
+        // not copyable
+        holder(const holder&);
+        holder& operator=(const holder&);
+
+    public:
+        explicit holder(hazard_domain& domain)
+            : m_domain(domain) {
+            m_slot = 0;
+            m_record = domain.m_records.acquire(m_cached);
+            if (!m_record) {
+                return;
+            }
+            unsigned free = ~m_record->used & ((1u << details::HAZARD_SLOTS) - 1);
+            if (free == 0) {
+                domain.m_records.release(m_record, m_cached);
+                m_record = domain.m_records.acquire_spare();
+                m_cached = false;
+                if (!m_record) {
+                    return;
+                }
+                free = ~m_record->used & ((1u << details::HAZARD_SLOTS) - 1);
+            }
+            m_slot = __builtin_ctz(free);
+            m_record->used |= 1u << m_slot;
+        }
+
+        ~holder() {
+            if (!m_record) {
+                return;
+            }
+            reset();
+            m_record->used &= ~(1u << m_slot);
+            m_domain.m_records.release(m_record, m_cached);
+        }
+
+        bool valid() const {
+            return m_record != NULL;
+        }
+
+        /**
+         * Loads "src" and announces the result, retrying until the
+         * announcement is known to have happened before any retire of it.
+         * The result stays safe to dereference until the next protect(),
+         * reset() or the holder's end.
+         */
+        template <typename T>
+        T* protect(const atomic<T*>& src) {
+            ASSERT_TRUE(valid());
+            T* p = src.load_acquire();
+            while (true) {
+                m_record->slots[m_slot].store_release(p);
+                atomic_thread_fence();
+                T* again = src.load_acquire();
+                if (again == p) {
+                    return p;
+                }
+                p = again;
+            }
+        }
+
+        /// Announces "ptr" without validation; the caller re-checks its source
+        template <typename T>
+        void set(T* ptr) {
+            ASSERT_TRUE(valid());
+            m_record->slots[m_slot].store_release(const_cast<void*>(static_cast<const void*>(ptr)));
+            atomic_thread_fence();
+        }
+
+        void reset() {
+            m_record->slots[m_slot].store_release(NULL);
+        }
+    };
+
+    hazard_domain() {}
+
+    //! Frees everything still retired. No thread may use the domain
+    ~hazard_domain() {
+        for (details::hazard_record* r = m_records.first(); r; r = m_records.next(r)) {
+            free_all(r);
+        }
+    }
+
+    /// Calls deleter(ptr) once no hazard slot holds "ptr". Never blocks
+    void retire(void* ptr, void (*deleter)(void*)) {
+        bool cached;
+        details::hazard_record* r = m_records.acquire(cached);
+        if (!r) {
+            // no list to wait in: free it now unless a slot holds it, in
+            // which case it leaks
+            if (!held(ptr)) {
+                deleter(ptr);
+            }
+            return;
+        }
+        details::hazard_record::retired entry = {ptr, deleter};
+        if (!r->retired_list.push_back(entry)) {
+            // a scan makes room in the list's block; failing that "ptr"
+            // leaks rather than being freed while a slot may hold it
+            scan(r);
+            r->retired_list.push_back(entry);
+        } else if (r->retired_list.size() >= r->scan_at) {
+            scan(r);
+        }
+        m_records.release(r, cached);
+    }
+
+    /// retire() for objects from new, freed with delete
+    template <typename T>
+    void retire(T* ptr) {
+        retire(static_cast<void*>(ptr), &details::hazard_delete<T>);
+    }
+
+    /// Scans now, freeing whatever this thread retired that is no longer held
+    void flush() {
+        bool cached;
+        details::hazard_record* r = m_records.acquire(cached);
+        // without a record the thread has nothing retired
+        if (r) {
+            scan(r);
+            m_records.release(r, cached);
+        }
+    }
+};
+
+}  // namespace akl
@@ -11,17 +11,17 @@ extern "C" {
 
 /* memory */
 
-void akl_memset(void* dst, int c, unsigned int len);
+void akl_memset(void* dst, int c, size_t len);
 
-void* akl_cmemcpy(void* dst, void* src, unsigned int len);
+void* akl_cmemcpy(void* dst, const void* src, size_t len);
 
-void* akl_cmemmove(void* dst, void* src, unsigned int len);
+void* akl_cmemmove(void* dst, const void* src, size_t len);
 
-int akl_cmemcmp(void* p1, void* p2, unsigned int len);
+int akl_cmemcmp(const void* p1, const void* p2, size_t len);
 
-void* akl_cmalloc(unsigned int size);
+void* akl_cmalloc(size_t size);
 
-void* akl_crealloc(void* mem, unsigned int size);
+void* akl_crealloc(void* mem, size_t size);
 
 void akl_cfree(void* mem);
 
@@ -31,6 +31,16 @@ typedef struct {
     int counter;
 } akl_atomic_t;
 
+typedef struct {
+    akl_u64 counter;
+} akl_atomic64_t;
+
+//! two words swapped as one unit by the double width cas
+typedef struct {
+    akl_u64 lo;
+    akl_u64 hi;
+} __attribute__((aligned(16))) akl_u128_t;
+
 typedef struct {
     union {
         float f;
@@ -66,6 +76,27 @@ int akl_atomic_add_return(int add_val, akl_atomic_t* v);
 
 int akl_atomic_sub_return(int sub_val, akl_atomic_t* v);
 
+int akl_atomic_read_acquire(akl_atomic_t* v);
+
+void akl_atomic_set_release(akl_atomic_t* v, int i);
+
+akl_u64 akl_atomic64_xchg(akl_atomic64_t* v, akl_u64 new_val);
+
+akl_u64 akl_atomic64_cmpxchg(akl_atomic64_t* v, akl_u64 old_val, akl_u64 new_val);
+
+akl_u64 akl_atomic64_add_return(akl_u64 add_val, akl_atomic64_t* v);
+
+akl_u64 akl_atomic64_sub_return(akl_u64 sub_val, akl_atomic64_t* v);
+
+akl_u64 akl_atomic64_read_acquire(akl_atomic64_t* v);
+
+void akl_atomic64_set_release(akl_atomic64_t* v, akl_u64 i);
+
+//! double width cas, returns nonzero if "v" held "old_val"
+int akl_atomic128_cmpxchg(akl_u128_t* v, akl_u128_t old_val, akl_u128_t new_val);
+
+void akl_smp_mb(void);
+
 int akl_atomic_cmpxchg_float(
     akl_atomic_float_t* ptr, akl_atomic_float_t oldv, akl_atomic_float_t newv
 );
@@ -74,6 +105,61 @@ int akl_atomic_cmpxchg_double(
     akl_atomic_double_t* ptr, akl_atomic_double_t oldv, akl_atomic_double_t newv
 );
 
+/* rcu, kernel only */
+
+void akl_rcu_read_lock(void);
+
+void akl_rcu_read_unlock(void);
+
+/**
+ * Calls deleter(ptr) from softirq context once every rcu reader that may
+ * see "ptr" is done. Returns -1 if the bookkeeping allocation failed, in
+ * which case the caller waits with akl_synchronize_rcu() instead.
+ */
+int akl_call_rcu(void* ptr, void (*deleter)(void*));
+
+//! Waits for all current rcu readers
+void akl_synchronize_rcu(void);
+
+//! Waits until every akl_call_rcu callback queued so far has run
+void akl_rcu_barrier(void);
+
+/* sleeping on a variable, kernel only */
+
+//! Sleeps until "*var" differs from "expected" or a wakeup arrives, as TASK_IDLE
+void akl_wait_var_event(volatile int* var, int expected);
+
+//! Wakes the threads sleeping in akl_wait_var_event on "var"
+void akl_wake_up_var(volatile int* var);
+
+//! Lets other tasks run if a reschedule is due, process context only
+void akl_cond_resched(void);
+
+/* cpu topology, kernel only */
+
+//! First online cpu after "cpu" (-1 for the first one), -1 past the last
+int akl_next_online_cpu(int cpu);
+
+/**
+ * Ids of the package, the physical core and the last level cache of an
+ * online cpu. Cpus share an id exactly when they share that unit.
+ */
+void akl_cpu_topology(int cpu, int* package, int* core, int* llc);
+
+/* per-cpu data, kernel only */
+
+//! Bound on cpu ids, per-cpu arrays have this many entries
+int akl_nr_cpu_ids(void);
+
+//! Current cpu, only stable while preemption is disabled
+int akl_cpu_id(void);
+
+//! Disables preemption and returns the current cpu
+int akl_get_cpu(void);
+
+//! Enables preemption again after akl_get_cpu()
+void akl_put_cpu(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,240 @@
+#pragma once
+
+#include "atomic.hpp"
+#include "kern_lib.h"
+#include "sync.h"
+#include "utility.hpp"
+
+namespace akl {
+
+//! Link embedded in the nodes of an intrusive_lockfree_stack
+struct lockfree_stack_hook {
+    atomic<lockfree_stack_hook*> next;
+};
+
+namespace details {
+
+/**
+ * Stack top: a pointer and a version counter swapped together with the
+ * double width cas. Every successful swap bumps the version, so a top that
+ * was popped and pushed back in between no longer compares equal (ABA).
+ */
+class tagged_top {
+    union word {
+        akl_u128_t raw;
+        struct {
+            lockfree_stack_hook* ptr;
+            akl_u64 tag;
+        };
+    };
+
+    static_assert(sizeof(lockfree_stack_hook*) == sizeof(akl_u64), "tagged_top needs 64 bit pointers");
+
+    word m_top;
+
+public:
+    struct snapshot {
+        lockfree_stack_hook* ptr;
+        akl_u64 tag;
+    };
+
+    tagged_top() {
+        m_top.ptr = NULL;
+        m_top.tag = 0;
+    }
+
+    /**
+     * Reads both halves. The read is not atomic as a pair, but a torn
+     * snapshot never matches memory in compare_and_swap.
+     */
+    snapshot load() const {
+        snapshot s;
+        s.tag = akl_sync_load_acquire_u64(const_cast<volatile akl_u64*>(&m_top.raw.hi));
+        s.ptr = (lockfree_stack_hook*)akl_sync_load_acquire_u64(const_cast<volatile akl_u64*>(&m_top.raw.lo));
+        return s;
+    }
+
+    //! Replaces "expected" with "ptr" and the next version
+    bool compare_and_swap(const snapshot& expected, lockfree_stack_hook* ptr) {
+        word old_word, new_word;
+        old_word.ptr = expected.ptr;
+        old_word.tag = expected.tag;
+        new_word.ptr = ptr;
+        new_word.tag = expected.tag + 1;
+        return akl_sync_bool_compare_and_swap_u128(&m_top.raw, old_word.raw, new_word.raw);
+    }
+};
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * Treiber stack over caller-owned nodes. T derives from
+ * lockfree_stack_hook; the stack never allocates.
+ *
+ * The top is swapped with a double width cas together with a version
+ * counter, which keeps pop() correct when a node is popped and pushed
+ * back concurrently. pop() reads the link of a node that another thread
+ * may have popped meanwhile, so nodes must stay readable memory for as
+ * long as the stack is in use: recycle them (free lists, pools) rather
+ * than returning them to the allocator.
+ */
+template <typename T>
+class intrusive_lockfree_stack {
+private:
+    details::tagged_top m_top;
+
+    // not copyable
+    intrusive_lockfree_stack(const intrusive_lockfree_stack&);
+    intrusive_lockfree_stack& operator=(const intrusive_lockfree_stack&);
+
+public:
+    intrusive_lockfree_stack() {}
+
+    bool empty() const {
+        return m_top.load().ptr == NULL;
+    }
+
+    void push(T* node) {
+        push_list(node, node);
+    }
+
+    /**
+     * Pushes the chain first..last, already linked through their hooks,
+     * with a single cas. "first" ends up on top.
+     */
+    void push_list(T* first, T* last) {
+        lockfree_stack_hook* tail = static_cast<lockfree_stack_hook*>(last);
+        while (true) {
+            details::tagged_top::snapshot top = m_top.load();
+            tail->next.store_release(top.ptr);
+            if (m_top.compare_and_swap(top, static_cast<lockfree_stack_hook*>(first))) {
+                return;
+            }
+        }
+    }
+
+    /// Removes the top node, NULL if the stack is empty
+    T* pop() {
+        while (true) {
+            details::tagged_top::snapshot top = m_top.load();
+            if (!top.ptr) {
+                return NULL;
+            }
+            lockfree_stack_hook* next = top.ptr->next.load_acquire();
+            if (m_top.compare_and_swap(top, next)) {
+                return static_cast<T*>(top.ptr);
+            }
+        }
+    }
+
+    /// Detaches the whole stack, returning its top; walk it through the hooks
+    T* pop_all() {
+        while (true) {
+            details::tagged_top::snapshot top = m_top.load();
+            if (!top.ptr || m_top.compare_and_swap(top, NULL)) {
+                return static_cast<T*>(top.ptr);
+            }
+        }
+    }
+};
+
+/**
+ * \ingroup util
+ *
+ * Lock free LIFO of values. Nodes come from akl_cmalloc and are recycled
+ * through an internal free stack instead of being freed, which is what
+ * makes the unsynchronized link reads in pop() safe; the memory is
+ * returned when the stack is destroyed.
+ */
+template <typename T>
+class lockfree_stack {
+private:
+    struct node : lockfree_stack_hook {
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* item() {
+            return reinterpret_cast<T*>(storage);
+        }
+    };
+
+    intrusive_lockfree_stack<node> m_items;
+    intrusive_lockfree_stack<node> m_free;
+
+    // not copyable
+    lockfree_stack(const lockfree_stack&);
+    lockfree_stack& operator=(const lockfree_stack&);
+
+    static_assert(alignof(T) <= 16, "nodes are at most 16 byte aligned");
+
+    //! A recycled node or a new one, NULL if the allocation failed
+    node* get_node() {
+        node* n = m_free.pop();
+        if (!n) {
+            n = static_cast<node*>(akl_cmalloc(sizeof(node)));
+            if (n) {
+                new (n) node();
+            }
+        }
+        return n;
+    }
+
+    static void free_chain(node* n, bool destroy) {
+        while (n) {
+            node* next = static_cast<node*>(n->next.load_acquire());
+            if (destroy) {
+                n->item()->~T();
+            }
+            akl_cfree(n);
+            n = next;
+        }
+    }
+
+public:
+    lockfree_stack() {}
+
+    //! Destroys the remaining values. No other thread may use the stack
+    ~lockfree_stack() {
+        free_chain(m_items.pop_all(), !is_trivially_destructible<T>::value);
+        free_chain(m_free.pop_all(), false);
+    }
+
+    bool empty() const {
+        return m_items.empty();
+    }
+
+    /// Constructs a value on top. Returns false if no node could be allocated
+    template <typename... Args>
+    bool emplace(Args&&... args) {
+        node* n = get_node();
+        if (!n) {
+            return false;
+        }
+        new (n->item()) T(akl::forward<Args>(args)...);
+        m_items.push(n);
+        return true;
+    }
+
+    bool push(const T& value) {
+        return emplace(value);
+    }
+
+    bool push(T&& value) {
+        return emplace(akl::move(value));
+    }
+
+    /// Moves the top value into "out". Returns false if the stack is empty
+    bool try_pop(T& out) {
+        node* n = m_items.pop();
+        if (!n) {
+            return false;
+        }
+        out = akl::move(*n->item());
+        n->item()->~T();
+        m_free.push(n);
+        return true;
+    }
+};
+
+}  // namespace akl
@@ -0,0 +1,261 @@
+#pragma once
+
+#include "atomic.hpp"
+#include "cache_line_pad.hpp"
+#include "eventcount.hpp"
+#include "kern_lib.h"
+#include "utility.hpp"
+
+namespace akl {
+
+/**
+ * \ingroup util
+ *
+ * Bounded multi-producer multi-consumer queue (Vyukov's ring with
+ * per-cell sequence numbers).
+ *
+ * Cell i of the ring is free for the producer at position p when its
+ * sequence equals p, and ready for the consumer at position p when it
+ * equals p + 1. Producers and consumers claim positions with a CAS on the
+ * tail or head, then publish the cell with a release store of its
+ * sequence, so no operation ever waits on another thread. Head and tail
+ * sit on separate cache lines.
+ *
+ * The try_ operations fail instead of blocking when the queue is full or
+ * empty; callers decide whether to spin, yield or sleep. push() and pop()
+ * sleep on an eventcount instead and wake each other, at the cost of a
+ * fence per call; the try_ operations wake nobody, so a queue whose
+ * consumers sleep in pop() is fed with push().
+ */
+template <typename T>
+class mpmc_queue {
+private:
+    struct cell {
+        atomic<size_t> sequence;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* item() {
+            return reinterpret_cast<T*>(storage);
+        }
+    };
+
+    cell* m_cells;
+    size_t m_mask;
+    cache_line_pad<atomic<size_t> > m_tail;
+    cache_line_pad<atomic<size_t> > m_head;
+    //! consumers sleeping in pop() and producers sleeping in push()
+    cache_line_pad<eventcount> m_readable;
+    cache_line_pad<eventcount> m_writable;
+
+    // not copyable
+    mpmc_queue(const mpmc_queue&);
+    mpmc_queue& operator=(const mpmc_queue&);
+
+    static_assert(alignof(T) <= 16, "cells are at most 16 byte aligned");
+
+    //! Claims one position for a producer, returns NULL if the ring is full
+    cell* claim_push(size_t& pos) {
+        if (!m_cells) {
+            return NULL;
+        }
+        pos = m_tail.value.load_acquire();
+        while (true) {
+            cell* c = &m_cells[pos & m_mask];
+            size_t seq = c->sequence.load_acquire();
+            long diff = (long)seq - (long)pos;
+            if (diff == 0) {
+                if (m_tail.value.compare_and_swap(pos, pos + 1)) {
+                    return c;
+                }
+                pos = m_tail.value.load_acquire();
+            } else if (diff < 0) {
+                return NULL;
+            } else {
+                pos = m_tail.value.load_acquire();
+            }
+        }
+    }
+
+    //! Claims one position for a consumer, returns NULL if the ring is empty
+    cell* claim_pop(size_t& pos) {
+        if (!m_cells) {
+            return NULL;
+        }
+        pos = m_head.value.load_acquire();
+        while (true) {
+            cell* c = &m_cells[pos & m_mask];
+            size_t seq = c->sequence.load_acquire();
+            long diff = (long)seq - (long)(pos + 1);
+            if (diff == 0) {
+                if (m_head.value.compare_and_swap(pos, pos + 1)) {
+                    return c;
+                }
+                pos = m_head.value.load_acquire();
+            } else if (diff < 0) {
+                return NULL;
+            } else {
+                pos = m_head.value.load_acquire();
+            }
+        }
+    }
+
+    /**
+     * Claims up to "n" consecutive positions starting at the current
+     * "end" (tail or head) whose cells are in the state "offset" away
+     * from their position (0 for free, 1 for ready). Returns the count.
+     */
+    size_t claim_batch(atomic<size_t>& end, size_t offset, size_t n, size_t& pos) {
+        if (!m_cells) {
+            return 0;
+        }
+        while (true) {
+            pos = end.load_acquire();
+            size_t count = 0;
+            while (count < n) {
+                cell* c = &m_cells[(pos + count) & m_mask];
+                if (c->sequence.load_acquire() != pos + count + offset) {
+                    break;
+                }
+                ++count;
+            }
+            if (count == 0) {
+                // empty/full, unless another thread moved the end meanwhile
+                if (end.load_acquire() == pos) {
+                    return 0;
+                }
+                continue;
+            }
+            if (end.compare_and_swap(pos, pos + count)) {
+                return count;
+            }
+        }
+    }
+
+public:
+    /**
+     * Creates a queue holding at least "capacity" items, rounded up to a
+     * power of two. If the ring cannot be allocated, capacity() is 0 and
+     * every try_ operation fails.
+     */
+    explicit mpmc_queue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_cells = static_cast<cell*>(akl_cmalloc(size * sizeof(cell)));
+        if (!m_cells) {
+            return;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            new (&m_cells[i].sequence) atomic<size_t>(i);
+        }
+    }
+
+    //! Destroys the items still queued. No other thread may use the queue
+    ~mpmc_queue() {
+        if (!is_trivially_destructible<T>::value) {
+            size_t tail = m_tail.value.load_acquire();
+            for (size_t pos = m_head.value.load_acquire(); pos != tail; ++pos) {
+                m_cells[pos & m_mask].item()->~T();
+            }
+        }
+        akl_cfree(m_cells);
+    }
+
+    size_t capacity() const {
+        return m_cells ? m_mask + 1 : 0;
+    }
+
+    /// Number of queued items, exact only when the queue is quiescent
+    size_t size_approx() const {
+        size_t head = m_head.value.load_acquire();
+        size_t tail = m_tail.value.load_acquire();
+        return tail > head ? tail - head : 0;
+    }
+
+    /// Constructs an item at the tail. Returns false if the queue is full
+    template <typename... Args>
+    bool try_emplace(Args&&... args) {
+        size_t pos;
+        cell* c = claim_push(pos);
+        if (!c) {
+            return false;
+        }
+        new (c->item()) T(akl::forward<Args>(args)...);
+        c->sequence.store_release(pos + 1);
+        return true;
+    }
+
+    bool try_push(const T& item) {
+        return try_emplace(item);
+    }
+
+    bool try_push(T&& item) {
+        return try_emplace(akl::move(item));
+    }
+
+    /// Moves the head item into "out". Returns false if the queue is empty
+    bool try_pop(T& out) {
+        size_t pos;
+        cell* c = claim_pop(pos);
+        if (!c) {
+            return false;
+        }
+        out = akl::move(*c->item());
+        c->item()->~T();
+        c->sequence.store_release(pos + m_mask + 1);
+        return true;
+    }
+
+    /// Pushes "item", sleeping while the queue is full, and wakes a pop()
+    void push(const T& item) {
+        m_writable->wait([this, &item]() { return try_push(item); });
+        m_readable->notify_one();
+    }
+
+    void push(T&& item) {
+        m_writable->wait([this, &item]() { return try_push(akl::move(item)); });
+        m_readable->notify_one();
+    }
+
+    /// Pops the head item into "out", sleeping while the queue is empty, and wakes a push()
+    void pop(T& out) {
+        m_readable->wait([this, &out]() { return try_pop(out); });
+        m_writable->notify_one();
+    }
+
+    /**
+     * Pushes up to "n" items from "items" with a single CAS on the tail.
+     * Returns how many were pushed, which is less than "n" if the ring
+     * filled up.
+     */
+    size_t try_push_batch(const T* items, size_t n) {
+        size_t pos;
+        size_t count = claim_batch(m_tail.value, 0, n, pos);
+        for (size_t i = 0; i < count; ++i) {
+            cell* c = &m_cells[(pos + i) & m_mask];
+            new (c->item()) T(items[i]);
+            c->sequence.store_release(pos + i + 1);
+        }
+        return count;
+    }
+
+    /**
+     * Pops up to "n" items into "out" with a single CAS on the head.
+     * Returns how many were popped.
+     */
+    size_t try_pop_batch(T* out, size_t n) {
+        size_t pos;
+        size_t count = claim_batch(m_head.value, 1, n, pos);
+        for (size_t i = 0; i < count; ++i) {
+            cell* c = &m_cells[(pos + i) & m_mask];
+            out[i] = akl::move(*c->item());
+            c->item()->~T();
+            c->sequence.store_release(pos + i + m_mask + 1);
+        }
+        return count;
+    }
+};
+
+}  // namespace akl
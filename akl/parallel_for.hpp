@@ -0,0 +1,146 @@
+#pragma once
+
+#include "cache_line_pad.hpp"
+#include "kern_lib.h"
+#include "thread_pool.hpp"
+#include "utility.hpp"
+
+namespace akl {
+
+namespace details {
+
+/**
+ * Runs body(b, e) over pieces of [begin, end) with lazy binary splitting:
+ * the caller works through the range a grain at a time, and whenever its
+ * deque is empty it first hands the upper half of what is left to the
+ * pool. Ranges are therefore split only while some worker may be idle,
+ * and deeply only where stealing actually happens. A half the pool
+ * cannot take stays with the caller.
+ */
+template <typename Index, typename Body>
+void split_range(thread_pool& pool, task_batch& batch, Index begin, Index end, size_t grain, Body& body) {
+    while ((size_t)(end - begin) > grain) {
+        if (pool.local_backlog() == 0) {
+            Index mid = begin + (end - begin) / 2;
+            thread_pool* p = &pool;
+            task_batch* b = &batch;
+            Body* f = &body;
+            if (pool.launch([p, b, mid, end, grain, f]() { split_range(*p, *b, mid, end, grain, *f); }, batch)) {
+                end = mid;
+                continue;
+            }
+        }
+        Index stop = begin + (Index)grain;
+        body(begin, stop);
+        begin = stop;
+    }
+    body(begin, end);
+}
+
+//! Splits [begin, end) over the pool and waits for all of it
+template <typename Index, typename Body>
+void run_split(thread_pool& pool, Index begin, Index end, size_t grain, Body& body) {
+    task_batch batch;
+    if (pool.is_worker()) {
+        split_range(pool, batch, begin, end, grain, body);
+    } else {
+        thread_pool* p = &pool;
+        task_batch* b = &batch;
+        Body* f = &body;
+        if (!pool.launch([p, b, begin, end, grain, f]() { split_range(*p, *b, begin, end, grain, *f); }, batch)) {
+            split_range(pool, batch, begin, end, grain, body);
+        }
+    }
+    pool.wait(batch);
+}
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * Calls fn(i) for every i in [begin, end) on the workers of "pool". The
+ * range is split recursively and spread by work stealing; no piece is
+ * smaller than "grain" indices unless the range is. Ranges of at most
+ * "grain" indices, and pools of one worker, run sequentially in the
+ * caller. May be called from inside a task of the same pool: the caller
+ * then works on the range itself.
+ */
+template <typename Index, typename Fn>
+void parallel_for(thread_pool& pool, Index begin, Index end, size_t grain, Fn fn) {
+    if (grain == 0) {
+        grain = 1;
+    }
+    if (end <= begin || (size_t)(end - begin) <= grain || pool.size() == 1) {
+        for (; begin != end; ++begin) {
+            fn(begin);
+        }
+        return;
+    }
+    auto body = [&fn](Index b, Index e) {
+        for (; b != e; ++b) {
+            fn(b);
+        }
+    };
+    details::run_split(pool, begin, end, grain, body);
+}
+
+/**
+ * \ingroup util
+ *
+ * Folds [begin, end) in parallel: fn(i, acc) adds index i to the
+ * accumulator "acc", and combine(a, b) merges two accumulators. Every
+ * worker folds into its own cache line padded accumulator, starting from
+ * "identity", so no two workers write the same line and nothing is
+ * locked; the caller combines the per-worker results once all are done.
+ * combine must be associative and commutative, since the order in which
+ * indices reach a worker is not fixed. Splitting and the sequential
+ * fallback are as in parallel_for(); the fold also runs sequentially if
+ * the accumulators cannot be allocated.
+ */
+template <typename Index, typename T, typename Fn, typename Combine>
+T parallel_reduce(thread_pool& pool, Index begin, Index end, size_t grain, const T& identity, Fn fn,
+                  Combine combine) {
+    if (grain == 0) {
+        grain = 1;
+    }
+    // akl_cmalloc aligns to 16 only, the accumulators want whole lines
+    // a resize() meanwhile may bring in workers up to max_size(), and one
+    // more is for a caller outside the pool that keeps part of the range
+    size_t workers = pool.max_size();
+    void* raw = NULL;
+    if (end > begin && (size_t)(end - begin) > grain && pool.size() > 1) {
+        raw = akl_cmalloc((workers + 1) * sizeof(cache_line_pad<T>) + AKL_CACHE_LINE_SIZE - 1);
+    }
+    if (!raw) {
+        T acc = identity;
+        for (; begin != end; ++begin) {
+            fn(begin, acc);
+        }
+        return acc;
+    }
+    size_t addr = ((size_t)raw + AKL_CACHE_LINE_SIZE - 1) & ~(size_t)(AKL_CACHE_LINE_SIZE - 1);
+    cache_line_pad<T>* accs = reinterpret_cast<cache_line_pad<T>*>(addr);
+    for (size_t w = 0; w <= workers; ++w) {
+        new (&accs[w]) cache_line_pad<T>(identity);
+    }
+
+    thread_pool* p = &pool;
+    auto body = [p, accs, workers, &fn](Index b, Index e) {
+        T& acc = accs[p->is_worker() ? (size_t)thread_pool::worker_index() : workers].value;
+        for (; b != e; ++b) {
+            fn(b, acc);
+        }
+    };
+    details::run_split(pool, begin, end, grain, body);
+
+    T result = identity;
+    for (size_t w = 0; w <= workers; ++w) {
+        result = combine(result, accs[w].value);
+        accs[w].~cache_line_pad<T>();
+    }
+    akl_cfree(raw);
+    return result;
+}
+
+}  // namespace akl
@@ -3,8 +3,17 @@
 
 #include "types.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* opaque storage for a pthread_mutex_t or a kernel struct mutex,
+ * pthread.c checks that the backend type fits */
 typedef struct {
-    char data_[5];
+    union {
+        char data_[64];
+        akl_u64 align_;
+    };
 } akl_pthread_mutex_t;
 
 int akl_pthread_mutex_init(akl_pthread_mutex_t* mutex, void*);
@@ -17,4 +26,56 @@ int akl_pthread_mutex_unlock(akl_pthread_mutex_t* mutex);
 
 int akl_pthread_mutex_trylock(akl_pthread_mutex_t* mutex);
 
+/* threads: kthreads in the kernel, pthreads in userspace */
+
+typedef struct akl_thread akl_thread_t;
+
+/**
+ * Starts a thread calling fn(arg), pinned to "cpu" before it runs unless
+ * "cpu" is negative. In the kernel a pinned thread comes from
+ * kthread_create_on_cpu, and the call waits for the thread to claim its
+ * akl_thread_slot(). Returns NULL if no thread could be started.
+ */
+akl_thread_t* akl_thread_create(void (*fn)(void*), void* arg, int cpu);
+
+//! Waits until fn has returned, then frees the thread
+void akl_thread_join(akl_thread_t* thread);
+
+//! Moves the thread to "cpu", or lets it run on any cpu if "cpu" is negative
+int akl_thread_set_cpu(akl_thread_t* thread, int cpu);
+
+/**
+ * A word of per-thread storage for the calling thread. Every thread of
+ * akl_thread_create has one; in the kernel other threads get NULL. The
+ * kernel has no thread_local, so headers that need one in both builds
+ * keep it here.
+ */
+void** akl_thread_slot(void);
+
+/* wait queues: a wait_queue_head_t in the kernel, a futex on the word in userspace */
+
+typedef struct {
+    union {
+        char data_[64];
+        akl_u64 align_;
+    };
+} akl_wait_queue_t;
+
+void akl_wait_queue_init(akl_wait_queue_t* queue);
+
+/**
+ * Sleeps on "queue" while "*word" equals "expected", until
+ * akl_wait_queue_wake(). Kernel sleepers count neither towards the load
+ * average nor as hung tasks, so idle workers may wait indefinitely. May
+ * return early; callers re-check their condition in a loop.
+ */
+void akl_wait_queue_wait(akl_wait_queue_t* queue, volatile int* word, int expected);
+
+//! Wakes up to "count" threads sleeping on "queue" for "word"
+void akl_wait_queue_wake(akl_wait_queue_t* queue, volatile int* word, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -1,193 +1,152 @@
 #pragma once
 
-#if 0
-
-#include <cstdlib>
-#include <pthread.h>
-#include <semaphore.h>
+#ifndef __KERNEL_MODULE__
 #include <sched.h>
-#include <signal.h>
-#include <sys/time.h>
-#include <vector>
-#include <list>
-#include <queue>
-#include <iostream>
-
-#include "macro.hpp"
-#include "mutex.hpp"
+#endif
 
+#include "atomic.hpp"
+#include "kern_lib.h"
 
 namespace akl {
-#if _POSIX_SPIN_LOCKS >= 0
-    /**
-     * \ingroup util
-     *
-     * Wrapper around pthread's spinlock.
-     *
-     * Before you use, see \ref parallel_object_intricacies.
-     */
-    class spinlock {
-    private:
-        // mutable not actually needed
-        mutable pthread_spinlock_t m_spin;
-
-    public:
-        /// constructs a spinlock
-        spinlock() {
-            int error = pthread_spin_init(&m_spin, PTHREAD_PROCESS_PRIVATE);
-            ASSERT_TRUE(!error);
-        }
-
-        /** Copy constructor which does not copy. Do not use!
-            Required for compatibility with some STL implementations (LLVM).
-            which use the copy constructor for vector resize,
-            rather than the standard constructor.    */
-        spinlock(const spinlock &) {
-            int error = pthread_spin_init(&m_spin, PTHREAD_PROCESS_PRIVATE);
-            ASSERT_TRUE(!error);
-        }
-
-        // not copyable
-        void operator=(const spinlock &m) {
-        }
-
-
-        /// Acquires a lock on the spinlock
-        inline void lock() const {
-            int error = pthread_spin_lock(&m_spin);
-            ASSERT_TRUE(!error);
-        }
-
-        /// Releases a lock on the spinlock
-        inline void unlock() const {
-            int error = pthread_spin_unlock(&m_spin);
-            ASSERT_TRUE(!error);
-        }
-
-        /// Non-blocking attempt to acquire a lock on the spinlock
-        inline bool try_lock() const {
-            return pthread_spin_trylock(&m_spin) == 0;
-        }
 
-        ~spinlock() {
-            int error = pthread_spin_destroy(&m_spin);
-            ASSERT_TRUE(!error);
-        }
-
-        friend class conditional;
-    }; // End of spinlock
-#define SPINLOCK_SUPPORTED 1
+namespace details {
+
+//! Spins before a waiter gives up its time slice
+enum { SPIN_YIELD_AFTER = 1024 };
+
+/**
+ * One step of a spin wait, yields now and then. In the kernel that is a
+ * cond_resched(), so waiters there must be in process context.
+ */
+inline void spin_wait(unsigned& spins) {
+    cpu_relax();
+    if (++spins == SPIN_YIELD_AFTER) {
+        spins = 0;
+#ifdef __KERNEL_MODULE__
+        akl_cond_resched();
 #else
-    //! if spinlock not supported, it is typedef it to a mutex.
-    typedef mutex spinlock;
-#define SPINLOCK_SUPPORTED 0
+        sched_yield();
 #endif
-
-
-    /**
-   * \ingroup util
-   *If pthread spinlock is not implemented,
-   * this provides a simple alternate spin lock implementation.
-   *
-   * Before you use, see \ref parallel_object_intricacies.
-   */
-    class simple_spinlock {
-    private:
-        // mutable not actually needed
-        mutable volatile char spinner;
-
-    public:
-        /// constructs a spinlock
-        simple_spinlock() {
-            spinner = 0;
-        }
-
-        /** Copy constructor which does not copy. Do not use!
-        Required for compatibility with some STL implementations (LLVM).
-        which use the copy constructor for vector resize,
-        rather than the standard constructor.    */
-        simple_spinlock(const simple_spinlock &) {
-            spinner = 0;
-        }
-
-        // not copyable
-        void operator=(const simple_spinlock &m) {
-        }
-
-
-        /// Acquires a lock on the spinlock
-        inline void lock() const {
-            while (spinner == 1 || __sync_lock_test_and_set(&spinner, 1));
-        }
-
-        /// Releases a lock on the spinlock
-        inline void unlock() const {
-            __sync_synchronize();
-            spinner = 0;
-        }
-
-        /// Non-blocking attempt to acquire a lock on the spinlock
-        inline bool try_lock() const {
-            return (__sync_lock_test_and_set(&spinner, 1) == 0);
-        }
-
-        ~simple_spinlock() {
-            ASSERT_TRUE(spinner == 0);
-        }
-    };
-
-
-    /**
-   * \ingroup util
-   *If pthread spinlock is not implemented,
-   * this provides a simple alternate spin lock implementation.
-   *
-   * Before you use, see \ref parallel_object_intricacies.
-   */
-    class padded_simple_spinlock {
-    private:
-        // mutable not actually needed
-        mutable volatile char spinner;
-        // char padding[63];
-    public:
-        /// constructs a spinlock
-        padded_simple_spinlock() {
-            spinner = 0;
-        }
-
-        /** Copy constructor which does not copy. Do not use!
-        Required for compatibility with some STL implementations (LLVM).
-        which use the copy constructor for vector resize,
-        rather than the standard constructor.    */
-        padded_simple_spinlock(const padded_simple_spinlock &) {
-            spinner = 0;
-        }
-
-        // not copyable
-        void operator=(const padded_simple_spinlock &m) {
-        }
-
-
-        /// Acquires a lock on the spinlock
-        inline void lock() const {
-            while (spinner == 1 || __sync_lock_test_and_set(&spinner, 1));
-        }
-
-        /// Releases a lock on the spinlock
-        inline void unlock() const {
-            __sync_synchronize();
-            spinner = 0;
-        }
-
-        /// Non-blocking attempt to acquire a lock on the spinlock
-        inline bool try_lock() const {
-            return (__sync_lock_test_and_set(&spinner, 1) == 0);
-        }
-
-        ~padded_simple_spinlock() {
-            ASSERT_TRUE(spinner == 0);
-        }
-    };
+    }
 }
 
-#endif
\ No newline at end of file
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * Test and test-and-set spinlock over akl::atomic, so it builds in the
+ * kernel module too. Waiters spin on a plain read and only retry the
+ * exchange once the lock looks free. A waiter yields after a while, so
+ * a preempted holder is not starved by its waiters; in the kernel that
+ * needs process context.
+ *
+ * Meant for critical sections of a few dozen instructions; anything that
+ * may sleep belongs under akl::mutex.
+ */
+class spinlock {
+private:
+    mutable atomic<int> m_locked;
+
+public:
+    spinlock() {}
+
+    /** Copy constructor which does not copy. Do not use!
+        Lets spinlocks live in containers that copy on resize. */
+    spinlock(const spinlock&) {}
+
+    // not copyable
+    void operator=(const spinlock&) {}
+
+    /// Acquires the lock
+    inline void lock() const {
+        unsigned spins = 0;
+        while (m_locked.exchange(1)) {
+            while (m_locked.load_acquire()) {
+                details::spin_wait(spins);
+            }
+        }
+    }
+
+    /// Releases the lock
+    inline void unlock() const {
+        m_locked.store_release(0);
+    }
+
+    /// Non-blocking attempt to acquire the lock
+    inline bool try_lock() const {
+        return !m_locked.load_acquire() && !m_locked.exchange(1);
+    }
+};
+
+/**
+ * \ingroup util
+ *
+ * Reader-writer spinlock. The state word holds the reader count above two
+ * flag bits: writer holds the lock, writer waiting. A waiting writer
+ * turns new readers away, so a steady stream of readers cannot starve it.
+ */
+class spin_rwlock {
+private:
+    enum { WRITER = 1, WRITER_WAITING = 2, READER = 4 };
+
+    mutable atomic<int> m_state;
+
+public:
+    spin_rwlock() {}
+
+    /** Copy constructor which does not copy. Do not use! */
+    spin_rwlock(const spin_rwlock&) {}
+
+    // not copyable
+    void operator=(const spin_rwlock&) {}
+
+    inline void readlock() const {
+        unsigned spins = 0;
+        while (true) {
+            int state = m_state.load_acquire();
+            if (!(state & (WRITER | WRITER_WAITING)) && m_state.compare_and_swap(state, state + READER)) {
+                return;
+            }
+            details::spin_wait(spins);
+        }
+    }
+
+    inline bool try_readlock() const {
+        int state = m_state.load_acquire();
+        return !(state & (WRITER | WRITER_WAITING)) && m_state.compare_and_swap(state, state + READER);
+    }
+
+    inline void rdunlock() const {
+        m_state.dec(READER);
+    }
+
+    inline void writelock() const {
+        unsigned spins = 0;
+        while (true) {
+            int state = m_state.load_acquire();
+            if ((state & ~WRITER_WAITING) == 0) {
+                // free: take it and clear our waiting mark
+                if (m_state.compare_and_swap(state, WRITER)) {
+                    return;
+                }
+                continue;
+            }
+            if (!(state & WRITER_WAITING)) {
+                m_state.compare_and_swap(state, state | WRITER_WAITING);
+            }
+            details::spin_wait(spins);
+        }
+    }
+
+    inline bool try_writelock() const {
+        int state = m_state.load_acquire();
+        return (state & ~WRITER_WAITING) == 0 && m_state.compare_and_swap(state, WRITER);
+    }
+
+    inline void wrunlock() const {
+        m_state.dec(WRITER);
+    }
+};
+
+}  // namespace akl
@@ -0,0 +1,268 @@
+#pragma once
+
+#include "atomic.hpp"
+#include "cache_line_pad.hpp"
+#include "eventcount.hpp"
+#include "kern_lib.h"
+#include "utility.hpp"
+
+namespace akl {
+
+/**
+ * \ingroup util
+ *
+ * Bounded single-producer single-consumer ring buffer.
+ *
+ * Exactly one thread may call the producer side (try_push, reserve,
+ * commit) and one thread the consumer side (try_pop, peek, consume).
+ * Neither side ever retries, so every operation is wait-free.
+ *
+ * Each side keeps a private copy of the other side's index and reads the
+ * shared one only when the copy says the ring is full or empty. A batch
+ * of any size is made visible with a single release store, and
+ * reserve()/peek() hand out the slots themselves so items can be built
+ * and read in place without an extra copy.
+ *
+ * push() and pop() sleep on an eventcount while the ring is full or
+ * empty and wake each other, at the cost of a fence per call; the other
+ * operations wake nobody, so a ring whose consumer sleeps in pop() is
+ * fed with push().
+ */
+template <typename T>
+class spsc_ring {
+private:
+    struct producer_side {
+        //! next slot to publish, read by the consumer
+        atomic<size_t> tail;
+        //! the producer's own copy of tail, never read by the consumer
+        size_t local_tail;
+        //! last head seen by the producer
+        size_t cached_head;
+
+        producer_side()
+            : local_tail(0), cached_head(0) {}
+    };
+
+    struct consumer_side {
+        //! next slot to consume, read by the producer
+        atomic<size_t> head;
+        //! the consumer's own copy of head, never read by the producer
+        size_t local_head;
+        //! last tail seen by the consumer
+        size_t cached_tail;
+
+        consumer_side()
+            : local_head(0), cached_tail(0) {}
+    };
+
+    T* m_slots;
+    size_t m_mask;
+    cache_line_pad<producer_side> m_prod;
+    cache_line_pad<consumer_side> m_cons;
+    //! the consumer sleeping in pop() and the producer sleeping in push()
+    cache_line_pad<eventcount> m_readable;
+    cache_line_pad<eventcount> m_writable;
+
+    // not copyable
+    spsc_ring(const spsc_ring&);
+    spsc_ring& operator=(const spsc_ring&);
+
+    static_assert(alignof(T) <= 16, "slots are at most 16 byte aligned");
+
+    //! Free slots as seen by the producer, refreshing the head if needed
+    size_t writable(size_t tail, size_t wanted) {
+        size_t free = capacity() - (tail - m_prod->cached_head);
+        if (free < wanted) {
+            m_prod->cached_head = m_cons->head.load_acquire();
+            free = capacity() - (tail - m_prod->cached_head);
+        }
+        return free;
+    }
+
+    //! Ready slots as seen by the consumer, refreshing the tail if needed
+    size_t readable(size_t head, size_t wanted) {
+        size_t ready = m_cons->cached_tail - head;
+        if (ready < wanted) {
+            m_cons->cached_tail = m_prod->tail.load_acquire();
+            ready = m_cons->cached_tail - head;
+        }
+        return ready;
+    }
+
+    //! Makes every slot below "tail" visible to the consumer
+    void publish(size_t tail) {
+        m_prod->local_tail = tail;
+        m_prod->tail.store_release(tail);
+    }
+
+    //! Hands every slot below "head" back to the producer
+    void retire(size_t head) {
+        m_cons->local_head = head;
+        m_cons->head.store_release(head);
+    }
+
+public:
+    /**
+     * Creates a ring holding at least "capacity" items, rounded up to a
+     * power of two. If the slots cannot be allocated, capacity() is 0 and
+     * the ring stays both full and empty.
+     */
+    explicit spsc_ring(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_slots = static_cast<T*>(akl_cmalloc(size * sizeof(T)));
+        m_mask = m_slots ? size - 1 : 0;
+    }
+
+    //! Destroys the items still queued. Neither side may be in use
+    ~spsc_ring() {
+        if (!is_trivially_destructible<T>::value) {
+            size_t tail = m_prod->tail.load_acquire();
+            for (size_t pos = m_cons->head.load_acquire(); pos != tail; ++pos) {
+                m_slots[pos & m_mask].~T();
+            }
+        }
+        akl_cfree(m_slots);
+    }
+
+    size_t capacity() const {
+        return m_slots ? m_mask + 1 : 0;
+    }
+
+    /// Number of queued items, exact only when called by one of the two sides
+    size_t size_approx() const {
+        return m_prod->tail.load_acquire() - m_cons->head.load_acquire();
+    }
+
+    /* producer side */
+
+    /// Constructs an item at the tail and publishes it. False if full
+    template <typename... Args>
+    bool try_emplace(Args&&... args) {
+        size_t tail = m_prod->local_tail;
+        if (writable(tail, 1) == 0) {
+            return false;
+        }
+        new (m_slots + (tail & m_mask)) T(akl::forward<Args>(args)...);
+        publish(tail + 1);
+        return true;
+    }
+
+    bool try_push(const T& item) {
+        return try_emplace(item);
+    }
+
+    bool try_push(T&& item) {
+        return try_emplace(akl::move(item));
+    }
+
+    /// Pushes "item", sleeping while the ring is full, and wakes a pop()
+    void push(const T& item) {
+        m_writable->wait([this, &item]() { return try_push(item); });
+        m_readable->notify_one();
+    }
+
+    void push(T&& item) {
+        m_writable->wait([this, &item]() { return try_push(akl::move(item)); });
+        m_readable->notify_one();
+    }
+
+    /**
+     * Copies up to "n" items from "items" and publishes them with one
+     * release store. Returns how many fitted.
+     */
+    size_t try_push_batch(const T* items, size_t n) {
+        size_t tail = m_prod->local_tail;
+        n = akl::min(n, writable(tail, n));
+        for (size_t i = 0; i < n; ++i) {
+            new (m_slots + ((tail + i) & m_mask)) T(items[i]);
+        }
+        publish(tail + n);
+        return n;
+    }
+
+    /**
+     * Returns up to "n" contiguous unconstructed slots at the tail and
+     * stores their number in "n", which is 0 if the ring is full. The
+     * caller constructs items in them with placement new and hands them
+     * to the consumer with commit(). The run stops at the wrap point, so
+     * a second reserve() may return more.
+     */
+    T* reserve(size_t& n) {
+        size_t tail = m_prod->local_tail;
+        size_t offset = tail & m_mask;
+        n = akl::min(n, capacity() - offset);
+        n = akl::min(n, writable(tail, n));
+        return m_slots + offset;
+    }
+
+    /// Publishes the first "n" slots of the last reserve() at once
+    void commit(size_t n) {
+        publish(m_prod->local_tail + n);
+    }
+
+    /* consumer side */
+
+    /// Moves the head item into "out". False if the ring is empty
+    bool try_pop(T& out) {
+        size_t head = m_cons->local_head;
+        if (readable(head, 1) == 0) {
+            return false;
+        }
+        T* slot = m_slots + (head & m_mask);
+        out = akl::move(*slot);
+        slot->~T();
+        retire(head + 1);
+        return true;
+    }
+
+    /// Pops the head item into "out", sleeping while the ring is empty, and wakes a push()
+    void pop(T& out) {
+        m_readable->wait([this, &out]() { return try_pop(out); });
+        m_writable->notify_one();
+    }
+
+    /**
+     * Moves up to "n" items into "out" and frees their slots with one
+     * release store. Returns how many were taken.
+     */
+    size_t try_pop_batch(T* out, size_t n) {
+        size_t head = m_cons->local_head;
+        n = akl::min(n, readable(head, n));
+        for (size_t i = 0; i < n; ++i) {
+            T* slot = m_slots + ((head + i) & m_mask);
+            out[i] = akl::move(*slot);
+            slot->~T();
+        }
+        retire(head + n);
+        return n;
+    }
+
+    /**
+     * Returns up to "n" contiguous published items at the head and stores
+     * their number in "n", which is 0 if the ring is empty. The items stay
+     * in the ring until consume() releases them.
+     */
+    T* peek(size_t& n) {
+        size_t head = m_cons->local_head;
+        size_t offset = head & m_mask;
+        n = akl::min(n, capacity() - offset);
+        n = akl::min(n, readable(head, n));
+        return m_slots + offset;
+    }
+
+    /// Destroys the first "n" items of the last peek() and frees their slots
+    void consume(size_t n) {
+        size_t head = m_cons->local_head;
+        if (!is_trivially_destructible<T>::value) {
+            for (size_t i = 0; i < n; ++i) {
+                m_slots[(head + i) & m_mask].~T();
+            }
+        }
+        retire(head + n);
+    }
+};
+
+}  // namespace akl
@@ -42,6 +42,47 @@ int akl_atomic_compare_and_swap_double(
     akl_atomic_double_t desired
 );
 
+int akl_sync_load_acquire(volatile int* t);
+
+void akl_sync_store_release(volatile int* t, int val);
+
+/* 64 bit words */
+
+int akl_sync_bool_compare_and_swap_u64(volatile akl_u64* t, akl_u64 expected, akl_u64 desired);
+
+akl_u64 akl_sync_add_and_fetch_u64(volatile akl_u64* t, akl_u64 val);
+
+akl_u64 akl_sync_fetch_and_add_u64(volatile akl_u64* t, akl_u64 val);
+
+akl_u64 akl_sync_sub_and_fetch_u64(volatile akl_u64* t, akl_u64 val);
+
+akl_u64 akl_sync_fetch_and_sub_u64(volatile akl_u64* t, akl_u64 val);
+
+akl_u64 akl_sync_lock_test_and_set_u64(volatile akl_u64* t, akl_u64 val);
+
+akl_u64 akl_sync_load_acquire_u64(volatile akl_u64* t);
+
+void akl_sync_store_release_u64(volatile akl_u64* t, akl_u64 val);
+
+/* 128 bit words, "t" must be 16 byte aligned */
+
+int akl_sync_bool_compare_and_swap_u128(volatile akl_u128_t* t, akl_u128_t expected, akl_u128_t desired);
+
+/* sleeping on a word */
+
+/**
+ * Blocks while "*t" equals "expected", until akl_sync_wake() on "t".
+ * May return early; callers re-check their condition in a loop.
+ */
+void akl_sync_wait(volatile int* t, int expected);
+
+//! Wakes up to "count" threads blocked in akl_sync_wait() on "t"
+void akl_sync_wake(volatile int* t, int count);
+
+/* fences */
+
+void akl_sync_synchronize(void);
+
 void akl_atomic_exchange(volatile int* a, int* b);
 
 int akl_fetch_and_store(volatile int* a, const int* newval);
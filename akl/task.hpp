@@ -0,0 +1,362 @@
+#pragma once
+
+/* userspace only: needs the C++20 <coroutine> support header */
+
+#include <coroutine>
+
+#include "atomic.hpp"
+#include "kern_lib.h"
+#include "sync.h"
+#include "utility.hpp"
+
+namespace akl {
+
+template <typename T>
+class task;
+
+namespace details {
+
+enum {
+    //! frame sizes are rounded up to multiples of this
+    FRAME_CLASS_BYTES = 64,
+    //! frames up to FRAME_CLASSES * FRAME_CLASS_BYTES are cached
+    FRAME_CLASSES = 16,
+    //! freed frames a thread keeps per size class
+    FRAME_CACHE = 64
+};
+
+/**
+ * Coroutine frames freed by this thread, by size class. Frames come back
+ * to the thread that finishes the coroutine, which in a pool is usually
+ * one that starts the next ones; the rest go to akl_cfree.
+ */
+struct frame_cache {
+    struct free_frame {
+        free_frame* next;
+    };
+
+    free_frame* heads[FRAME_CLASSES];
+    size_t counts[FRAME_CLASSES];
+
+    ~frame_cache() {
+        for (size_t c = 0; c < FRAME_CLASSES; ++c) {
+            while (free_frame* f = heads[c]) {
+                heads[c] = f->next;
+                akl_cfree(f);
+            }
+        }
+    }
+};
+
+inline frame_cache& current_frame_cache() {
+    static thread_local frame_cache cache;
+    return cache;
+}
+
+inline void* frame_alloc(size_t size) {
+    size_t c = (size - 1) / FRAME_CLASS_BYTES;
+    if (c < FRAME_CLASSES) {
+        frame_cache& cache = current_frame_cache();
+        if (frame_cache::free_frame* f = cache.heads[c]) {
+            cache.heads[c] = f->next;
+            --cache.counts[c];
+            return f;
+        }
+        size = (c + 1) * FRAME_CLASS_BYTES;
+    }
+    return akl_cmalloc(size);
+}
+
+inline void frame_free(void* p, size_t size) {
+    size_t c = (size - 1) / FRAME_CLASS_BYTES;
+    if (c < FRAME_CLASSES) {
+        frame_cache& cache = current_frame_cache();
+        if (cache.counts[c] < FRAME_CACHE) {
+            frame_cache::free_frame* f = static_cast<frame_cache::free_frame*>(p);
+            f->next = cache.heads[c];
+            cache.heads[c] = f;
+            ++cache.counts[c];
+            return;
+        }
+    }
+    akl_cfree(p);
+}
+
+//! One shot event a thread sleeps on until a coroutine finishes
+struct task_event {
+    atomic<int> done;
+
+    void set() {
+        done.store_release(1);
+        akl_sync_wake(&done.value, 1);
+    }
+
+    void wait() {
+        while (!done.load_acquire()) {
+            akl_sync_wait(&done.value, 0);
+        }
+    }
+};
+
+struct task_promise_base {
+    //! coroutine awaiting this one, resumed by symmetric transfer
+    std::coroutine_handle<> continuation;
+    //! or a thread in sync_wait()
+    task_event* event;
+
+    struct final_awaiter {
+        bool await_ready() noexcept {
+            return false;
+        }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+            task_promise_base& p = h.promise();
+            if (p.continuation) {
+                return p.continuation;
+            }
+            // sync_wait() may destroy the frame as soon as the event is set
+            task_event* event = p.event;
+            if (event) {
+                event->set();
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    task_promise_base()
+        : event(NULL) {}
+
+    std::suspend_always initial_suspend() noexcept {
+        return std::suspend_always();
+    }
+
+    final_awaiter final_suspend() noexcept {
+        return final_awaiter();
+    }
+
+    void unhandled_exception() {
+        // the build has no exceptions
+        ASSERT_TRUE(false);
+    }
+
+    //! NULL makes the call yield get_return_object_on_allocation_failure()
+    static void* operator new(size_t size) noexcept {
+        return frame_alloc(size);
+    }
+
+    static void operator delete(void* p, size_t size) {
+        frame_free(p, size);
+    }
+};
+
+template <typename T>
+struct task_promise : task_promise_base {
+    alignas(T) unsigned char storage[sizeof(T)];
+    bool has_value;
+
+    task_promise()
+        : has_value(false) {}
+
+    ~task_promise() {
+        if (has_value) {
+            value()->~T();
+        }
+    }
+
+    task<T> get_return_object();
+
+    static task<T> get_return_object_on_allocation_failure();
+
+    T* value() {
+        return reinterpret_cast<T*>(storage);
+    }
+
+    template <typename U>
+    void return_value(U&& v) {
+        new (storage) T(akl::forward<U>(v));
+        has_value = true;
+    }
+
+    T take() {
+        return akl::move(*value());
+    }
+};
+
+template <>
+struct task_promise<void> : task_promise_base {
+    task<void> get_return_object();
+
+    static task<void> get_return_object_on_allocation_failure();
+
+    void return_void() {}
+
+    void take() {}
+};
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * Coroutine returning T. A task starts when it is first awaited (or
+ * handed to sync_wait()) and resumes its awaiter by symmetric transfer
+ * when it returns, so chains of tasks neither grow the stack nor go
+ * through a queue. co_await schedule_on(pool) moves the rest of a
+ * coroutine onto a pool worker; a coroutine that waits on an
+ * async_mutex or async_semaphore is suspended, and its worker runs
+ * other tasks meanwhile.
+ *
+ * Frames are allocated through promise_type::operator new from
+ * per-thread size class caches backed by akl_cmalloc; a call whose frame
+ * cannot be allocated returns a task that is not valid(). A task is move
+ * only, awaited once, and destroys its frame with it.
+ */
+template <typename T = void>
+class task {
+public:
+    typedef details::task_promise<T> promise_type;
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+
+    template <typename U>
+    friend U sync_wait(task<U>&& t);
+
+    // not copyable
+    task(const task&);
+    task& operator=(const task&);
+
+public:
+    struct awaiter {
+        std::coroutine_handle<promise_type> handle;
+
+        bool await_ready() noexcept {
+            return handle.done();
+        }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+
+        T await_resume() {
+            return handle.promise().take();
+        }
+    };
+
+    task()
+        : m_handle() {}
+
+    explicit task(std::coroutine_handle<promise_type> handle)
+        : m_handle(handle) {}
+
+    task(task&& other)
+        : m_handle(other.m_handle) {
+        other.m_handle = std::coroutine_handle<promise_type>();
+    }
+
+    task& operator=(task&& other) {
+        if (this != &other) {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+            m_handle = other.m_handle;
+            other.m_handle = std::coroutine_handle<promise_type>();
+        }
+        return *this;
+    }
+
+    ~task() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    bool valid() const {
+        return (bool)m_handle;
+    }
+
+    /// True once the coroutine has returned
+    bool done() const {
+        return m_handle && m_handle.done();
+    }
+
+    awaiter operator co_await() && {
+        ASSERT_TRUE(valid());
+        return awaiter{m_handle};
+    }
+
+    awaiter operator co_await() & {
+        ASSERT_TRUE(valid());
+        return awaiter{m_handle};
+    }
+};
+
+namespace details {
+
+template <typename T>
+task<T> task_promise<T>::get_return_object() {
+    return task<T>(std::coroutine_handle<task_promise<T> >::from_promise(*this));
+}
+
+inline task<void> task_promise<void>::get_return_object() {
+    return task<void>(std::coroutine_handle<task_promise<void> >::from_promise(*this));
+}
+
+template <typename T>
+task<T> task_promise<T>::get_return_object_on_allocation_failure() {
+    return task<T>();
+}
+
+inline task<void> task_promise<void>::get_return_object_on_allocation_failure() {
+    return task<void>();
+}
+
+template <typename Pool>
+struct schedule_awaiter {
+    Pool* pool;
+
+    bool await_ready() noexcept {
+        return false;
+    }
+
+    //! Stays running on the caller if the pool cannot take the task
+    bool await_suspend(std::coroutine_handle<> h) {
+        return pool->launch([h]() { h.resume(); });
+    }
+
+    void await_resume() noexcept {}
+};
+
+}  // namespace details
+
+/**
+ * co_await schedule_on(pool) suspends the coroutine and resumes it as a
+ * task of "pool". From a worker of that pool it goes to the worker's own
+ * deque, which makes it a yield.
+ */
+template <typename Pool>
+details::schedule_awaiter<Pool> schedule_on(Pool& pool) {
+    details::schedule_awaiter<Pool> a = {&pool};
+    return a;
+}
+
+/**
+ * Starts "t" on the calling thread, sleeps until it returns and yields
+ * its result. The coroutine runs here until it first suspends, typically
+ * at a schedule_on().
+ */
+template <typename T>
+T sync_wait(task<T>&& t) {
+    ASSERT_TRUE(t.valid());
+    details::task_event event;
+    t.m_handle.promise().event = &event;
+    t.m_handle.resume();
+    event.wait();
+    return t.m_handle.promise().take();
+}
+
+}  // namespace akl
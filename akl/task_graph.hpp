@@ -0,0 +1,193 @@
+#pragma once
+
+#include "atomic.hpp"
+#include "function.hpp"
+#include "kern_lib.h"
+#include "thread_pool.hpp"
+#include "utility.hpp"
+#include "vector.hpp"
+
+namespace akl {
+
+namespace details {
+
+enum {
+    //! capture bytes a graph node stores without allocating
+    GRAPH_NODE_INLINE = 64,
+    //! successors a node keeps without allocating
+    GRAPH_NODE_SUCCESSORS = 4
+};
+
+struct graph_node {
+    function<void(), GRAPH_NODE_INLINE> fn;
+    //! predecessors not finished yet in the current run
+    atomic<size_t> pending;
+    size_t predecessors;
+    small_vector<graph_node*, GRAPH_NODE_SUCCESSORS> successors;
+
+    graph_node()
+        : predecessors(0) {}
+};
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * Directed acyclic graph of tasks run on a thread_pool. Every node counts
+ * its unfinished predecessors; the node that brings a successor's count
+ * to zero releases it, so a node starts as soon as its inputs are done
+ * rather than at the next round boundary.
+ *
+ * A finishing node continues with one of the successors it released on
+ * the same worker, whose cache still holds the data the two share, and
+ * launches the others onto that worker's deque, where idle workers steal
+ * them. Only the root nodes go through the pool's injection queue.
+ *
+ * The graph is built once with add() and precede() and may be run any
+ * number of times, one run at a time. A cycle is caught by an assert
+ * when the run ends with nodes that never became ready.
+ */
+class task_graph {
+private:
+    vector<details::graph_node*> m_nodes;
+    //! nodes without predecessors, gathered by run()
+    vector<details::graph_node*> m_roots;
+    thread_pool* m_pool;
+    task_batch m_batch;
+
+    // not copyable
+    task_graph(const task_graph&);
+    task_graph& operator=(const task_graph&);
+
+    //! Launches the branch starting at "n", or runs it here if no task could be queued
+    void release(details::graph_node* n) {
+        task_graph* g = this;
+        if (!m_pool->launch([g, n]() { g->run_from(n); }, m_batch)) {
+            run_from(n);
+        }
+    }
+
+    //! Runs "n", then keeps running a successor it released until none is
+    void run_from(details::graph_node* n) {
+        while (n) {
+            n->fn();
+            details::graph_node* next = NULL;
+            for (size_t i = 0; i < n->successors.size(); ++i) {
+                details::graph_node* s = n->successors[i];
+                if (s->pending.dec() != 0) {
+                    continue;
+                }
+                if (next) {
+                    release(next);
+                }
+                next = s;
+            }
+            n = next;
+        }
+    }
+
+public:
+    task_graph()
+        : m_pool(NULL) {}
+
+    ~task_graph() {
+        clear();
+    }
+
+    /**
+     * Adds a node running fn(), returns its index for precede(), or
+     * size_t(-1) if the node or its captures could not be allocated.
+     */
+    template <typename Fn>
+    size_t add(Fn&& fn) {
+        void* p = akl_cmalloc(sizeof(details::graph_node));
+        if (!p) {
+            return size_t(-1);
+        }
+        details::graph_node* n = new (p) details::graph_node();
+        n->fn = akl::forward<Fn>(fn);
+        if (!n->fn || !m_nodes.push_back(n)) {
+            n->~graph_node();
+            akl_cfree(n);
+            return size_t(-1);
+        }
+        return m_nodes.size() - 1;
+    }
+
+    /// Makes node "after" wait for node "before" to finish. Returns false if the edge could not be allocated
+    bool precede(size_t before, size_t after) {
+        ASSERT_TRUE(before < m_nodes.size() && after < m_nodes.size() && before != after);
+        if (!m_nodes[before]->successors.push_back(m_nodes[after])) {
+            return false;
+        }
+        ++m_nodes[after]->predecessors;
+        return true;
+    }
+
+    size_t size() const {
+        return m_nodes.size();
+    }
+
+    bool empty() const {
+        return m_nodes.empty();
+    }
+
+    /// Removes every node
+    void clear() {
+        ASSERT_TRUE(m_batch.done());
+        for (size_t i = 0; i < m_nodes.size(); ++i) {
+            m_nodes[i]->~graph_node();
+            akl_cfree(m_nodes[i]);
+        }
+        m_nodes.clear();
+        m_roots.clear();
+    }
+
+    /**
+     * Runs every node on "pool", each after all its predecessors, and
+     * returns once all have finished. From inside a task of the same pool
+     * the caller runs tasks while it waits. Nodes the pool cannot take
+     * run on the caller.
+     */
+    void run(thread_pool& pool) {
+        ASSERT_TRUE(m_batch.done());
+        if (m_nodes.empty()) {
+            return;
+        }
+        m_pool = &pool;
+        m_roots.clear();
+        for (size_t i = 0; i < m_nodes.size(); ++i) {
+            details::graph_node* n = m_nodes[i];
+            n->pending.store_release(n->predecessors);
+        }
+        size_t roots = 0;
+        for (size_t i = 0; i < m_nodes.size(); ++i) {
+            details::graph_node* n = m_nodes[i];
+            if (n->predecessors != 0) {
+                continue;
+            }
+            ++roots;
+            // roots that find no room in the list are launched one by one
+            if (!m_roots.push_back(n)) {
+                release(n);
+            }
+        }
+        ASSERT_TRUE(roots != 0);
+
+        task_graph* g = this;
+        if (!m_roots.empty() &&
+            !pool.launch_n(m_roots.size(), [g](size_t i) { g->run_from(g->m_roots[i]); }, &m_batch)) {
+            for (size_t i = 0; i < m_roots.size(); ++i) {
+                run_from(m_roots[i]);
+            }
+        }
+        pool.wait(m_batch);
+
+        for (size_t i = 0; i < m_nodes.size(); ++i) {
+            ASSERT_TRUE(m_nodes[i]->pending.load_acquire() == 0);
+        }
+    }
+};
+
+}  // namespace akl
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "atomic.hpp"
+#include "cpu_topology.hpp"
+#include "function.hpp"
+#include "kern_lib.h"
+#include "pthread.h"
+#include "utility.hpp"
+#include "vector.hpp"
+
+namespace akl {
+
+namespace details {
+
+//! One thread of a thread_group, freed by join()
+struct group_thread {
+    function<void()> fn;
+    akl_thread_t* thread;
+    atomic<size_t>* running;
+};
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * A collection of threads, each running one function until it returns.
+ * Threads may be pinned to a given cpu, or placed by a cpu_placement
+ * over the machine's cpu_topology, the n-th thread of the group taking
+ * the n-th cpu of the placement.
+ *
+ * Threads come from akl_thread_create: pthreads in userspace, kthreads
+ * in the kernel module, where a pinned thread is made with
+ * kthread_create_on_cpu.
+ *
+ * Launch and join from one controlling thread. The build has no
+ * exceptions, so threads report failures themselves; launch() returns
+ * false if the thread could not be started.
+ */
+class thread_group {
+private:
+#ifdef __KERNEL_MODULE__
+    //! there is no system() topology in the kernel, so each group reads one
+    cpu_topology m_topology;
+#endif
+    vector<details::group_thread*> m_threads;
+    atomic<size_t> m_running;
+
+    // not copyable
+    thread_group(const thread_group&);
+    thread_group& operator=(const thread_group&);
+
+    static void entry(void* arg) {
+        details::group_thread* t = static_cast<details::group_thread*>(arg);
+        t->fn();
+        t->fn.reset();
+        t->running->dec();
+    }
+
+    const cpu_topology& topology() const {
+#ifdef __KERNEL_MODULE__
+        return m_topology;
+#else
+        return cpu_topology::system();
+#endif
+    }
+
+    static void free_thread(details::group_thread* t) {
+        t->~group_thread();
+        akl_cfree(t);
+    }
+
+    template <typename Fn>
+    bool start(Fn&& fn, int cpu) {
+        // the entry first, so that every thread started is joined
+        if (!m_threads.push_back(NULL)) {
+            return false;
+        }
+        void* p = akl_cmalloc(sizeof(details::group_thread));
+        if (!p) {
+            m_threads.pop_back();
+            return false;
+        }
+        details::group_thread* t = new (p) details::group_thread();
+        t->fn = akl::forward<Fn>(fn);
+        t->running = &m_running;
+        m_running.inc();
+        // pinned before it runs, so its first touches land on its node
+        t->thread = akl_thread_create(&thread_group::entry, t, cpu);
+        if (!t->thread) {
+            m_running.dec();
+            free_thread(t);
+            m_threads.pop_back();
+            return false;
+        }
+        m_threads.back() = t;
+        return true;
+    }
+
+public:
+    thread_group() {}
+
+    //! Waits for all threads to complete execution
+    ~thread_group() {
+        join();
+    }
+
+    /**
+     * Launches a thread which calls fn(). No cpu affinity is set, so the
+     * scheduler decides where it runs.
+     */
+    template <typename Fn>
+    bool launch(Fn&& fn) {
+        return start(akl::forward<Fn>(fn), -1);
+    }
+
+    /// Launches a thread which calls fn(), pinned to "cpu_id" unless it is size_t(-1)
+    template <typename Fn>
+    bool launch(Fn&& fn, size_t cpu_id) {
+        return start(akl::forward<Fn>(fn), cpu_id == size_t(-1) ? -1 : (int)cpu_id);
+    }
+
+    /**
+     * Launches a thread which calls fn(), pinned to the cpu "placement"
+     * gives the n-th thread of the group. Threads of one group thus fill
+     * whole cores, scatter over them or stay within one L3 domain.
+     */
+    template <typename Fn>
+    bool launch(Fn&& fn, cpu_placement placement) {
+        return start(akl::forward<Fn>(fn), topology().cpu_for(placement, m_threads.size()));
+    }
+
+    /**
+     * Waits for all threads to complete execution. The next thread
+     * launched is the first of the group again.
+     */
+    void join() {
+        for (size_t i = 0; i < m_threads.size(); ++i) {
+            details::group_thread* t = m_threads[i];
+            akl_thread_join(t->thread);
+            free_thread(t);
+        }
+        m_threads.clear();
+    }
+
+    /// Number of threads that have not returned yet
+    size_t running_threads() const {
+        return m_running.load_acquire();
+    }
+};
+
+}  // namespace akl
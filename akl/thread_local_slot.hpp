@@ -0,0 +1,340 @@
+#pragma once
+
+#include "cache_line_pad.hpp"
+#include "kern_lib.h"
+#include "spinlock.hpp"
+#include "utility.hpp"
+#include "vector.hpp"
+
+namespace akl {
+
+namespace details {
+
+#ifndef __KERNEL_MODULE__
+
+enum {
+    //! entries of a thread's slot table when it first grows
+    TLS_INITIAL_SLOTS = 16
+};
+
+//! A thread's value of one slot, in the slot's list of values
+struct tls_value {
+    tls_value* prev;
+    tls_value* next;
+};
+
+//! What a thread's slot table holds per slot index
+struct tls_entry {
+    tls_value* value;
+    //! generation of the slot the value belongs to, 0 for none
+    size_t generation;
+};
+
+//! Index bookkeeping shared by every thread_local_slot
+struct tls_slot_record {
+    //! destroys one value of the slot and frees it
+    void (*destroy)(tls_value*);
+    //! bumped by every slot that takes or gives back the index
+    size_t generation;
+};
+
+/**
+ * Slot indices and the values of every slot, guarded by one lock. Only
+ * the slow paths take it: the first access of a thread, thread exit and
+ * slot creation and destruction.
+ */
+struct tls_registry {
+    spinlock lock;
+    vector<tls_slot_record> slots;
+    vector<size_t> free_indices;
+};
+
+inline tls_registry& current_tls_registry() {
+    static tls_registry registry;
+    return registry;
+}
+
+/**
+ * A thread's values by slot index. Trivial, so reaching it costs no
+ * initialization check; a tls_table_cleanup armed on first growth
+ * destroys the values when the thread exits.
+ */
+struct tls_table {
+    tls_entry* entries;
+    size_t capacity;
+
+    //! False if the table could not grow, it is left as it was
+    bool reserve(size_t n);
+
+    //! Destroys the thread's values, the thread is exiting
+    void release() {
+        if (!capacity) {
+            return;
+        }
+        tls_registry& registry = current_tls_registry();
+        registry.lock.lock();
+        for (size_t i = 0; i < capacity; ++i) {
+            tls_entry& e = entries[i];
+            // values of slots destroyed meanwhile went with their slot
+            if (e.generation && i < registry.slots.size() && registry.slots[i].generation == e.generation) {
+                e.value->prev->next = e.value->next;
+                e.value->next->prev = e.value->prev;
+                registry.slots[i].destroy(e.value);
+            }
+        }
+        registry.lock.unlock();
+        akl_cfree(entries);
+        entries = NULL;
+        capacity = 0;
+    }
+};
+
+inline tls_table& current_tls_table() {
+    static thread_local tls_table table;
+    return table;
+}
+
+struct tls_table_cleanup {
+    bool armed;
+
+    ~tls_table_cleanup() {
+        current_tls_table().release();
+    }
+};
+
+inline bool tls_table::reserve(size_t n) {
+    if (n <= capacity) {
+        return true;
+    }
+    size_t grown = capacity ? capacity : (size_t)TLS_INITIAL_SLOTS;
+    while (grown < n) {
+        grown *= 2;
+    }
+    tls_entry* bigger = static_cast<tls_entry*>(akl_cmalloc(grown * sizeof(tls_entry)));
+    if (!bigger) {
+        return false;
+    }
+    if (!capacity) {
+        static thread_local tls_table_cleanup cleanup;
+        cleanup.armed = true;
+    }
+    if (capacity) {
+        akl_cmemcpy(bigger, entries, capacity * sizeof(tls_entry));
+        akl_cfree(entries);
+    }
+    akl_memset(bigger + capacity, 0, (grown - capacity) * sizeof(tls_entry));
+    entries = bigger;
+    capacity = grown;
+    return true;
+}
+
+#endif
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * One value of T per thread, reached with one indexed load.
+ *
+ * In userspace each slot takes an index at construction, and every
+ * thread keeps its values in a flat table by index: local() loads the
+ * calling thread's table, checks the entry and returns the value, which
+ * is copied from the slot's initial value on the thread's first access.
+ * local() is NULL when that copy or the table cannot be allocated, or
+ * for a slot that is not valid().
+ * A thread's values are destroyed when it exits, or with the slot,
+ * whichever comes first; indices of destroyed slots are reused.
+ *
+ * In the kernel the values are per cpu instead: one cache line padded T
+ * per possible cpu, and local() is the current cpu's. The caller keeps
+ * preemption disabled with akl_get_cpu()/akl_put_cpu() while it uses the
+ * value. A slot whose values cannot be allocated is not valid().
+ *
+ * The slot must outlive every use of its values.
+ */
+template <typename T>
+class thread_local_slot {
+private:
+#ifdef __KERNEL_MODULE__
+    cache_line_pad<T>* m_values;
+    size_t m_count;
+    //! block the values were carved from
+    void* m_raw;
+#else
+    struct node {
+        details::tls_value link;
+        T value;
+
+        explicit node(const T& initial)
+            : value(initial) {}
+    };
+
+    size_t m_index;
+    size_t m_generation;
+    //! sentinel of the list of values
+    details::tls_value m_values;
+    T m_initial;
+
+    static void destroy(details::tls_value* v) {
+        node* n = reinterpret_cast<node*>(v);
+        n->~node();
+        akl_cfree(n);
+    }
+
+    //! The calling thread's first access: makes its value, NULL if it cannot
+    T* create() {
+        if (!valid()) {
+            return NULL;
+        }
+        details::tls_table& table = details::current_tls_table();
+        if (!table.reserve(m_index + 1)) {
+            return NULL;
+        }
+        static_assert(alignof(node) <= 16, "values are at most 16 byte aligned");
+        void* p = akl_cmalloc(sizeof(node));
+        if (!p) {
+            return NULL;
+        }
+        node* n = new (p) node(m_initial);
+
+        details::tls_registry& registry = details::current_tls_registry();
+        registry.lock.lock();
+        n->link.next = m_values.next;
+        n->link.prev = &m_values;
+        m_values.next->prev = &n->link;
+        m_values.next = &n->link;
+        registry.lock.unlock();
+
+        details::tls_entry& e = table.entries[m_index];
+        e.value = &n->link;
+        e.generation = m_generation;
+        return &n->value;
+    }
+#endif
+
+    // not copyable
+    thread_local_slot(const thread_local_slot&);
+    thread_local_slot& operator=(const thread_local_slot&);
+
+public:
+#ifdef __KERNEL_MODULE__
+    /// Creates the slot, every cpu's value starts as a copy of "initial"
+    explicit thread_local_slot(const T& initial = T()) {
+        m_count = (size_t)akl_nr_cpu_ids();
+        // akl_cmalloc aligns to 16 only, the values want whole lines
+        m_raw = akl_cmalloc(m_count * sizeof(cache_line_pad<T>) + AKL_CACHE_LINE_SIZE - 1);
+        if (!m_raw) {
+            m_values = NULL;
+            m_count = 0;
+            return;
+        }
+        size_t addr = ((size_t)m_raw + AKL_CACHE_LINE_SIZE - 1) & ~(size_t)(AKL_CACHE_LINE_SIZE - 1);
+        m_values = reinterpret_cast<cache_line_pad<T>*>(addr);
+        for (size_t i = 0; i < m_count; ++i) {
+            new (&m_values[i]) cache_line_pad<T>(initial);
+        }
+    }
+#else
+    /// Creates the slot, every thread's value starts as a copy of "initial"
+    explicit thread_local_slot(const T& initial = T())
+        : m_initial(initial) {
+        m_values.prev = &m_values;
+        m_values.next = &m_values;
+        details::tls_registry& registry = details::current_tls_registry();
+        registry.lock.lock();
+        if (registry.free_indices.size()) {
+            m_index = registry.free_indices.back();
+            registry.free_indices.pop_back();
+        } else {
+            details::tls_slot_record fresh = {NULL, 0};
+            if (!registry.slots.push_back(fresh)) {
+                // no index, every local() is NULL
+                m_index = size_t(-1);
+                registry.lock.unlock();
+                return;
+            }
+            m_index = registry.slots.size() - 1;
+        }
+        details::tls_slot_record& record = registry.slots[m_index];
+        record.destroy = &thread_local_slot::destroy;
+        m_generation = ++record.generation;
+        registry.lock.unlock();
+    }
+#endif
+
+    //! Destroys the values of every thread
+    ~thread_local_slot() {
+#ifdef __KERNEL_MODULE__
+        for (size_t i = 0; i < m_count; ++i) {
+            m_values[i].~cache_line_pad<T>();
+        }
+        akl_cfree(m_raw);
+#else
+        if (!valid()) {
+            return;
+        }
+        details::tls_registry& registry = details::current_tls_registry();
+        registry.lock.lock();
+        while (m_values.next != &m_values) {
+            details::tls_value* v = m_values.next;
+            m_values.next = v->next;
+            destroy(v);
+        }
+        // stale table entries no longer match the generation
+        ++registry.slots[m_index].generation;
+        // an index that finds no room in the free list is just never reused
+        registry.free_indices.push_back(m_index);
+        registry.lock.unlock();
+#endif
+    }
+
+    /// False if the slot could not be set up, local() is then always NULL
+    bool valid() const {
+#ifdef __KERNEL_MODULE__
+        return m_values != NULL;
+#else
+        return m_index != size_t(-1);
+#endif
+    }
+
+    /// The calling thread's value (the current cpu's in the kernel), NULL if it could not be allocated
+    T* local() {
+#ifdef __KERNEL_MODULE__
+        return m_values ? &m_values[akl_cpu_id()].value : NULL;
+#else
+        details::tls_table& table = details::current_tls_table();
+        if (m_index < table.capacity) {
+            details::tls_entry& e = table.entries[m_index];
+            if (e.generation == m_generation) {
+                return &reinterpret_cast<node*>(e.value)->value;
+            }
+        }
+        return create();
+#endif
+    }
+
+    /**
+     * Calls fn(value) for the value of every thread that has one (every
+     * cpu in the kernel), for instance to sum per-thread counters. The
+     * owners may keep updating their values meanwhile; values of exited
+     * threads are gone.
+     */
+    template <typename Fn>
+    void for_each(Fn fn) {
+#ifdef __KERNEL_MODULE__
+        for (size_t i = 0; i < m_count; ++i) {
+            fn(m_values[i].value);
+        }
+#else
+        details::tls_registry& registry = details::current_tls_registry();
+        registry.lock.lock();
+        for (details::tls_value* v = m_values.next; v != &m_values; v = v->next) {
+            fn(reinterpret_cast<node*>(v)->value);
+        }
+        registry.lock.unlock();
+#endif
+    }
+};
+
+}  // namespace akl
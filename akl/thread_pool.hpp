@@ -0,0 +1,950 @@
+#pragma once
+
+#include "atomic.hpp"
+#include "cache_line_pad.hpp"
+#include "cpu_topology.hpp"
+#include "eventcount.hpp"
+#include "function.hpp"
+#include "hash.hpp"
+#include "kern_lib.h"
+#include "lockfree_stack.hpp"
+#include "mpmc_queue.hpp"
+#include "mutex.hpp"
+#include "pthread.h"
+#include "spinlock.hpp"
+#include "sync.h"
+#include "utility.hpp"
+#include "vector.hpp"
+
+namespace akl {
+
+class thread_pool;
+class task_batch;
+
+namespace details {
+
+enum {
+    //! initial slots of a worker deque, it doubles when full
+    POOL_DEQUE_CAPACITY = 256,
+    //! external submissions in flight before launch() waits for room
+    POOL_INJECTION_CAPACITY = 4096,
+    //! rounds of looking for work before a worker parks
+    POOL_SPIN_ROUNDS = 16,
+    //! capture bytes a task stores without allocating
+    POOL_TASK_INLINE = 96,
+    //! finished task nodes a worker keeps for reuse
+    POOL_TASK_CACHE = 256
+};
+
+//! pool_worker::state
+enum { WORKER_RUNNING = 0, WORKER_RETIRING = 1, WORKER_EXITED = 2 };
+
+/**
+ * A queued task. Nodes are recycled rather than freed: a worker keeps up
+ * to POOL_TASK_CACHE finished nodes for its own launches and hands the
+ * rest to a pool wide lock free stack that outside submitters draw from.
+ * They are freed only with the pool, which also keeps the stack's stale
+ * link reads on live memory.
+ */
+struct pool_task : lockfree_stack_hook {
+    function<void(), POOL_TASK_INLINE> fn;
+    //! finished once fn() has run and been destroyed, or NULL
+    task_batch* batch;
+    //! link in a worker's private cache
+    pool_task* next_cached;
+};
+
+/**
+ * Chase-Lev work stealing deque of tasks (the C11 formulation by Le, Pop,
+ * Cohen and Zappa Nardelli). The owning worker pushes and takes at the
+ * bottom and needs a CAS only when it races the thieves for the last
+ * task; thieves take from the top with one CAS. The ring doubles when
+ * full, and push() fails if it cannot. Outgrown rings stay allocated until
+ * the deque dies, since a thief may still read from them.
+ */
+class ws_deque {
+    struct ring {
+        long mask;
+        ring* previous;
+        //! really mask + 1 slots, allocated with the ring
+        atomic<pool_task*> slots[1];
+    };
+
+    cache_line_pad<atomic<long> > m_top;
+    cache_line_pad<atomic<long> > m_bottom;
+    atomic<ring*> m_ring;
+
+    // not copyable
+    ws_deque(const ws_deque&);
+    ws_deque& operator=(const ws_deque&);
+
+    //! NULL if the ring could not be allocated
+    static ring* make_ring(long size, ring* previous) {
+        ring* r = static_cast<ring*>(akl_cmalloc(sizeof(ring) + (size - 1) * sizeof(atomic<pool_task*>)));
+        if (!r) {
+            return NULL;
+        }
+        r->mask = size - 1;
+        r->previous = previous;
+        for (long i = 0; i < size; ++i) {
+            new (&r->slots[i]) atomic<pool_task*>();
+        }
+        return r;
+    }
+
+    ring* grow(ring* r, long top, long bottom) {
+        ring* bigger = make_ring((r->mask + 1) * 2, r);
+        if (!bigger) {
+            return NULL;
+        }
+        for (long i = top; i < bottom; ++i) {
+            bigger->slots[i & bigger->mask].store_release(r->slots[i & r->mask].load_acquire());
+        }
+        m_ring.store_release(bigger);
+        return bigger;
+    }
+
+public:
+    ws_deque() {}
+
+    //! Allocates the first ring, the deque is unusable if this fails
+    bool init() {
+        ring* r = make_ring(POOL_DEQUE_CAPACITY, NULL);
+        m_ring.store_release(r);
+        return r != NULL;
+    }
+
+    ~ws_deque() {
+        ring* r = m_ring.load_acquire();
+        while (r) {
+            ring* previous = r->previous;
+            akl_cfree(r);
+            r = previous;
+        }
+    }
+
+    //! Owner only. False if the ring was full and could not grow
+    bool push(pool_task* t) {
+        long bottom = m_bottom.value.load_acquire();
+        long top = m_top.value.load_acquire();
+        ring* r = m_ring.load_acquire();
+        if (bottom - top > r->mask) {
+            r = grow(r, top, bottom);
+            if (!r) {
+                return false;
+            }
+        }
+        r->slots[bottom & r->mask].store_release(t);
+        m_bottom.value.store_release(bottom + 1);
+        return true;
+    }
+
+    //! Owner only, takes the newest task. NULL if empty
+    pool_task* take() {
+        long bottom = m_bottom.value.load_acquire() - 1;
+        ring* r = m_ring.load_acquire();
+        m_bottom.value.store_release(bottom);
+        // the bottom store must be visible before the top is read
+        atomic_thread_fence();
+        long top = m_top.value.load_acquire();
+        if (top > bottom) {
+            m_bottom.value.store_release(bottom + 1);
+            return NULL;
+        }
+        pool_task* t = r->slots[bottom & r->mask].load_acquire();
+        if (top == bottom) {
+            // last task, race the thieves for it
+            if (!m_top.value.compare_and_swap(top, top + 1)) {
+                t = NULL;
+            }
+            m_bottom.value.store_release(bottom + 1);
+        }
+        return t;
+    }
+
+    //! Tasks queued, exact for the owner
+    size_t size_approx() const {
+        long n = m_bottom.value.load_acquire() - m_top.value.load_acquire();
+        return n > 0 ? (size_t)n : 0;
+    }
+
+    //! Any thread, takes the oldest task. NULL if empty or the race was lost
+    pool_task* steal() {
+        long top = m_top.value.load_acquire();
+        atomic_thread_fence();
+        long bottom = m_bottom.value.load_acquire();
+        if (top >= bottom) {
+            return NULL;
+        }
+        ring* r = m_ring.load_acquire();
+        pool_task* t = r->slots[top & r->mask].load_acquire();
+        if (!m_top.value.compare_and_swap(top, top + 1)) {
+            return NULL;
+        }
+        return t;
+    }
+};
+
+struct pool_worker {
+    ws_deque deque;
+    thread_pool* pool;
+    size_t index;
+    //! xorshift state for picking victims
+    akl_u64 rng;
+    akl_thread_t* thread;
+    //! WORKER_RUNNING, or retiring and exited after a shrinking resize()
+    atomic<int> state;
+    //! finished task nodes, only this worker touches them
+    pool_task* cached_tasks;
+    size_t cached_count;
+    //! block the worker was carved from
+    void* raw;
+};
+
+//! Shared state of one launch_n(), its runners claim chunks of indices
+template <typename Fn>
+struct bulk_job {
+    Fn fn;
+    size_t count;
+    size_t grain;
+    task_batch* batch;
+    atomic<size_t> next;
+    //! runners still working, the last one frees the job
+    atomic<size_t> runners;
+
+    template <typename F>
+    bulk_job(F&& f, size_t count, size_t grain, size_t runners, task_batch* batch)
+        : fn(akl::forward<F>(f)), count(count), grain(grain), batch(batch), runners(runners) {}
+};
+
+//! Adapts an element function to the index function launch_n() takes
+template <typename Iterator, typename Fn>
+struct bulk_range {
+    Iterator begin;
+    Fn fn;
+
+    void operator()(size_t i) {
+        fn(*(begin + i));
+    }
+};
+
+#ifdef __KERNEL_MODULE__
+//! Kthreads keep it in their akl_thread_slot(), other threads have none
+inline pool_worker** pool_worker_slot() {
+    return reinterpret_cast<pool_worker**>(akl_thread_slot());
+}
+#else
+inline pool_worker** pool_worker_slot() {
+    static thread_local pool_worker* worker = NULL;
+    return &worker;
+}
+#endif
+
+inline pool_worker* current_pool_worker() {
+    pool_worker** slot = pool_worker_slot();
+    return slot ? *slot : NULL;
+}
+
+//! False if the calling thread has no slot to keep "w" in
+inline bool set_current_pool_worker(pool_worker* w) {
+    pool_worker** slot = pool_worker_slot();
+    if (!slot) {
+        return false;
+    }
+    *slot = w;
+    return true;
+}
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * Completion counter for a group of thread_pool tasks. Launch tasks with
+ * the batch and thread_pool::wait() on it to wait for exactly those
+ * tasks, whatever else the pool runs. A batch may gather several
+ * launches and be reused once done; it must outlive its tasks.
+ */
+class task_batch {
+    atomic<size_t> m_remaining;
+
+    // not copyable
+    task_batch(const task_batch&);
+    task_batch& operator=(const task_batch&);
+
+    friend class thread_pool;
+
+public:
+    task_batch() {}
+
+    /// True once every task launched with the batch so far has finished
+    bool done() const {
+        return m_remaining.load_acquire() == 0;
+    }
+};
+
+/**
+ * \ingroup util
+ *
+ * Work stealing thread pool.
+ *
+ * Every worker owns a Chase-Lev deque. Tasks launched from inside a task
+ * go to the bottom of the current worker's deque and run newest first,
+ * which keeps their data in cache; idle workers steal the oldest task of
+ * a random victim. Threads outside the pool submit through a lock free
+ * injection queue (an mpmc_queue) that workers poll between their own
+ * tasks. No launch takes a lock.
+ *
+ * Idle workers look for work a few rounds, then park on an eventcount;
+ * launch() wakes one parked worker, and costs a fence and a load when
+ * none is parked.
+ *
+ * launch_n() and launch_bulk() queue thousands of calls as a handful of
+ * runner tasks. join() waits for everything; a task_batch waits for just
+ * the tasks launched with it.
+ *
+ * resize() starts only the missing workers and lets surplus ones retire
+ * after their current task, handing their backlog to the others, so the
+ * pool keeps running tasks while it grows or shrinks.
+ *
+ * Workers come from akl_thread_create: pthreads in userspace, kthreads
+ * in the kernel module, with the same API in both builds.
+ *
+ * The build has no exceptions, so tasks report failures themselves.
+ * launch() and launch_n() return false, leaving the callable to the
+ * caller, when no worker runs or the task could not be allocated.
+ */
+class thread_pool {
+private:
+#ifdef __KERNEL_MODULE__
+    //! there is no system() topology in the kernel, so each pool reads one
+    cpu_topology m_topology;
+#endif
+    //! max_size() slots; a worker stays in its slot until the pool dies,
+    //! so thieves that read a stale size() still find a valid deque
+    details::pool_worker** m_workers;
+    size_t m_capacity;
+    //! slots holding a worker, retired or not
+    size_t m_slots;
+    atomic<size_t> m_size;
+    cpu_placement m_placement;
+    //! serializes resize() and set_cpu_placement()
+    mutex m_resize_lock;
+    mpmc_queue<details::pool_task*> m_injection;
+    eventcount m_idle;
+    eventcount m_drained;
+    //! waiters of any task_batch, the batches themselves may die right
+    //! after their last task, so nothing is signalled through them
+    eventcount m_batch_done;
+    cache_line_pad<atomic<size_t> > m_pending;
+    atomic<int> m_stopping;
+    intrusive_lockfree_stack<details::pool_task> m_spare_tasks;
+
+    // not copyable
+    thread_pool(const thread_pool&);
+    thread_pool& operator=(const thread_pool&);
+
+    static void worker_entry(void* arg) {
+        details::pool_worker* w = static_cast<details::pool_worker*>(arg);
+        w->pool->worker_main(w);
+    }
+
+    const cpu_topology& topology() const {
+#ifdef __KERNEL_MODULE__
+        return m_topology;
+#else
+        return cpu_topology::system();
+#endif
+    }
+
+    //! NULL if the worker or its deque could not be allocated
+    details::pool_worker* make_worker(size_t index) {
+        // akl_cmalloc aligns to 16 only, the deque wants whole cache lines
+        void* raw = akl_cmalloc(sizeof(details::pool_worker) + AKL_CACHE_LINE_SIZE - 1);
+        if (!raw) {
+            return NULL;
+        }
+        size_t addr = ((size_t)raw + AKL_CACHE_LINE_SIZE - 1) & ~(size_t)(AKL_CACHE_LINE_SIZE - 1);
+        details::pool_worker* w = new ((void*)addr) details::pool_worker();
+        w->pool = this;
+        w->index = index;
+        w->rng = details::hash_mix(index + 1) | 1;
+        w->thread = NULL;
+        w->cached_tasks = NULL;
+        w->cached_count = 0;
+        w->raw = raw;
+        if (!w->deque.init()) {
+            free_worker(w);
+            return NULL;
+        }
+        return w;
+    }
+
+    static void free_worker(details::pool_worker* w) {
+        while (details::pool_task* t = w->cached_tasks) {
+            w->cached_tasks = t->next_cached;
+            free_task(t);
+        }
+        void* raw = w->raw;
+        w->~pool_worker();
+        akl_cfree(raw);
+    }
+
+    //! Pins the worker to its cpu under the placement, or lets it run on all of them
+    void pin_worker(details::pool_worker* w) {
+        akl_thread_set_cpu(w->thread, topology().cpu_for(m_placement, w->index));
+    }
+
+    /**
+     * Starts the worker's thread, already pinned under the placement. If
+     * the thread cannot be created the worker stays exited, without one.
+     */
+    bool start_worker(details::pool_worker* w) {
+        w->state.store_release(details::WORKER_RUNNING);
+        w->thread = akl_thread_create(&thread_pool::worker_entry, w, topology().cpu_for(m_placement, w->index));
+        if (!w->thread) {
+            w->state.store_release(details::WORKER_EXITED);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Puts a worker that resize() retired back to work: cancels the
+     * retirement if the thread has not left yet, else starts a new thread
+     * on the slot. False if that thread could not be created.
+     */
+    bool revive_worker(details::pool_worker* w) {
+        if (w->state.compare_and_swap(details::WORKER_RETIRING, details::WORKER_RUNNING)) {
+            // set_cpu_placement() skipped it while it was retiring
+            pin_worker(w);
+            return true;
+        }
+        if (w->thread) {
+            akl_thread_join(w->thread);
+            w->thread = NULL;
+        }
+        return start_worker(w);
+    }
+
+    /**
+     * Moves the retiring worker's backlog to the injection queue, then
+     * marks it exited. Returns false if resize() revived it meanwhile.
+     */
+    bool retire(details::pool_worker* w) {
+        int handed = 0;
+        while (details::pool_task* t = w->deque.take()) {
+            submit(NULL, &t, 1);
+            ++handed;
+        }
+        if (handed) {
+            m_idle.notify(handed);
+        }
+        // nobody else pushes to the deque, it is empty from here on
+        return w->state.compare_and_swap(details::WORKER_RETIRING, details::WORKER_EXITED);
+    }
+
+    static akl_u64 next_random(akl_u64& state) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    //! Own deque first, then the injection queue, then the other workers
+    details::pool_task* find_task(details::pool_worker* w) {
+        details::pool_task* t = w->deque.take();
+        if (t || m_injection.try_pop(t)) {
+            return t;
+        }
+        size_t size = m_size.load_acquire();
+        if (size == 0) {
+            // started by a resize() of a pool that had no worker yet
+            return NULL;
+        }
+        size_t start = next_random(w->rng) % size;
+        for (size_t i = 0; i < size; ++i) {
+            size_t victim = start + i < size ? start + i : start + i - size;
+            if (victim == w->index) {
+                continue;
+            }
+            t = m_workers[victim]->deque.steal();
+            if (t) {
+                return t;
+            }
+        }
+        return NULL;
+    }
+
+    /**
+     * A node for a new task: the worker's cache, then the spares, then the
+     * heap. NULL if the heap is out of memory, or if the caller is outside
+     * the pool and no worker runs to take the task.
+     */
+    details::pool_task* acquire_task(details::pool_worker* self) {
+        details::pool_task* t;
+        if (self && self->cached_tasks) {
+            t = self->cached_tasks;
+            self->cached_tasks = t->next_cached;
+            --self->cached_count;
+            return t;
+        }
+        if (!self && m_size.load_acquire() == 0) {
+            return NULL;
+        }
+        t = m_spare_tasks.pop();
+        if (t) {
+            return t;
+        }
+        void* p = akl_cmalloc(sizeof(details::pool_task));
+        if (!p) {
+            return NULL;
+        }
+        return new (p) details::pool_task();
+    }
+
+    //! Returns a node acquire_task() handed out but that was never queued
+    void give_back(details::pool_worker* self, details::pool_task* t) {
+        t->fn.reset();
+        if (self) {
+            recycle_task(self, t);
+        } else {
+            m_spare_tasks.push(t);
+        }
+    }
+
+    void recycle_task(details::pool_worker* w, details::pool_task* t) {
+        if (w->cached_count < details::POOL_TASK_CACHE) {
+            t->next_cached = w->cached_tasks;
+            w->cached_tasks = t;
+            ++w->cached_count;
+        } else {
+            m_spare_tasks.push(t);
+        }
+    }
+
+    void run(details::pool_worker* w, details::pool_task* t) {
+        task_batch* batch = t->batch;
+        t->fn();
+        t->fn.reset();
+        recycle_task(w, t);
+        finish(batch, 1);
+        if (m_pending.value.dec() == 0) {
+            m_drained.notify_all();
+        }
+    }
+
+    /**
+     * Queues "n" tasks: on the own deque, or with one CAS per injected
+     * run. Tasks a full deque cannot grow for go to the injection queue.
+     */
+    void submit(details::pool_worker* self, details::pool_task* const* tasks, size_t n) {
+        if (self) {
+            while (n && self->deque.push(*tasks)) {
+                ++tasks;
+                --n;
+            }
+        }
+        unsigned spins = 0;
+        size_t pushed = 0;
+        while (pushed < n) {
+            size_t count = m_injection.try_push_batch(tasks + pushed, n - pushed);
+            if (count == 0) {
+                details::spin_wait(spins);
+            }
+            pushed += count;
+        }
+    }
+
+    details::pool_worker* own_worker() const {
+        details::pool_worker* self = details::current_pool_worker();
+        return self && self->pool == this ? self : NULL;
+    }
+
+    void finish(task_batch* batch, size_t count) {
+        if (batch && batch->m_remaining.dec(count) == 0) {
+            m_batch_done.notify_all();
+        }
+    }
+
+    template <typename Fn>
+    bool launch_task(Fn&& fn, task_batch* batch) {
+        details::pool_worker* self = own_worker();
+        details::pool_task* t = acquire_task(self);
+        if (!t) {
+            return false;
+        }
+        t->fn = akl::forward<Fn>(fn);
+        if (!t->fn) {
+            // the captures needed a block the heap could not give
+            give_back(self, t);
+            return false;
+        }
+        t->batch = batch;
+        if (batch) {
+            batch->m_remaining.inc();
+        }
+        m_pending.value.inc();
+        submit(self, &t, 1);
+        m_idle.notify_one();
+        return true;
+    }
+
+    template <typename Fn>
+    void run_bulk(details::bulk_job<Fn>* job) {
+        while (true) {
+            size_t start = job->next.inc_ret_last(job->grain);
+            if (start >= job->count) {
+                break;
+            }
+            size_t end = akl::min(start + job->grain, job->count);
+            for (size_t i = start; i < end; ++i) {
+                job->fn(i);
+            }
+            finish(job->batch, end - start);
+        }
+        if (job->runners.dec() == 0) {
+            job->~bulk_job();
+            akl_cfree(job);
+        }
+    }
+
+    static void free_task(details::pool_task* t) {
+        t->~pool_task();
+        akl_cfree(t);
+    }
+
+    void worker_main(details::pool_worker* w) {
+        // a worker that cannot tell it is one would push to no deque;
+        // akl_thread_create does not start a thread without a slot anyway
+        if (!details::set_current_pool_worker(w)) {
+            w->state.store_release(details::WORKER_EXITED);
+            return;
+        }
+        while (true) {
+            if (w->state.load_acquire() == details::WORKER_RETIRING && retire(w)) {
+                break;
+            }
+            details::pool_task* t = find_task(w);
+            for (int round = 0; !t && round < details::POOL_SPIN_ROUNDS; ++round) {
+                cpu_relax();
+                t = find_task(w);
+            }
+            if (!t) {
+                int key = m_idle.prepare_wait();
+                if (m_stopping.load_acquire()) {
+                    m_idle.cancel_wait(key);
+                    break;
+                }
+                if (w->state.load_acquire() == details::WORKER_RETIRING) {
+                    m_idle.cancel_wait(key);
+                    continue;
+                }
+                t = find_task(w);
+                if (!t) {
+                    m_idle.commit_wait(key);
+                    continue;
+                }
+                m_idle.cancel_wait(key);
+            }
+            run(w, t);
+        }
+        details::set_current_pool_worker(NULL);
+    }
+
+public:
+    /**
+     * Starts "nthreads" workers. With "affinity" set, the workers are
+     * pinned with CPU_PLACEMENT_SCATTER_CORES. resize() may grow the pool
+     * up to "max_threads" workers, by default the larger of "nthreads"
+     * and the number of online cpus.
+     */
+    explicit thread_pool(size_t nthreads = 2, bool affinity = false, size_t max_threads = 0)
+        : thread_pool(nthreads, affinity ? CPU_PLACEMENT_SCATTER_CORES : CPU_PLACEMENT_NONE, max_threads) {}
+
+    /**
+     * Starts "nthreads" workers, worker i pinned to the i-th cpu of
+     * "placement". size() tells how many could be started; a pool left
+     * without memory for its queues has max_size() 0.
+     */
+    thread_pool(size_t nthreads, cpu_placement placement, size_t max_threads = 0)
+        : m_workers(NULL),
+          m_capacity(0),
+          m_slots(0),
+          m_placement(placement),
+          m_injection(details::POOL_INJECTION_CAPACITY) {
+        ASSERT_TRUE(nthreads > 0);
+        size_t capacity = max_threads ? max_threads : akl::max(nthreads, topology().size());
+        ASSERT_TRUE(nthreads <= capacity);
+        // outside threads reach the workers only through the injection queue
+        if (m_injection.capacity() == 0) {
+            return;
+        }
+        m_workers = static_cast<details::pool_worker**>(akl_cmalloc(capacity * sizeof(details::pool_worker*)));
+        if (!m_workers) {
+            return;
+        }
+        m_capacity = capacity;
+        // every deque exists before any worker may try to steal from it
+        while (m_slots < nthreads) {
+            details::pool_worker* w = make_worker(m_slots);
+            if (!w) {
+                break;
+            }
+            m_workers[m_slots++] = w;
+        }
+        // workers that fail to start keep their slots until resize()
+        size_t started = 0;
+        while (started < m_slots && start_worker(m_workers[started])) {
+            ++started;
+        }
+        m_size.store_release(started);
+    }
+
+    //! Runs the remaining tasks, then stops the workers
+    ~thread_pool() {
+        join();
+        m_stopping.store_release(1);
+        m_idle.notify_all();
+        // every slot has one thread not joined yet, retired or not, unless
+        // it could not be started
+        for (size_t i = 0; i < m_slots; ++i) {
+            if (m_workers[i]->thread) {
+                akl_thread_join(m_workers[i]->thread);
+            }
+        }
+        while (details::pool_task* t = m_spare_tasks.pop()) {
+            free_task(t);
+        }
+        for (size_t i = 0; i < m_slots; ++i) {
+            free_worker(m_workers[i]);
+        }
+        akl_cfree(m_workers);
+    }
+
+    /// Number of workers, not counting retiring ones
+    size_t size() const {
+        return m_size.load_acquire();
+    }
+
+    /// Most workers resize() accepts; worker indices stay below it
+    size_t max_size() const {
+        return m_capacity;
+    }
+
+    /**
+     * Grows or shrinks the pool to "nthreads" workers without stopping
+     * the others. Growing starts only the missing workers, or keeps
+     * workers that are still retiring. Shrinking retires the workers with
+     * the highest indices: each finishes its current task, moves its
+     * queued tasks to the injection queue and exits, while resize()
+     * returns right away. May be called from a task. Returns false if
+     * not every missing worker could be started; the pool keeps those
+     * that were.
+     */
+    bool resize(size_t nthreads) {
+        ASSERT_TRUE(nthreads > 0);
+        if (nthreads > m_capacity) {
+            return false;
+        }
+        m_resize_lock.lock();
+        bool grown = true;
+        size_t old = m_size.load_acquire();
+        if (nthreads < old) {
+            // stop handing work to the surplus workers before retiring them
+            m_size.store_release(nthreads);
+            for (size_t i = nthreads; i < old; ++i) {
+                m_workers[i]->state.store_release(details::WORKER_RETIRING);
+            }
+            m_idle.notify_all();
+        } else if (nthreads > old) {
+            size_t i = old;
+            for (; i < nthreads; ++i) {
+                if (i < m_slots) {
+                    if (!revive_worker(m_workers[i])) {
+                        break;
+                    }
+                    continue;
+                }
+                details::pool_worker* w = make_worker(i);
+                if (!w) {
+                    break;
+                }
+                m_workers[m_slots++] = w;
+                if (!start_worker(w)) {
+                    break;
+                }
+            }
+            m_size.store_release(i);
+            grown = i == nthreads;
+        }
+        m_resize_lock.unlock();
+        return grown;
+    }
+
+    bool get_cpu_affinity() const {
+        return m_placement != CPU_PLACEMENT_NONE;
+    }
+
+    cpu_placement get_cpu_placement() const {
+        return m_placement;
+    }
+
+    /// set_cpu_placement() with CPU_PLACEMENT_SCATTER_CORES or CPU_PLACEMENT_NONE
+    void set_cpu_affinity(bool affinity) {
+        set_cpu_placement(affinity ? CPU_PLACEMENT_SCATTER_CORES : CPU_PLACEMENT_NONE);
+    }
+
+    /**
+     * Pins worker i to the i-th cpu of "placement", or lets every worker
+     * run anywhere again with CPU_PLACEMENT_NONE. Workers are re-pinned
+     * in place and keep running their tasks.
+     */
+    void set_cpu_placement(cpu_placement placement) {
+        m_resize_lock.lock();
+        if (placement != m_placement) {
+            m_placement = placement;
+            size_t size = m_size.load_acquire();
+            for (size_t i = 0; i < size; ++i) {
+                pin_worker(m_workers[i]);
+            }
+        }
+        m_resize_lock.unlock();
+    }
+
+    /// Index of the calling worker in its pool, or -1 outside any pool
+    static int worker_index() {
+        details::pool_worker* w = details::current_pool_worker();
+        return w ? (int)w->index : -1;
+    }
+
+    /// True when called from a task running on this pool
+    bool is_worker() const {
+        return own_worker() != NULL;
+    }
+
+    /**
+     * Tasks waiting on the calling worker's deque, 0 outside this pool.
+     * Recursive algorithms split their work only while it is empty, that
+     * is while other workers may run out of things to steal.
+     */
+    size_t local_backlog() const {
+        details::pool_worker* self = own_worker();
+        return self ? self->deque.size_approx() : 0;
+    }
+
+    /**
+     * Runs fn() on some worker. From inside a task of this pool the task
+     * goes to the current worker's deque; from anywhere else it goes
+     * through the injection queue, waiting for room if it is full.
+     * Captures of up to POOL_TASK_INLINE bytes do not allocate once the
+     * pool has warmed up. Returns false, with fn untouched, if no worker
+     * runs or the task could not be allocated.
+     */
+    template <typename Fn>
+    bool launch(Fn&& fn) {
+        return launch_task(akl::forward<Fn>(fn), NULL);
+    }
+
+    /// Like launch(fn), counting the task in "batch"
+    template <typename Fn>
+    bool launch(Fn&& fn, task_batch& batch) {
+        return launch_task(akl::forward<Fn>(fn), &batch);
+    }
+
+    /**
+     * Runs fn(i) for every i in [0, n). The calls are shared by at most
+     * size() runner tasks, queued together with one synchronization, and
+     * only that many parked workers are woken. Runners claim chunks of
+     * about n / (8 * runners) indices from a shared counter, so uneven
+     * calls still balance. With a batch, each call counts as one task.
+     * Fewer runners are queued if not all of them could be allocated;
+     * returns false, with fn untouched, if none could.
+     */
+    template <typename Fn>
+    bool launch_n(size_t n, Fn&& fn, task_batch* batch = NULL) {
+        if (n == 0) {
+            return true;
+        }
+        typedef details::bulk_job<typename remove_cvref<Fn>::type> job_type;
+        static_assert(alignof(job_type) <= 16, "jobs are at most 16 byte aligned");
+        details::pool_worker* self = own_worker();
+        size_t runners = akl::min(n, size());
+        small_vector<details::pool_task*, 32> tasks;
+        // past the inline buffer, as many runners as the heap makes room for
+        if (!tasks.reserve(runners)) {
+            runners = tasks.capacity();
+        }
+        for (size_t i = 0; i < runners; ++i) {
+            details::pool_task* t = acquire_task(self);
+            if (!t) {
+                break;
+            }
+            tasks.push_back(t);
+        }
+        runners = tasks.size();
+        void* p = runners ? akl_cmalloc(sizeof(job_type)) : NULL;
+        if (!p) {
+            for (size_t i = 0; i < runners; ++i) {
+                give_back(self, tasks[i]);
+            }
+            return false;
+        }
+        size_t grain = akl::max((size_t)1, n / (runners * 8));
+        job_type* job = new (p) job_type(akl::forward<Fn>(fn), n, grain, runners, batch);
+        if (batch) {
+            batch->m_remaining.inc(n);
+        }
+
+        for (size_t i = 0; i < runners; ++i) {
+            // fits the node inline, so the assignment cannot fail
+            tasks[i]->fn = [this, job]() { run_bulk(job); };
+            tasks[i]->batch = NULL;
+        }
+        m_pending.value.inc(runners);
+        submit(self, tasks.data(), runners);
+        m_idle.notify((int)runners);
+        return true;
+    }
+
+    /// launch_n() over the elements of [begin, end), calling fn(element)
+    template <typename Iterator, typename Fn>
+    bool launch_bulk(Iterator begin, Iterator end, Fn&& fn, task_batch* batch = NULL) {
+        details::bulk_range<Iterator, typename remove_cvref<Fn>::type> range = {begin, akl::forward<Fn>(fn)};
+        return launch_n((size_t)(end - begin), akl::move(range), batch);
+    }
+
+    /**
+     * Waits until every task of "batch" has finished. From inside a task
+     * of this pool the caller runs other tasks meanwhile instead of
+     * blocking, so tasks may wait on batches they launched.
+     */
+    void wait(task_batch& batch) {
+        details::pool_worker* self = own_worker();
+        if (self) {
+            unsigned spins = 0;
+            while (!batch.done()) {
+                details::pool_task* t = find_task(self);
+                if (t) {
+                    run(self, t);
+                } else {
+                    details::spin_wait(spins);
+                }
+            }
+            return;
+        }
+        m_batch_done.wait([&batch]() { return batch.done(); });
+    }
+
+    /**
+     * Waits until every launched task, including tasks launched meanwhile,
+     * has finished. Must not be called from a task of this pool.
+     */
+    void join() {
+        details::pool_worker* self = details::current_pool_worker();
+        ASSERT_TRUE(!self || self->pool != this);
+        m_drained.wait([this]() { return m_pending.value.load_acquire() == 0; });
+    }
+};
+
+}  // namespace akl
@@ -0,0 +1,180 @@
+#pragma once
+
+/* userspace only: records are found through a thread_local cache */
+
+#include "atomic.hpp"
+#include "kern_lib.h"
+#include "utility.hpp"
+
+namespace akl {
+
+namespace details {
+
+enum { RECORD_FREE = 0, RECORD_OWNED = 1, RECORD_ORPHANED = 2 };
+
+//! domains a thread keeps its record cached for
+enum { RECORD_THREAD_CACHE = 8 };
+
+//! Header of a per-thread record, see thread_record_list
+struct thread_record {
+    //! next record of the list, records are never unlinked
+    thread_record* next_record;
+    //! RECORD_FREE, RECORD_OWNED, or RECORD_ORPHANED once the list is gone
+    atomic<int> owned;
+
+    thread_record()
+        : next_record(NULL) {}
+};
+
+//! Gives up a record; frees it if its list was destroyed meanwhile
+inline void release_record(thread_record* r) {
+    if (r->owned.exchange(RECORD_FREE) == RECORD_ORPHANED) {
+        akl_cfree(r);
+    }
+}
+
+//! Records this thread owns, handed back when the thread exits
+struct record_thread_cache {
+    struct entry {
+        akl_u64 list;
+        thread_record* record;
+    };
+
+    entry entries[RECORD_THREAD_CACHE] = {};
+
+    ~record_thread_cache() {
+        for (size_t i = 0; i < RECORD_THREAD_CACHE; ++i) {
+            if (entries[i].record) {
+                release_record(entries[i].record);
+            }
+        }
+    }
+};
+
+inline record_thread_cache& record_cache() {
+    static thread_local record_thread_cache cache;
+    return cache;
+}
+
+//! Source of list ids, so a new list at a reused address is not
+//! mistaken for the old one in the thread caches
+inline akl_u64 next_record_list_id() {
+    static atomic<akl_u64> next_id;
+    return next_id.inc();
+}
+
+/**
+ * Per-thread records of a reclamation domain. Each thread that uses the
+ * domain owns one Record (derived from thread_record), found through a
+ * small thread_local cache. Records are never unlinked, so other threads
+ * may walk the list at any time. A thread that exits gives its record
+ * up for the next thread to adopt, together with whatever it still
+ * holds. When the list dies first, records still cached by live threads
+ * are destroyed but their memory is left to those threads to free.
+ */
+template <typename Record>
+class thread_record_list {
+private:
+    atomic<thread_record*> m_head;
+    akl_u64 m_id;
+
+    // not copyable
+    thread_record_list(const thread_record_list&);
+    thread_record_list& operator=(const thread_record_list&);
+
+    //! Adopts a record no thread owns, or adds a new one. NULL if none could be allocated
+    Record* claim() {
+        for (Record* r = first(); r; r = next(r)) {
+            if (!r->owned.load_acquire() && r->owned.compare_and_swap(RECORD_FREE, RECORD_OWNED)) {
+                return r;
+            }
+        }
+        void* block = akl_cmalloc(sizeof(Record));
+        if (!block) {
+            return NULL;
+        }
+        Record* r = new (block) Record();
+        r->owned.store_release(RECORD_OWNED);
+        while (true) {
+            thread_record* head = m_head.load_acquire();
+            r->next_record = head;
+            if (m_head.compare_and_swap(head, r)) {
+                return r;
+            }
+        }
+    }
+
+public:
+    thread_record_list()
+        : m_id(next_record_list_id()) {}
+
+    ~thread_record_list() {
+        thread_record* r = m_head.load_acquire();
+        while (r) {
+            thread_record* next = r->next_record;
+            static_cast<Record*>(r)->~Record();
+            if (!r->owned.compare_and_swap(RECORD_OWNED, RECORD_ORPHANED)) {
+                akl_cfree(r);
+            }
+            r = next;
+        }
+    }
+
+    Record* first() const {
+        return static_cast<Record*>(m_head.load_acquire());
+    }
+
+    static Record* next(Record* r) {
+        return static_cast<Record*>(r->next_record);
+    }
+
+    /**
+     * The calling thread's record. "cached" is false when the thread cache
+     * is full; the record must then be handed to release() after use.
+     * NULL if the thread had none and none could be allocated.
+     */
+    Record* acquire(bool& cached) {
+        record_thread_cache& cache = record_cache();
+        record_thread_cache::entry* free_entry = NULL;
+        for (size_t i = 0; i < RECORD_THREAD_CACHE; ++i) {
+            record_thread_cache::entry& e = cache.entries[i];
+            if (e.record && e.list == m_id) {
+                cached = true;
+                return static_cast<Record*>(e.record);
+            }
+            if (e.record && e.record->owned.load_acquire() == RECORD_ORPHANED) {
+                // left behind by a destroyed list
+                release_record(e.record);
+                e.record = NULL;
+            }
+            if (!e.record && !free_entry) {
+                free_entry = &e;
+            }
+        }
+        Record* r = claim();
+        if (!r) {
+            return NULL;
+        }
+        cached = free_entry != NULL;
+        if (free_entry) {
+            free_entry->list = m_id;
+            free_entry->record = r;
+        }
+        return r;
+    }
+
+    /// A record of its own for a thread whose cached one is busy, handed to release() uncached. May be NULL
+    Record* acquire_spare() {
+        return claim();
+    }
+
+    void release(Record* r, bool cached) {
+        if (!cached) {
+            release_record(r);
+        }
+    }
+};
+
+}  // namespace details
+
+}  // namespace akl
@@ -14,6 +14,7 @@ if (!(expr)) {
 #endif
 
 #ifdef __cplusplus
+#include <cstddef>
 #include <cstdint>
 
 #else
@@ -21,6 +22,7 @@ if (!(expr)) {
 #include <linux/types.h>
 
 #else
+#include <stddef.h>
 #include <stdint.h>
 
 #endif
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "types.h"
+
+/* the kernel build has no <new>, placement new is provided here */
+#ifdef __KERNEL_MODULE__
+inline void* operator new(size_t, void* place) noexcept {
+    return place;
+}
+
+inline void operator delete(void*, void*) noexcept {}
+#else
+#include <new>
+#endif
+
+namespace akl {
+
+template <typename T>
+struct remove_reference {
+    using type = T;
+};
+
+template <typename T>
+struct remove_reference<T&> {
+    using type = T;
+};
+
+template <typename T>
+struct remove_reference<T&&> {
+    using type = T;
+};
+
+template <typename T>
+struct remove_cv {
+    using type = T;
+};
+
+template <typename T>
+struct remove_cv<const T> {
+    using type = T;
+};
+
+template <typename T>
+struct remove_cv<volatile T> {
+    using type = T;
+};
+
+template <typename T>
+struct remove_cv<const volatile T> {
+    using type = T;
+};
+
+//! std::remove_cvref replacement, the type to store a forwarded argument as
+template <typename T>
+struct remove_cvref {
+    using type = typename remove_cv<typename remove_reference<T>::type>::type;
+};
+
+//! std::enable_if replacement
+template <bool Condition, typename T = void>
+struct enable_if {};
+
+template <typename T>
+struct enable_if<true, T> {
+    using type = T;
+};
+
+template <typename A, typename B>
+struct is_same {
+    static constexpr bool value = false;
+};
+
+template <typename A>
+struct is_same<A, A> {
+    static constexpr bool value = true;
+};
+
+//! std::declval replacement, only for unevaluated operands such as decltype
+template <typename T>
+T&& declval() noexcept;
+
+//! std::move replacement for freestanding builds
+template <typename T>
+constexpr typename remove_reference<T>::type&& move(T&& value) noexcept {
+    return static_cast<typename remove_reference<T>::type&&>(value);
+}
+
+//! std::forward replacement for freestanding builds
+template <typename T>
+constexpr T&& forward(typename remove_reference<T>::type& value) noexcept {
+    return static_cast<T&&>(value);
+}
+
+template <typename T>
+constexpr T&& forward(typename remove_reference<T>::type&& value) noexcept {
+    return static_cast<T&&>(value);
+}
+
+template <typename T>
+inline void swap(T& a, T& b) {
+    T tmp(akl::move(a));
+    a = akl::move(b);
+    b = akl::move(tmp);
+}
+
+template <typename T>
+constexpr const T& min(const T& a, const T& b) {
+    return b < a ? b : a;
+}
+
+template <typename T>
+constexpr const T& max(const T& a, const T& b) {
+    return a < b ? b : a;
+}
+
+/**
+ * True if a T can be moved to another address with a raw byte copy and
+ * no destructor call for the source. Specialize it to true for types
+ * that never point into themselves, such as most owning handles.
+ */
+template <typename T>
+struct is_trivially_relocatable {
+    static constexpr bool value = __is_trivially_copyable(T);
+};
+
+template <typename T>
+struct is_trivially_destructible {
+    static constexpr bool value = __has_trivial_destructor(T);
+};
+
+}  // namespace akl
@@ -0,0 +1,449 @@
+#pragma once
+
+#include "kern_lib.h"
+#include "utility.hpp"
+
+namespace akl {
+
+namespace details {
+
+//! In-object element storage used by small_vector
+template <typename T, size_t N>
+class inline_storage {
+    alignas(T) unsigned char m_bytes[N * sizeof(T)];
+
+protected:
+    T* inline_data() {
+        return reinterpret_cast<T*>(m_bytes);
+    }
+
+    const T* inline_data() const {
+        return reinterpret_cast<const T*>(m_bytes);
+    }
+};
+
+template <typename T>
+class inline_storage<T, 0> {
+protected:
+    T* inline_data() {
+        return NULL;
+    }
+
+    const T* inline_data() const {
+        return NULL;
+    }
+};
+
+/**
+ * Storage and element management shared by vector and small_vector.
+ *
+ * The first N elements live in the object. Inline storage is never
+ * passed to akl_crealloc or akl_cfree; growing past it moves the
+ * elements to the heap once.
+ */
+template <typename T, size_t N>
+class vector_impl : protected inline_storage<T, N> {
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    // blocks come from akl_cmalloc, which only guarantees this much
+    static_assert(alignof(T) <= 16, "akl::vector storage is at most 16 byte aligned");
+
+protected:
+    T* m_data;
+    size_t m_size;
+    size_t m_capacity;
+
+    vector_impl()
+        : m_data(this->inline_data()), m_size(0), m_capacity(N) {}
+
+    ~vector_impl() {
+        destroy_range(m_data, m_data + m_size);
+        release();
+    }
+
+    // not copyable through the base
+    vector_impl(const vector_impl&) = delete;
+    vector_impl& operator=(const vector_impl&) = delete;
+
+    static void destroy_range(T* first, T* last) {
+        if (!is_trivially_destructible<T>::value) {
+            for (; first != last; ++first) {
+                first->~T();
+            }
+        }
+    }
+
+    bool on_heap() const {
+        return m_data != this->inline_data();
+    }
+
+    //! Frees heap storage and falls back to the inline buffer, elements must be gone
+    void release() {
+        if (on_heap()) {
+            akl_cfree(m_data);
+        }
+        m_data = this->inline_data();
+        m_capacity = N;
+    }
+
+    //! Moves the elements into a block of exactly "new_capacity" slots
+    bool relocate(size_t new_capacity) {
+        T* fresh;
+        if (is_trivially_relocatable<T>::value && on_heap()) {
+            // krealloc/realloc extend the block in place when they can
+            fresh = static_cast<T*>(akl_crealloc(m_data, new_capacity * sizeof(T)));
+            if (!fresh) {
+                return false;
+            }
+        } else {
+            fresh = static_cast<T*>(akl_cmalloc(new_capacity * sizeof(T)));
+            if (!fresh) {
+                return false;
+            }
+            if (is_trivially_relocatable<T>::value) {
+                akl_cmemcpy(fresh, m_data, m_size * sizeof(T));
+            } else {
+                for (size_t i = 0; i < m_size; ++i) {
+                    new (fresh + i) T(akl::move(m_data[i]));
+                    m_data[i].~T();
+                }
+            }
+            if (on_heap()) {
+                akl_cfree(m_data);
+            }
+        }
+        m_data = fresh;
+        m_capacity = new_capacity;
+        return true;
+    }
+
+    //! Amortized 1.5x growth, enough for at least "needed" elements
+    bool grow(size_t needed) {
+        size_t next = m_capacity + m_capacity / 2;
+        if (next < 4) {
+            next = 4;
+        }
+        return relocate(akl::max(next, needed));
+    }
+
+    //! Takes other's elements, stealing its heap block when it has one.
+    //! This vector must be empty and own no heap block, so other's inline
+    //! elements always fit in this one's inline buffer.
+    void take(vector_impl&& other) {
+        if (other.on_heap()) {
+            m_data = other.m_data;
+            m_size = other.m_size;
+            m_capacity = other.m_capacity;
+        } else if (other.m_size != 0) {
+            for (size_t i = 0; i < other.m_size; ++i) {
+                new (m_data + i) T(akl::move(other.m_data[i]));
+            }
+            m_size = other.m_size;
+            destroy_range(other.m_data, other.m_data + other.m_size);
+        }
+        other.m_data = other.inline_data();
+        other.m_size = 0;
+        other.m_capacity = N;
+    }
+
+    //! Copies other's elements into this empty vector, which stays empty
+    //! if the allocation fails
+    bool copy_from(const vector_impl& other) {
+        if (!reserve(other.m_size)) {
+            return false;
+        }
+        for (size_t i = 0; i < other.m_size; ++i) {
+            new (m_data + i) T(other.m_data[i]);
+        }
+        m_size = other.m_size;
+        return true;
+    }
+
+public:
+    size_t size() const {
+        return m_size;
+    }
+
+    size_t capacity() const {
+        return m_capacity;
+    }
+
+    bool empty() const {
+        return m_size == 0;
+    }
+
+    T* data() {
+        return m_data;
+    }
+
+    const T* data() const {
+        return m_data;
+    }
+
+    T& operator[](size_t idx) {
+        return m_data[idx];
+    }
+
+    const T& operator[](size_t idx) const {
+        return m_data[idx];
+    }
+
+    T& front() {
+        return m_data[0];
+    }
+
+    const T& front() const {
+        return m_data[0];
+    }
+
+    T& back() {
+        return m_data[m_size - 1];
+    }
+
+    const T& back() const {
+        return m_data[m_size - 1];
+    }
+
+    iterator begin() {
+        return m_data;
+    }
+
+    iterator end() {
+        return m_data + m_size;
+    }
+
+    const_iterator begin() const {
+        return m_data;
+    }
+
+    const_iterator end() const {
+        return m_data + m_size;
+    }
+
+    /// Makes room for "n" elements. Returns false if the allocation failed
+    bool reserve(size_t n) {
+        if (n <= m_capacity) {
+            return true;
+        }
+        return relocate(n);
+    }
+
+    /// Appends a copy of "value". Returns false if the allocation failed
+    bool push_back(const T& value) {
+        return emplace_back(value) != NULL;
+    }
+
+    /// Appends "value" by move. Returns false if the allocation failed
+    bool push_back(T&& value) {
+        return emplace_back(akl::move(value)) != NULL;
+    }
+
+    /// Constructs an element in place at the end, returns NULL if the allocation failed
+    template <typename... Args>
+    T* emplace_back(Args&&... args) {
+        if (m_size == m_capacity) {
+            // the arguments may point into the storage that is about to move
+            T value(akl::forward<Args>(args)...);
+            if (!grow(m_size + 1)) {
+                return NULL;
+            }
+            T* slot = new (m_data + m_size) T(akl::move(value));
+            ++m_size;
+            return slot;
+        }
+        T* slot = new (m_data + m_size) T(akl::forward<Args>(args)...);
+        ++m_size;
+        return slot;
+    }
+
+    void pop_back() {
+        --m_size;
+        m_data[m_size].~T();
+    }
+
+    /// Resizes to "n" elements, new ones are value-initialized
+    bool resize(size_t n) {
+        if (n > m_capacity && !grow(n)) {
+            return false;
+        }
+        for (size_t i = m_size; i < n; ++i) {
+            new (m_data + i) T();
+        }
+        if (n < m_size) {
+            destroy_range(m_data + n, m_data + m_size);
+        }
+        m_size = n;
+        return true;
+    }
+
+    /// Resizes to "n" elements, new ones are copies of "value"
+    bool resize(size_t n, const T& value) {
+        if (n > m_capacity && !grow(n)) {
+            return false;
+        }
+        for (size_t i = m_size; i < n; ++i) {
+            new (m_data + i) T(value);
+        }
+        if (n < m_size) {
+            destroy_range(m_data + n, m_data + m_size);
+        }
+        m_size = n;
+        return true;
+    }
+
+    /// Destroys all elements, keeps the storage
+    void clear() {
+        destroy_range(m_data, m_data + m_size);
+        m_size = 0;
+    }
+
+    /// Returns heap storage that is not in use
+    void shrink_to_fit() {
+        if (!on_heap() || m_size == m_capacity) {
+            return;
+        }
+        if (m_size == 0) {
+            release();
+            return;
+        }
+        if (m_size <= N) {
+            // the elements fit inline again, so the heap block can go
+            T* inline_buf = this->inline_data();
+            if (is_trivially_relocatable<T>::value) {
+                akl_cmemcpy(inline_buf, m_data, m_size * sizeof(T));
+            } else {
+                for (size_t i = 0; i < m_size; ++i) {
+                    new (inline_buf + i) T(akl::move(m_data[i]));
+                    m_data[i].~T();
+                }
+            }
+            release();
+            return;
+        }
+        relocate(m_size);
+    }
+};
+
+}  // namespace details
+
+/**
+ * \ingroup util
+ *
+ * Growable array for freestanding builds. Storage comes from akl_cmalloc;
+ * when T is trivially relocatable the buffer grows with akl_crealloc, so
+ * the allocator can extend it in place instead of copying. Growth reports
+ * allocation failure: push_back(), reserve() and resize() return false,
+ * emplace_back() NULL. The allocating constructors and copy assignment
+ * trip ASSERT_TRUE and leave the vector empty.
+ */
+template <typename T>
+class vector : public details::vector_impl<T, 0> {
+public:
+    vector() {}
+
+    explicit vector(size_t n) {
+        bool ok = this->resize(n);
+        ASSERT_TRUE(ok);
+    }
+
+    vector(size_t n, const T& value) {
+        bool ok = this->resize(n, value);
+        ASSERT_TRUE(ok);
+    }
+
+    vector(const vector& other) {
+        bool ok = this->copy_from(other);
+        ASSERT_TRUE(ok);
+    }
+
+    vector(vector&& other) noexcept {
+        this->take(akl::move(other));
+    }
+
+    vector& operator=(const vector& other) {
+        if (this != &other) {
+            this->clear();
+            bool ok = this->copy_from(other);
+            ASSERT_TRUE(ok);
+        }
+        return *this;
+    }
+
+    vector& operator=(vector&& other) noexcept {
+        if (this != &other) {
+            this->clear();
+            this->release();
+            this->take(akl::move(other));
+        }
+        return *this;
+    }
+
+    void swap(vector& other) {
+        akl::swap(this->m_data, other.m_data);
+        akl::swap(this->m_size, other.m_size);
+        akl::swap(this->m_capacity, other.m_capacity);
+    }
+};
+
+/**
+ * \ingroup util
+ *
+ * vector that keeps its first N elements inside the object, so short
+ * vectors never touch the allocator. Past N the elements move to the
+ * heap once and from then on grow like akl::vector.
+ */
+template <typename T, size_t N>
+class small_vector : public details::vector_impl<T, N> {
+public:
+    static_assert(N > 0, "use akl::vector for an empty inline buffer");
+
+    small_vector() {}
+
+    explicit small_vector(size_t n) {
+        bool ok = this->resize(n);
+        ASSERT_TRUE(ok);
+    }
+
+    small_vector(size_t n, const T& value) {
+        bool ok = this->resize(n, value);
+        ASSERT_TRUE(ok);
+    }
+
+    small_vector(const small_vector& other) {
+        bool ok = this->copy_from(other);
+        ASSERT_TRUE(ok);
+    }
+
+    small_vector(small_vector&& other) noexcept {
+        this->take(akl::move(other));
+    }
+
+    small_vector& operator=(const small_vector& other) {
+        if (this != &other) {
+            this->clear();
+            bool ok = this->copy_from(other);
+            ASSERT_TRUE(ok);
+        }
+        return *this;
+    }
+
+    small_vector& operator=(small_vector&& other) noexcept {
+        if (this != &other) {
+            this->clear();
+            this->release();
+            this->take(akl::move(other));
+        }
+        return *this;
+    }
+
+    /// True while the elements still live in the inline buffer
+    bool is_inline() const {
+        return !this->on_heap();
+    }
+};
+
+}  // namespace akl
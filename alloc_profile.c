@@ -0,0 +1,287 @@
+#if defined(AKL_ALLOC_PROFILE) && !defined(__KERNEL_MODULE__)
+#define _GNU_SOURCE
+#endif
+
+#include "akl/alloc_profile.h"
+#include "akl/kern_lib.h"
+#include "akl/logger.h"
+#include "akl/sync.h"
+
+#ifdef AKL_ALLOC_PROFILE
+
+#ifdef __KERNEL_MODULE__
+#include <linux/atomic.h>
+#include <linux/smp.h>
+#include <linux/stacktrace.h>
+#include <linux/string.h>
+#else
+#include <execinfo.h>
+#include <sched.h>
+#include <string.h>
+#endif
+
+#ifdef __KERNEL_MODULE__
+#define AKL_PROF_SYM "%pS"
+
+static inline akl_u64 akl_prof_load(akl_u64* p) {
+    return (akl_u64)atomic64_read((atomic64_t*)p);
+}
+
+static inline akl_u64 akl_prof_add(akl_u64* p, akl_u64 v) {
+    return (akl_u64)atomic64_add_return(v, (atomic64_t*)p);
+}
+
+static inline int akl_prof_cas(akl_u64* p, akl_u64 old, akl_u64 v) {
+    return atomic64_cmpxchg((atomic64_t*)p, (s64)old, (s64)v) == (s64)old;
+}
+
+static inline void akl_prof_store(akl_u64* p, akl_u64 v) {
+    atomic64_set((atomic64_t*)p, (s64)v);
+}
+
+static inline void akl_prof_rmb(void) {
+    smp_rmb();
+}
+
+static inline unsigned int akl_prof_cpu(void) {
+    return raw_smp_processor_id();
+}
+#else
+#define AKL_PROF_SYM "%p"
+
+static inline akl_u64 akl_prof_load(akl_u64* p) {
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static inline akl_u64 akl_prof_add(akl_u64* p, akl_u64 v) {
+    return __atomic_add_fetch(p, v, __ATOMIC_RELAXED);
+}
+
+static inline int akl_prof_cas(akl_u64* p, akl_u64 old, akl_u64 v) {
+    return __atomic_compare_exchange_n(p, &old, v, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static inline void akl_prof_store(akl_u64* p, akl_u64 v) {
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+
+static inline void akl_prof_rmb(void) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+static inline unsigned int akl_prof_cpu(void) {
+    int cpu = sched_getcpu();
+    return cpu < 0 ? 0 : (unsigned int)cpu;
+}
+#endif
+
+//! Counters owned by one cpu, padded so that cpus never share a line
+typedef struct {
+    akl_alloc_class_stats_t classes[AKL_ALLOC_PROFILE_CLASSES];
+    //! bytes allocated since the last sample taken on this slot
+    akl_u64 sample_bytes;
+} __attribute__((aligned(64))) akl_prof_slot_t;
+
+static akl_prof_slot_t akl_prof_slots[AKL_ALLOC_PROFILE_SLOTS];
+
+static akl_u64 akl_prof_rate = AKL_ALLOC_PROFILE_DEFAULT_RATE;
+
+/* sample ring: every entry carries a sequence number which is odd while
+ * a writer is filling it, so readers can skip torn entries */
+static akl_alloc_sample_t akl_prof_samples[AKL_ALLOC_PROFILE_SAMPLES];
+static volatile int akl_prof_sample_seq[AKL_ALLOC_PROFILE_SAMPLES];
+static volatile int akl_prof_sample_next;
+
+static inline unsigned int akl_prof_class(size_t size) {
+    if (size <= 1) {
+        return 0;
+    }
+    unsigned int k = 64 - __builtin_clzll((unsigned long long)size - 1);
+    return k < AKL_ALLOC_PROFILE_CLASSES ? k : AKL_ALLOC_PROFILE_CLASSES - 1;
+}
+
+static inline akl_prof_slot_t* akl_prof_slot(void) {
+    return &akl_prof_slots[akl_prof_cpu() % AKL_ALLOC_PROFILE_SLOTS];
+}
+
+__attribute__((noinline)) static void akl_prof_take_sample(size_t size, void* site) {
+    int ticket = akl_sync_fetch_and_add(&akl_prof_sample_next, 1);
+    unsigned int idx = (unsigned int)ticket % AKL_ALLOC_PROFILE_SAMPLES;
+    akl_alloc_sample_t* sample = &akl_prof_samples[idx];
+
+    akl_sync_add_and_fetch(&akl_prof_sample_seq[idx], 1);
+    sample->size = size;
+    sample->site = site;
+#ifdef __KERNEL_MODULE__
+    /* skip this function and the allocation hook */
+    sample->depth = stack_trace_save(
+        (unsigned long*)sample->frames, AKL_ALLOC_PROFILE_DEPTH, 2
+    );
+#else
+    void* frames[AKL_ALLOC_PROFILE_DEPTH + 2];
+    int depth = backtrace(frames, AKL_ALLOC_PROFILE_DEPTH + 2);
+    depth = depth > 2 ? depth - 2 : 0;
+    memcpy(sample->frames, frames + 2, depth * sizeof(void*));
+    sample->depth = (unsigned int)depth;
+#endif
+    akl_sync_add_and_fetch(&akl_prof_sample_seq[idx], 1);
+}
+
+void akl_alloc_profile_on_alloc(size_t size, void* site) {
+    akl_prof_slot_t* slot = akl_prof_slot();
+    akl_alloc_class_stats_t* cls = &slot->classes[akl_prof_class(size)];
+    akl_prof_add(&cls->allocs, 1);
+    akl_prof_add(&cls->alloc_bytes, size);
+
+    akl_u64 rate = akl_prof_rate;
+    if (rate == 0) {
+        return;
+    }
+    akl_u64 acc = akl_prof_add(&slot->sample_bytes, size);
+    /* whoever brings the counter back under the period takes the sample,
+     * so a slot that concurrent adders or a lowered rate pushed far past
+     * it still samples on its next allocation */
+    while (acc >= rate) {
+        if (akl_prof_cas(&slot->sample_bytes, acc, acc % rate)) {
+            akl_prof_take_sample(size, site);
+            return;
+        }
+        acc = akl_prof_load(&slot->sample_bytes);
+    }
+}
+
+void akl_alloc_profile_on_free(size_t size) {
+    akl_prof_slot_t* slot = akl_prof_slot();
+    akl_alloc_class_stats_t* cls = &slot->classes[akl_prof_class(size)];
+    akl_prof_add(&cls->frees, 1);
+    akl_prof_add(&cls->free_bytes, size);
+}
+
+static void akl_prof_sum_class(unsigned int k, akl_alloc_class_stats_t* out) {
+    out->allocs = 0;
+    out->frees = 0;
+    out->alloc_bytes = 0;
+    out->free_bytes = 0;
+    for (unsigned int s = 0; s < AKL_ALLOC_PROFILE_SLOTS; ++s) {
+        akl_alloc_class_stats_t* cls = &akl_prof_slots[s].classes[k];
+        out->allocs += akl_prof_load(&cls->allocs);
+        out->frees += akl_prof_load(&cls->frees);
+        out->alloc_bytes += akl_prof_load(&cls->alloc_bytes);
+        out->free_bytes += akl_prof_load(&cls->free_bytes);
+    }
+}
+
+//! Copies ring entry "idx" into "out", returns 0 if it is empty or being written
+static int akl_prof_read_sample(unsigned int idx, akl_alloc_sample_t* out) {
+    int seq = akl_prof_sample_seq[idx];
+    if (seq == 0 || (seq & 1)) {
+        return 0;
+    }
+    akl_prof_rmb();
+    *out = akl_prof_samples[idx];
+    akl_prof_rmb();
+    return akl_prof_sample_seq[idx] == seq;
+}
+
+int akl_alloc_profile_snapshot(akl_alloc_profile_t* out) {
+    out->sample_rate = akl_prof_rate;
+    out->live_bytes = 0;
+    out->live_allocs = 0;
+    for (unsigned int k = 0; k < AKL_ALLOC_PROFILE_CLASSES; ++k) {
+        akl_prof_sum_class(k, &out->classes[k]);
+        out->live_bytes += out->classes[k].alloc_bytes - out->classes[k].free_bytes;
+        out->live_allocs += out->classes[k].allocs - out->classes[k].frees;
+    }
+    out->nsamples = 0;
+    for (unsigned int i = 0; i < AKL_ALLOC_PROFILE_SAMPLES; ++i) {
+        if (akl_prof_read_sample(i, &out->samples[out->nsamples])) {
+            out->nsamples++;
+        }
+    }
+    return 0;
+}
+
+void akl_alloc_profile_dump(void) {
+    /* the snapshot struct is too large for a kernel stack, so the dump
+     * walks the slots and the ring one entry at a time */
+    akl_alloc_class_stats_t classes[AKL_ALLOC_PROFILE_CLASSES];
+    akl_u64 live_bytes = 0;
+    akl_u64 live_allocs = 0;
+    for (unsigned int k = 0; k < AKL_ALLOC_PROFILE_CLASSES; ++k) {
+        akl_prof_sum_class(k, &classes[k]);
+        live_bytes += classes[k].alloc_bytes - classes[k].free_bytes;
+        live_allocs += classes[k].allocs - classes[k].frees;
+    }
+
+    akl_kern_log(
+        "akl_alloc: rate=%llu live_bytes=%llu live_allocs=%llu\n",
+        (unsigned long long)akl_prof_rate,
+        (unsigned long long)live_bytes,
+        (unsigned long long)live_allocs
+    );
+    for (unsigned int k = 0; k < AKL_ALLOC_PROFILE_CLASSES; ++k) {
+        if (classes[k].allocs == 0) {
+            continue;
+        }
+        akl_kern_log(
+            "akl_alloc: class=%u max_size=%llu allocs=%llu frees=%llu "
+            "alloc_bytes=%llu free_bytes=%llu\n",
+            k,
+            1ull << k,
+            (unsigned long long)classes[k].allocs,
+            (unsigned long long)classes[k].frees,
+            (unsigned long long)classes[k].alloc_bytes,
+            (unsigned long long)classes[k].free_bytes
+        );
+    }
+
+    akl_alloc_sample_t sample;
+    for (unsigned int i = 0; i < AKL_ALLOC_PROFILE_SAMPLES; ++i) {
+        if (!akl_prof_read_sample(i, &sample)) {
+            continue;
+        }
+        akl_kern_log(
+            "akl_alloc: sample=%u size=%llu site=" AKL_PROF_SYM "\n",
+            i,
+            (unsigned long long)sample.size,
+            sample.site
+        );
+        for (unsigned int f = 0; f < sample.depth; ++f) {
+            akl_kern_log(
+                "akl_alloc: sample=%u frame=%u addr=" AKL_PROF_SYM "\n", i, f, sample.frames[f]
+            );
+        }
+    }
+}
+
+void akl_alloc_profile_reset(void) {
+    memset(akl_prof_slots, 0, sizeof(akl_prof_slots));
+    for (unsigned int i = 0; i < AKL_ALLOC_PROFILE_SAMPLES; ++i) {
+        akl_prof_sample_seq[i] = 0;
+    }
+    akl_prof_sample_next = 0;
+}
+
+void akl_alloc_profile_set_sample_rate(akl_u64 bytes) {
+    akl_prof_rate = bytes;
+    /* bytes counted under the old rate would skew the first period */
+    for (unsigned int s = 0; s < AKL_ALLOC_PROFILE_SLOTS; ++s) {
+        akl_prof_store(&akl_prof_slots[s].sample_bytes, 0);
+    }
+}
+
+#else
+
+int akl_alloc_profile_snapshot(akl_alloc_profile_t* out) {
+    return -1;
+}
+
+void akl_alloc_profile_dump(void) {
+    akl_kern_log("akl_alloc: profiling is not compiled in\n");
+}
+
+void akl_alloc_profile_reset(void) {}
+
+void akl_alloc_profile_set_sample_rate(akl_u64 bytes) {}
+
+#endif
@@ -0,0 +1,76 @@
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "akl/atomic.hpp"
+#include "akl/thread_pool.hpp"
+
+/* batches of 10k small tasks on akl::thread_pool: one launch() per task
+ * with a global join(), one launch() per task counted in a task_batch,
+ * and a single launch_n() waited on through its task_batch */
+
+namespace {
+
+const size_t batch_tasks = 10000;
+const size_t batches = 200;
+
+akl::atomic<int> sink;
+
+//! a few hundred nanoseconds of work per task
+inline void small_work(size_t i) {
+    unsigned x = (unsigned)i + 1;
+    for (int k = 0; k < 64; ++k) {
+        x = x * 1664525u + 1013904223u;
+    }
+    if (x == 0) {
+        sink.inc();
+    }
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//! ns per task for one way of running a batch
+template <typename RunBatch>
+double measure(RunBatch run_batch) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t b = 0; b < batches; ++b) {
+        run_batch();
+    }
+    return seconds_since(start) * 1e9 / double(batches * batch_tasks);
+}
+
+}  // namespace
+
+int main() {
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    printf("%8s %18s %18s %18s\n", "threads", "launch+join", "launch+batch", "launch_n+batch");
+    printf("%8s %18s %18s %18s\n", "", "ns/task", "ns/task", "ns/task");
+    for (size_t t = 1; t <= max_threads; t *= 2) {
+        akl::thread_pool pool(t);
+        double single = measure([&pool] {
+            for (size_t i = 0; i < batch_tasks; ++i) {
+                pool.launch([i] { small_work(i); });
+            }
+            pool.join();
+        });
+        double counted = measure([&pool] {
+            akl::task_batch batch;
+            for (size_t i = 0; i < batch_tasks; ++i) {
+                pool.launch([i] { small_work(i); }, batch);
+            }
+            pool.wait(batch);
+        });
+        double bulk = measure([&pool] {
+            akl::task_batch batch;
+            pool.launch_n(batch_tasks, [](size_t i) { small_work(i); }, &batch);
+            pool.wait(batch);
+        });
+        printf("%8zu %18.1f %18.1f %18.1f\n", t, single, counted, bulk);
+    }
+    return 0;
+}
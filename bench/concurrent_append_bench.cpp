@@ -0,0 +1,62 @@
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "akl/concurrent_append_vector.hpp"
+#include "akl/mutex.hpp"
+#include "akl/vector.hpp"
+
+/* multi-producer append throughput: concurrent_append_vector against an
+ * akl::vector guarded by one akl::mutex */
+
+namespace {
+
+const size_t total_items = size_t(1) << 23;
+
+struct locked_vector {
+    akl::vector<size_t> items;
+    akl::mutex mut;
+
+    void push_back(size_t v) {
+        mut.lock();
+        items.push_back(v);
+        mut.unlock();
+    }
+};
+
+template <typename Container>
+double run(size_t producers) {
+    Container c;
+    std::vector<std::thread> threads;
+    size_t per_thread = total_items / producers;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < producers; ++t) {
+        threads.emplace_back([&c, per_thread, t] {
+            for (size_t i = 0; i < per_thread; ++i) {
+                c.push_back(t * per_thread + i);
+            }
+        });
+    }
+    for (auto& thr : threads) {
+        thr.join();
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    return double(per_thread * producers) / seconds / 1e6;
+}
+
+}  // namespace
+
+int main() {
+    size_t max_threads = std::thread::hardware_concurrency();
+    printf("%10s %20s %20s\n", "producers", "append Mops/s", "mutex Mops/s");
+    for (size_t p = 1; p <= max_threads; p *= 2) {
+        double lockfree = run<akl::concurrent_append_vector<size_t>>(p);
+        double locked = run<locked_vector>(p);
+        printf("%10zu %20.1f %20.1f\n", p, lockfree, locked);
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "akl/concurrent_hash_map.hpp"
+#include "akl/mutex.hpp"
+
+/* mixed lookup/insert load on 64 bit ids: concurrent_hash_map with
+ * reader-writer and exclusive stripe locks against a std::unordered_map
+ * guarded by one akl::mutex, sweeping the read ratio and thread count */
+
+namespace {
+
+typedef unsigned long long ident;
+
+const size_t key_space = size_t(1) << 20;
+const size_t ops_per_thread = size_t(1) << 20;
+
+struct locked_map {
+    std::unordered_map<ident, ident> map;
+    akl::mutex mut;
+
+    bool find(ident key, ident& out) {
+        mut.lock();
+        auto it = map.find(key);
+        bool found = it != map.end();
+        if (found) {
+            out = it->second;
+        }
+        mut.unlock();
+        return found;
+    }
+
+    void insert_or_assign(ident key, ident value) {
+        mut.lock();
+        map[key] = value;
+        mut.unlock();
+    }
+};
+
+//! xorshift64, one per thread
+inline ident next_random(ident& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+template <typename Map>
+double run(size_t threads, unsigned read_percent) {
+    Map map;
+    for (ident k = 0; k < key_space; k += 2) {
+        map.insert_or_assign(k, k);
+    }
+    std::vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&map, t, read_percent] {
+            ident state = 0x9e3779b97f4a7c15ULL * (t + 1);
+            ident found = 0;
+            for (size_t i = 0; i < ops_per_thread; ++i) {
+                ident r = next_random(state);
+                ident key = r % key_space;
+                if ((r >> 40) % 100 < read_percent) {
+                    ident value;
+                    found += map.find(key, value);
+                } else {
+                    map.insert_or_assign(key, r);
+                }
+            }
+            if (found == ~ident(0)) {
+                printf("unreachable\n");
+            }
+        });
+    }
+    for (auto& thr : workers) {
+        thr.join();
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    return double(ops_per_thread * threads) / seconds / 1e6;
+}
+
+}  // namespace
+
+int main() {
+    const unsigned read_percents[] = {50, 90, 99};
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    printf("%8s %8s %18s %18s %18s\n", "reads %", "threads", "rwlock Mops/s", "spinlock Mops/s", "mutex Mops/s");
+    for (unsigned reads : read_percents) {
+        for (size_t t = 1; t <= max_threads; t *= 2) {
+            double rw = run<akl::concurrent_hash_map<ident, ident>>(t, reads);
+            double spin = run<akl::concurrent_hash_map<ident, ident, akl::hash<ident>, akl::spinlock>>(t, reads);
+            double locked = run<locked_map>(t, reads);
+            printf("%8u %8zu %18.1f %18.1f %18.1f\n", reads, t, rw, spin, locked);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "akl/concurrent_skiplist.hpp"
+#include "akl/mutex.hpp"
+#include "akl/vector.hpp"
+
+/* time ordered event index: concurrent_skiplist against a sorted
+ * akl::vector guarded by one akl::mutex. Measures insert throughput of
+ * random timestamps, then range scans of 64 events over a filled index */
+
+namespace {
+
+typedef unsigned long long ident;
+
+const size_t inserts_per_thread = size_t(1) << 14;
+const size_t prefill = size_t(1) << 16;
+const size_t scans_per_thread = size_t(1) << 14;
+const ident scan_width = 64;
+
+struct sorted_index {
+    struct entry {
+        ident key;
+        ident value;
+    };
+
+    akl::vector<entry> events;
+    akl::mutex mut;
+
+    //! first position with a key not below "key"
+    size_t lower_bound(ident key) const {
+        size_t lo = 0;
+        size_t hi = events.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (events[mid].key < key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    bool insert(ident key, ident value) {
+        mut.lock();
+        size_t pos = lower_bound(key);
+        bool fresh = pos == events.size() || events[pos].key != key;
+        if (fresh) {
+            events.push_back(entry{key, value});
+            akl_cmemmove(events.data() + pos + 1, events.data() + pos, (events.size() - pos - 1) * sizeof(entry));
+            events[pos] = entry{key, value};
+        }
+        mut.unlock();
+        return fresh;
+    }
+
+    template <typename Fn>
+    size_t scan(ident from, ident to, Fn fn) {
+        mut.lock();
+        size_t count = 0;
+        for (size_t i = lower_bound(from); i < events.size() && events[i].key < to; ++i, ++count) {
+            fn(events[i].key, events[i].value);
+        }
+        mut.unlock();
+        return count;
+    }
+};
+
+typedef akl::concurrent_skiplist<ident, ident> skiplist_index;
+
+//! xorshift64, one per thread
+inline ident next_random(ident& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+template <typename Fn>
+double timed(size_t threads, Fn body) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back(body, t);
+    }
+    for (auto& thr : workers) {
+        thr.join();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(stop - start).count();
+}
+
+template <typename Index>
+double run_inserts(size_t threads) {
+    Index index;
+    double seconds = timed(threads, [&index](size_t t) {
+        ident state = 0x9e3779b97f4a7c15ULL * (t + 1);
+        for (size_t i = 0; i < inserts_per_thread; ++i) {
+            ident r = next_random(state);
+            index.insert(r, r);
+        }
+    });
+    return double(inserts_per_thread * threads) / seconds / 1e6;
+}
+
+template <typename Index>
+double run_scans(size_t threads) {
+    Index index;
+    // dense timestamps in arrival order, so every scan sees scan_width events
+    for (ident k = 0; k < prefill; ++k) {
+        index.insert(k, k);
+    }
+    double seconds = timed(threads, [&index](size_t t) {
+        ident state = 0x9e3779b97f4a7c15ULL * (t + 1);
+        ident sum = 0;
+        for (size_t i = 0; i < scans_per_thread; ++i) {
+            ident from = next_random(state) % (prefill - scan_width);
+            index.scan(from, from + scan_width, [&sum](const ident&, const ident& v) { sum += v; });
+        }
+        if (sum == ~ident(0)) {
+            printf("unreachable\n");
+        }
+    });
+    return double(scans_per_thread * threads) / seconds / 1e6;
+}
+
+}  // namespace
+
+int main() {
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    printf("%8s %20s %20s %20s %20s\n", "threads", "skiplist ins M/s", "sorted ins M/s", "skiplist scan M/s",
+           "sorted scan M/s");
+    for (size_t t = 1; t <= max_threads; t *= 2) {
+        double skip_ins = run_inserts<skiplist_index>(t);
+        double sorted_ins = run_inserts<sorted_index>(t);
+        double skip_scan = run_scans<skiplist_index>(t);
+        double sorted_scan = run_scans<sorted_index>(t);
+        printf("%8zu %20.2f %20.2f %20.2f %20.2f\n", t, skip_ins, sorted_ins, skip_scan, sorted_scan);
+    }
+    return 0;
+}
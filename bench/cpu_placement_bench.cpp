@@ -0,0 +1,95 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "akl/cpu_topology.hpp"
+#include "akl/thread_group.hpp"
+
+/* memory bandwidth of a STREAM triad split over the threads of an
+ * akl::thread_group, unpinned, with the previous "thread i on cpu i
+ * modulo ncpus" pinning, and with each cpu_placement. Every thread
+ * touches its slice first after being pinned, so the pages land on its
+ * node */
+
+namespace {
+
+const size_t total_elements = size_t(1) << 23;
+const int repetitions = 10;
+
+enum pinning { unpinned, modulo, compact, scatter, per_l3 };
+
+//! GB/s moved by the triad a[i] = b[i] + s * c[i] on "threads" threads
+double run(pinning mode, size_t threads) {
+    size_t slice = total_elements / threads;
+    std::atomic<size_t> ready(0);
+    std::atomic<bool> go(false);
+    akl::thread_group group;
+    size_t ncpus = akl::cpu_topology::system().size();
+
+    for (size_t t = 0; t < threads; ++t) {
+        auto body = [slice, &ready, &go] {
+            std::vector<double> a(slice, 0.0), b(slice, 1.0), c(slice, 2.0);
+            ready.fetch_add(1);
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            for (int r = 0; r < repetitions; ++r) {
+                double s = r + 1;
+                for (size_t i = 0; i < slice; ++i) {
+                    a[i] = b[i] + s * c[i];
+                }
+            }
+            if (a[slice / 2] != 1.0 + 2.0 * repetitions) {
+                printf("unreachable\n");
+            }
+        };
+        switch (mode) {
+            case unpinned:
+                group.launch(body);
+                break;
+            case modulo:
+                group.launch(body, t % ncpus);
+                break;
+            case compact:
+                group.launch(body, akl::CPU_PLACEMENT_COMPACT);
+                break;
+            case scatter:
+                group.launch(body, akl::CPU_PLACEMENT_SCATTER_CORES);
+                break;
+            case per_l3:
+                group.launch(body, akl::CPU_PLACEMENT_PER_L3);
+                break;
+        }
+    }
+    while (ready.load() != threads) {
+        std::this_thread::yield();
+    }
+    auto start = std::chrono::steady_clock::now();
+    go.store(true);
+    group.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double bytes = 3.0 * sizeof(double) * double(slice * threads) * repetitions;
+    return bytes / seconds / 1e9;
+}
+
+}  // namespace
+
+int main() {
+    const akl::cpu_topology& topology = akl::cpu_topology::system();
+    printf("%zu cpus, %zu cores, %zu L3 domains\n", topology.size(), topology.cores(), topology.l3_domains());
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    printf("%8s %12s %12s %12s %12s %12s\n", "threads", "unpinned", "i % ncpus", "compact", "scatter", "per-L3");
+    for (size_t t = 1; t <= max_threads; t *= 2) {
+        printf("%8zu", t);
+        for (int mode = unpinned; mode <= per_l3; ++mode) {
+            printf(" %9.1f GB", run((pinning)mode, t));
+        }
+        printf("\n");
+    }
+    return 0;
+}
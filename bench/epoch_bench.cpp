@@ -0,0 +1,122 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "akl/epoch.hpp"
+
+/* read-side cost of protecting a shared object while one writer keeps
+ * replacing it: epoch reader sections against reference counting through
+ * std::atomic<std::shared_ptr> */
+
+namespace {
+
+const size_t reads_per_thread = size_t(1) << 21;
+const size_t replace_every_us = 50;
+
+struct config {
+    size_t generation;
+    size_t payload[7];
+
+    explicit config(size_t g)
+        : generation(g) {
+        for (size_t i = 0; i < 7; ++i) {
+            payload[i] = g + i;
+        }
+    }
+};
+
+struct epoch_scheme {
+    akl::epoch domain;
+    akl::atomic<config*> current;
+
+    epoch_scheme()
+        : current(new config(0)) {}
+
+    ~epoch_scheme() {
+        delete current.load_acquire();
+    }
+
+    size_t read() {
+        akl::epoch::guard g(domain);
+        config* c = current.load_acquire();
+        return c->payload[c->generation % 7];
+    }
+
+    void replace(size_t g) {
+        config* old = current.load_acquire();
+        current.store_release(new config(g));
+        domain.retire(old);
+    }
+};
+
+struct refcount_scheme {
+    std::atomic<std::shared_ptr<config> > current;
+
+    refcount_scheme()
+        : current(std::make_shared<config>(0)) {}
+
+    size_t read() {
+        std::shared_ptr<config> c = current.load();
+        return c->payload[c->generation % 7];
+    }
+
+    void replace(size_t g) {
+        current.store(std::make_shared<config>(g));
+    }
+};
+
+template <typename Scheme>
+double run(size_t readers) {
+    Scheme scheme;
+    akl::atomic<int> done;
+    std::vector<std::thread> threads;
+
+    std::thread writer([&scheme, &done] {
+        size_t g = 1;
+        while (!done.load_acquire()) {
+            scheme.replace(g++);
+            std::this_thread::sleep_for(std::chrono::microseconds(replace_every_us));
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < readers; ++t) {
+        threads.emplace_back([&scheme] {
+            size_t sum = 0;
+            for (size_t i = 0; i < reads_per_thread; ++i) {
+                sum += scheme.read();
+            }
+            if (sum == 1) {
+                printf("unreachable\n");
+            }
+        });
+    }
+    for (auto& thr : threads) {
+        thr.join();
+    }
+    auto stop = std::chrono::steady_clock::now();
+    done.store_release(1);
+    writer.join();
+
+    double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+    return ns / reads_per_thread;
+}
+
+}  // namespace
+
+int main() {
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    printf("%10s %18s %18s\n", "readers", "epoch ns/read", "refcount ns/read");
+    for (size_t t = 1; t <= max_threads; t *= 2) {
+        double epoch = run<epoch_scheme>(t);
+        double refcount = run<refcount_scheme>(t);
+        printf("%10zu %18.1f %18.1f\n", t, epoch, refcount);
+    }
+    return 0;
+}
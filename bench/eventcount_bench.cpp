@@ -0,0 +1,148 @@
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "akl/mpmc_queue.hpp"
+#include "akl/spsc_ring.hpp"
+
+/* consumers that sleep on an empty queue: mpmc_queue/spsc_ring push()
+ * and pop(), which park on an akl::eventcount, against a deque under a
+ * mutex with a condition variable, where every push takes the mutex to
+ * look for sleepers. Measured once without contention, where the
+ * eventcount costs a fence, and once with producers handing items to
+ * consumers that keep running dry and going to sleep */
+
+namespace {
+
+const size_t items = size_t(1) << 20;
+const long done_item = -1;
+
+class condvar_queue {
+    std::mutex mut;
+    std::condition_variable readable;
+    std::deque<long> queue;
+    size_t sleepers = 0;
+
+public:
+    void push(long v) {
+        std::lock_guard<std::mutex> lock(mut);
+        queue.push_back(v);
+        if (sleepers) {
+            readable.notify_one();
+        }
+    }
+
+    long pop() {
+        std::unique_lock<std::mutex> lock(mut);
+        while (queue.empty()) {
+            ++sleepers;
+            readable.wait(lock);
+            --sleepers;
+        }
+        long v = queue.front();
+        queue.pop_front();
+        return v;
+    }
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//! ns per push and pop of one item by a single thread
+template <typename Push, typename Pop>
+double uncontended(Push push, Pop pop) {
+    long sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < items; ++i) {
+        push((long)i);
+        sum += pop();
+    }
+    double ns = seconds_since(start) * 1e9 / items;
+    return sum ? ns : 0;
+}
+
+/**
+ * Mitems/s from "producers" threads to "consumers" threads. Every
+ * consumer stops at a done_item, pushed once per consumer at the end.
+ */
+template <typename Push, typename Pop>
+double handoff(size_t producers, size_t consumers, Push push, Pop pop) {
+    size_t per_producer = items / producers;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < consumers; ++c) {
+        threads.emplace_back([&pop] {
+            while (pop() != done_item) {
+            }
+        });
+    }
+    std::vector<std::thread> feeders;
+    for (size_t p = 0; p < producers; ++p) {
+        feeders.emplace_back([&push, per_producer] {
+            for (size_t i = 0; i < per_producer; ++i) {
+                push((long)i);
+            }
+        });
+    }
+    for (auto& t : feeders) {
+        t.join();
+    }
+    for (size_t c = 0; c < consumers; ++c) {
+        push(done_item);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    return producers * per_producer / seconds_since(start) / 1e6;
+}
+
+}  // namespace
+
+int main() {
+    akl::mpmc_queue<long> mpmc(1024);
+    akl::spsc_ring<long> ring(1024);
+    condvar_queue cv;
+
+    auto mpmc_push = [&mpmc](long v) { mpmc.push(v); };
+    auto mpmc_pop = [&mpmc]() {
+        long v;
+        mpmc.pop(v);
+        return v;
+    };
+    auto ring_push = [&ring](long v) { ring.push(v); };
+    auto ring_pop = [&ring]() {
+        long v;
+        ring.pop(v);
+        return v;
+    };
+    auto cv_push = [&cv](long v) { cv.push(v); };
+    auto cv_pop = [&cv]() { return cv.pop(); };
+
+    printf("uncontended push + pop, ns\n");
+    printf("%14s %14s %14s %14s\n", "mpmc try_", "mpmc", "spsc", "condvar");
+    double try_ns = uncontended([&mpmc](long v) { mpmc.try_push(v); },
+                                [&mpmc]() {
+                                    long v = 0;
+                                    mpmc.try_pop(v);
+                                    return v;
+                                });
+    printf("%14.1f %14.1f %14.1f %14.1f\n", try_ns, uncontended(mpmc_push, mpmc_pop),
+           uncontended(ring_push, ring_pop), uncontended(cv_push, cv_pop));
+
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    printf("\nhandoff, Mitems/s\n");
+    printf("%8s %14s %14s %14s %14s\n", "threads", "spsc", "condvar 1:1", "mpmc", "condvar");
+    for (size_t t = 1; t <= max_threads; t *= 2) {
+        printf("%8zu %14.2f %14.2f %14.2f %14.2f\n", t, handoff(1, 1, ring_push, ring_pop),
+               handoff(1, 1, cv_push, cv_pop), handoff(t, t, mpmc_push, mpmc_pop), handoff(t, t, cv_push, cv_pop));
+    }
+    return 0;
+}
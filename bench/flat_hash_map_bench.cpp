@@ -0,0 +1,116 @@
+#include <chrono>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+#include "akl/flat_hash_map.hpp"
+
+/* single-threaded flat_hash_map against std::unordered_map on a million
+ * random 64 bit keys: insert, successful and failed lookups, erase */
+
+namespace {
+
+typedef unsigned long long u64;
+
+const size_t entries = 1000000;
+
+struct std_map {
+    std::unordered_map<u64, u64> map;
+
+    void insert(u64 k, u64 v) {
+        map.emplace(k, v);
+    }
+
+    bool find(u64 k, u64& v) {
+        auto it = map.find(k);
+        if (it == map.end()) {
+            return false;
+        }
+        v = it->second;
+        return true;
+    }
+
+    void erase(u64 k) {
+        map.erase(k);
+    }
+};
+
+struct akl_map {
+    akl::flat_hash_map<u64, u64> map;
+
+    void insert(u64 k, u64 v) {
+        map.insert(k, v);
+    }
+
+    bool find(u64 k, u64& v) {
+        u64* p = map.find(k);
+        if (!p) {
+            return false;
+        }
+        v = *p;
+        return true;
+    }
+
+    void erase(u64 k) {
+        map.erase(k);
+    }
+};
+
+template <typename Fn>
+double ns_per_op(Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / entries;
+}
+
+template <typename Map>
+void run(const char* name, const std::vector<u64>& keys, const std::vector<u64>& misses) {
+    Map m;
+    u64 sum = 0;
+    double insert = ns_per_op([&] {
+        for (u64 k : keys) {
+            m.insert(k, k);
+        }
+    });
+    double hit = ns_per_op([&] {
+        for (u64 k : keys) {
+            u64 v;
+            if (m.find(k, v)) {
+                sum += v;
+            }
+        }
+    });
+    double miss = ns_per_op([&] {
+        for (u64 k : misses) {
+            u64 v;
+            if (m.find(k, v)) {
+                sum += v;
+            }
+        }
+    });
+    double erase = ns_per_op([&] {
+        for (u64 k : keys) {
+            m.erase(k);
+        }
+    });
+    printf("%-18s %10.1f %10.1f %10.1f %10.1f   (%llu)\n", name, insert, hit, miss, erase, (unsigned long long)(sum & 0xff));
+}
+
+}  // namespace
+
+int main() {
+    std::vector<u64> keys(entries);
+    std::vector<u64> misses(entries);
+    u64 state = 0x9e3779b97f4a7c15ULL;
+    for (size_t i = 0; i < entries; ++i) {
+        // odd keys are inserted, even ones are looked up and never found
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        keys[i] = state | 1;
+        misses[i] = state & ~1ULL;
+    }
+    printf("%-18s %10s %10s %10s %10s\n", "ns/op", "insert", "hit", "miss", "erase");
+    run<akl_map>("akl::flat_hash_map", keys, misses);
+    run<std_map>("std::unordered_map", keys, misses);
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+#include "akl/atomic.hpp"
+#include "akl/function.hpp"
+#include "akl/thread_pool.hpp"
+
+/* type erased task callables: std::function against akl::function for
+ * captures of 8 to 128 bytes, first through a plain task queue on one
+ * thread, then as the task submitted to akl::thread_pool */
+
+namespace {
+
+const size_t queue_tasks = size_t(1) << 20;
+const size_t batch = 1024;
+const size_t pool_tasks = size_t(1) << 17;
+
+akl::atomic<int> sink;
+
+template <size_t Bytes>
+struct capture {
+    unsigned char bytes[Bytes];
+};
+
+template <size_t Bytes>
+struct task_body {
+    capture<Bytes> state;
+
+    void operator()() {
+        if (state.bytes[0] == 0xff) {
+            sink.inc();
+        }
+    }
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//! ns per task to wrap it, move it into a queue, run it and destroy it
+template <typename Function, size_t Bytes>
+double run_queue() {
+    std::vector<Function> queue;
+    queue.reserve(batch);
+    task_body<Bytes> body = {};
+    auto start = std::chrono::steady_clock::now();
+    for (size_t done = 0; done < queue_tasks; done += batch) {
+        for (size_t i = 0; i < batch; ++i) {
+            body.state.bytes[1] = (unsigned char)i;
+            queue.emplace_back(Function(body));
+        }
+        for (auto& fn : queue) {
+            fn();
+        }
+        queue.clear();
+    }
+    return seconds_since(start) * 1e9 / queue_tasks;
+}
+
+//! Mtasks/s launched from outside the pool, the body wrapped in "Function"
+template <typename Function, size_t Bytes>
+double run_pool(akl::thread_pool& pool) {
+    task_body<Bytes> body = {};
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < pool_tasks; ++i) {
+        body.state.bytes[1] = (unsigned char)i;
+        Function fn(body);
+        pool.launch([fn = std::move(fn)]() mutable { fn(); });
+    }
+    pool.join();
+    return double(pool_tasks) / seconds_since(start) / 1e6;
+}
+
+template <size_t Bytes>
+void row(akl::thread_pool& pool) {
+    typedef std::function<void()> std_fn;
+    typedef akl::function<void(), 64> akl_fn;
+    double q_std = run_queue<std_fn, Bytes>();
+    double q_akl = run_queue<akl_fn, Bytes>();
+    // the pool stores its tasks in akl::function, wrapping std::function
+    // adds the std::function construction on top
+    double p_std = run_pool<std_fn, Bytes>(pool);
+    double p_akl = run_pool<akl_fn, Bytes>(pool);
+    printf("%8zu %14.1f %14.1f %14.2f %14.2f\n", Bytes, q_std, q_akl, p_std, p_akl);
+}
+
+}  // namespace
+
+int main() {
+    akl::thread_pool pool(2);
+    printf("%8s %14s %14s %14s %14s\n", "capture", "queue std", "queue akl", "pool std", "pool akl");
+    printf("%8s %14s %14s %14s %14s\n", "bytes", "ns/task", "ns/task", "Mtasks/s", "Mtasks/s");
+    row<8>(pool);
+    row<32>(pool);
+    row<64>(pool);
+    row<128>(pool);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "akl/future.hpp"
+#include "akl/thread_pool.hpp"
+
+/* getting results out of akl::thread_pool tasks: akl::future against the
+ * previous pattern of a result variable, a mutex and a condition
+ * variable per task, for single round trips, fan-out/fan-in of many
+ * tasks, and chains of dependent steps */
+
+namespace {
+
+const size_t round_trips = 20000;
+const size_t fan_out = size_t(1) << 16;
+const size_t chain_length = 20000;
+
+//! the previous way: the task fills the box and signals under the lock
+struct result_box {
+    std::mutex mut;
+    std::condition_variable cond;
+    bool ready = false;
+    long value = 0;
+
+    void set(long v) {
+        std::lock_guard<std::mutex> lock(mut);
+        value = v;
+        ready = true;
+        cond.notify_one();
+    }
+
+    long get() {
+        std::unique_lock<std::mutex> lock(mut);
+        while (!ready) {
+            cond.wait(lock);
+        }
+        return value;
+    }
+};
+
+inline long compute(long i) {
+    return i * 3 + 1;
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//! us per launch-and-wait of one task from outside the pool
+double round_trip_future(akl::thread_pool& pool) {
+    long sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < round_trips; ++i) {
+        sum += akl::async(pool, [i] { return compute(i); }).get();
+    }
+    double us = seconds_since(start) * 1e6 / round_trips;
+    return sum ? us : 0;
+}
+
+double round_trip_box(akl::thread_pool& pool) {
+    long sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < round_trips; ++i) {
+        result_box box;
+        result_box* b = &box;
+        pool.launch([b, i] { b->set(compute(i)); });
+        sum += box.get();
+    }
+    double us = seconds_since(start) * 1e6 / round_trips;
+    return sum ? us : 0;
+}
+
+//! ns per task when many tasks are launched and all results gathered
+double fan_future(akl::thread_pool& pool) {
+    auto start = std::chrono::steady_clock::now();
+    akl::vector<akl::future<long> > futures;
+    for (size_t i = 0; i < fan_out; ++i) {
+        futures.push_back(akl::async(pool, [i] { return compute(i); }));
+    }
+    akl::vector<long> values = akl::when_all(akl::move(futures)).get();
+    double ns = seconds_since(start) * 1e9 / fan_out;
+    return values.size() == fan_out ? ns : 0;
+}
+
+double fan_box(akl::thread_pool& pool) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<result_box>> boxes;
+    for (size_t i = 0; i < fan_out; ++i) {
+        boxes.emplace_back(new result_box());
+        result_box* b = boxes.back().get();
+        pool.launch([b, i] { b->set(compute(i)); });
+    }
+    long sum = 0;
+    for (auto& b : boxes) {
+        sum += b->get();
+    }
+    double ns = seconds_since(start) * 1e9 / fan_out;
+    return sum ? ns : 0;
+}
+
+//! ns per step of a chain where every step needs the previous result
+double chain_future(akl::thread_pool& pool) {
+    auto start = std::chrono::steady_clock::now();
+    akl::future<long> f = akl::async(pool, [] { return 0L; });
+    for (size_t i = 0; i < chain_length; ++i) {
+        f = f.then(pool, [](long v) { return compute(v) & 0xffff; });
+    }
+    long v = f.get();
+    double ns = seconds_since(start) * 1e9 / chain_length;
+    return v >= 0 ? ns : 0;
+}
+
+double chain_box(akl::thread_pool& pool) {
+    auto start = std::chrono::steady_clock::now();
+    long v = 0;
+    for (size_t i = 0; i < chain_length; ++i) {
+        result_box box;
+        result_box* b = &box;
+        pool.launch([b, v] { b->set(compute(v) & 0xffff); });
+        v = box.get();
+    }
+    double ns = seconds_since(start) * 1e9 / chain_length;
+    return v >= 0 ? ns : 0;
+}
+
+}  // namespace
+
+int main() {
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    printf("%8s %14s %14s %14s %14s %14s %14s\n", "threads", "trip future", "trip mutex", "fan future",
+           "fan mutex", "chain future", "chain mutex");
+    printf("%8s %14s %14s %14s %14s %14s %14s\n", "", "us", "us", "ns/task", "ns/task", "ns/step", "ns/step");
+    for (size_t t = 1; t <= max_threads; t *= 2) {
+        akl::thread_pool pool(t);
+        printf("%8zu %14.2f %14.2f %14.1f %14.1f %14.1f %14.1f\n", t, round_trip_future(pool), round_trip_box(pool),
+               fan_future(pool), fan_box(pool), chain_future(pool), chain_box(pool));
+    }
+    return 0;
+}
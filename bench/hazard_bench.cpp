@@ -0,0 +1,157 @@
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "akl/epoch.hpp"
+#include "akl/hazard.hpp"
+
+/* one writer keeps replacing a shared object while readers read it and
+ * one reader stalls inside its read section for the whole run: writer
+ * throughput, reader throughput and peak unreclaimed memory for
+ * hazard_domain against epoch */
+
+namespace {
+
+const size_t replacements = 200000;
+const size_t readers = 2;
+
+struct config {
+    static akl::atomic<size_t> live;
+
+    size_t generation;
+    size_t payload[15];
+
+    explicit config(size_t g)
+        : generation(g) {
+        live.inc();
+        for (size_t i = 0; i < 15; ++i) {
+            payload[i] = g + i;
+        }
+    }
+
+    ~config() {
+        live.dec();
+    }
+};
+
+akl::atomic<size_t> config::live;
+
+struct hazard_scheme {
+    akl::hazard_domain domain;
+
+    struct reader {
+        akl::hazard_domain::holder h;
+
+        explicit reader(hazard_scheme& s)
+            : h(s.domain) {}
+
+        config* enter(akl::atomic<config*>& src) {
+            return h.protect(src);
+        }
+
+        void exit() {
+            h.reset();
+        }
+    };
+
+    void retire(config* c) {
+        domain.retire(c);
+    }
+};
+
+struct epoch_scheme {
+    akl::epoch domain;
+
+    struct reader {
+        akl::epoch& d;
+        akl::epoch::reader_token token;
+
+        explicit reader(epoch_scheme& s)
+            : d(s.domain) {}
+
+        config* enter(akl::atomic<config*>& src) {
+            token = d.enter();
+            return src.load_acquire();
+        }
+
+        void exit() {
+            d.exit(token);
+        }
+    };
+
+    void retire(config* c) {
+        domain.retire(c);
+    }
+};
+
+template <typename Scheme>
+void run(const char* name) {
+    Scheme scheme;
+    akl::atomic<config*> shared(new config(0));
+    akl::atomic<int> done;
+    akl::atomic<int> stalled;
+    akl::atomic<size_t> reads;
+    size_t base = config::live.load_acquire();
+
+    std::thread staller([&] {
+        typename Scheme::reader r(scheme);
+        config* c = r.enter(shared);
+        stalled.store_release(1);
+        while (!done.load_acquire()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (c->generation == ~size_t(0)) {
+            printf("unreachable\n");
+        }
+        r.exit();
+    });
+    while (!stalled.load_acquire()) {
+        std::this_thread::yield();
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < readers; ++t) {
+        threads.emplace_back([&] {
+            typename Scheme::reader r(scheme);
+            size_t n = 0;
+            size_t sum = 0;
+            while (!done.load_acquire()) {
+                config* c = r.enter(shared);
+                sum += c->payload[c->generation % 15];
+                r.exit();
+                ++n;
+            }
+            reads.inc_ret_last(n + (sum == 1));
+        });
+    }
+
+    size_t peak = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t g = 1; g <= replacements; ++g) {
+        config* old = shared.load_acquire();
+        shared.store_release(new config(g));
+        scheme.retire(old);
+        peak = akl::max(peak, config::live.load_acquire() - base);
+    }
+    auto stop = std::chrono::steady_clock::now();
+    done.store_release(1);
+    for (auto& thr : threads) {
+        thr.join();
+    }
+    staller.join();
+    delete shared.load_acquire();
+
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    printf("%-8s %16.2f %16.2f %14zu %12.2f\n", name, replacements / seconds / 1e6,
+           reads.load_acquire() / seconds / 1e6, peak, peak * sizeof(config) / 1048576.0);
+}
+
+}  // namespace
+
+int main() {
+    printf("%-8s %16s %16s %14s %12s\n", "scheme", "writes Mops/s", "reads Mops/s", "peak objects", "peak MiB");
+    run<hazard_scheme>("hazard");
+    run<epoch_scheme>("epoch");
+    return 0;
+}
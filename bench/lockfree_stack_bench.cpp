@@ -0,0 +1,118 @@
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "akl/lockfree_stack.hpp"
+#include "akl/mutex.hpp"
+#include "akl/vector.hpp"
+
+/* free list churn: every thread pops a node and pushes it back, on
+ * intrusive_lockfree_stack, lockfree_stack and an akl::vector guarded by
+ * one akl::mutex */
+
+namespace {
+
+const size_t ops_per_thread = size_t(1) << 21;
+const size_t prefill = 1024;
+
+struct item : akl::lockfree_stack_hook {
+    size_t value;
+};
+
+struct intrusive_pool {
+    akl::intrusive_lockfree_stack<item> stack;
+    std::vector<item> nodes;
+
+    intrusive_pool()
+        : nodes(prefill) {
+        for (item& n : nodes) {
+            stack.push(&n);
+        }
+    }
+
+    void churn() {
+        item* n = stack.pop();
+        if (n) {
+            ++n->value;
+            stack.push(n);
+        }
+    }
+};
+
+struct value_pool {
+    akl::lockfree_stack<size_t> stack;
+
+    value_pool() {
+        for (size_t i = 0; i < prefill; ++i) {
+            stack.push(i);
+        }
+    }
+
+    void churn() {
+        size_t v;
+        if (stack.try_pop(v)) {
+            stack.push(v + 1);
+        }
+    }
+};
+
+struct locked_pool {
+    akl::vector<size_t> stack;
+    akl::mutex mut;
+
+    locked_pool() {
+        for (size_t i = 0; i < prefill; ++i) {
+            stack.push_back(i);
+        }
+    }
+
+    void churn() {
+        mut.lock();
+        size_t v = stack.back();
+        stack.pop_back();
+        mut.unlock();
+        mut.lock();
+        stack.push_back(v + 1);
+        mut.unlock();
+    }
+};
+
+template <typename Pool>
+double run(size_t threads) {
+    Pool pool;
+    std::vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&pool] {
+            for (size_t i = 0; i < ops_per_thread; ++i) {
+                pool.churn();
+            }
+        });
+    }
+    for (auto& thr : workers) {
+        thr.join();
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    return double(ops_per_thread * threads) / seconds / 1e6;
+}
+
+}  // namespace
+
+int main() {
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    printf("%10s %20s %20s %20s\n", "threads", "intrusive Mops/s", "value Mops/s", "mutex Mops/s");
+    for (size_t t = 1; t <= max_threads; t *= 2) {
+        double intrusive = run<intrusive_pool>(t);
+        double value = run<value_pool>(t);
+        double locked = run<locked_pool>(t);
+        printf("%10zu %20.1f %20.1f %20.1f\n", t, intrusive, value, locked);
+    }
+    return 0;
+}
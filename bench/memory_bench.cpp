@@ -0,0 +1,68 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "akl/kern_lib.h"
+
+/* copy bandwidth of akl_cmemcpy against glibc memcpy and "rep movsb"
+ * for sizes from 8 B to 64 MiB */
+
+namespace {
+
+using copy_fn = void* (*)(void*, const void*, size_t);
+
+void* glibc_copy(void* dst, const void* src, size_t len) {
+    return memcpy(dst, src, len);
+}
+
+void* rep_movsb_copy(void* dst, const void* src, size_t len) {
+#if defined(__x86_64__) || defined(__i386__)
+    void* ret = dst;
+    __asm__ volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(len) : : "memory");
+    return ret;
+#else
+    return memcpy(dst, src, len);
+#endif
+}
+
+double bandwidth(copy_fn fn, unsigned char* dst, const unsigned char* src, size_t len) {
+    // keep every measurement around 64 MiB of traffic, at least 4 rounds
+    size_t rounds = (size_t(64) << 20) / len;
+    if (rounds < 4) {
+        rounds = 4;
+    }
+    fn(dst, src, len);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < rounds; ++i) {
+        fn(dst, src, len);
+        __asm__ volatile("" : : "r"(dst) : "memory");
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    return double(len) * double(rounds) / seconds / 1e9;
+}
+
+}  // namespace
+
+int main() {
+    const size_t max_len = size_t(64) << 20;
+    auto* src = static_cast<unsigned char*>(aligned_alloc(64, max_len));
+    auto* dst = static_cast<unsigned char*>(aligned_alloc(64, max_len));
+    memset(src, 0x5a, max_len);
+    memset(dst, 0, max_len);
+
+    printf("%12s %14s %14s %14s\n", "size", "akl GB/s", "glibc GB/s", "movsb GB/s");
+    for (size_t len = 8; len <= max_len; len *= 2) {
+        double akl_bw = bandwidth(akl_cmemcpy, dst, src, len);
+        double glibc_bw = bandwidth(glibc_copy, dst, src, len);
+        double movsb_bw = bandwidth(rep_movsb_copy, dst, src, len);
+        printf("%12zu %14.2f %14.2f %14.2f\n", len, akl_bw, glibc_bw, movsb_bw);
+    }
+
+    free(src);
+    free(dst);
+    return 0;
+}
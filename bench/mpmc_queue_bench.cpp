@@ -0,0 +1,134 @@
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include "akl/mpmc_queue.hpp"
+#include "akl/mutex.hpp"
+
+/* bounded queue throughput over a producer x consumer grid: mpmc_queue
+ * (single and batched operations) against a std::deque guarded by one
+ * akl::mutex */
+
+namespace {
+
+const size_t total_items = size_t(1) << 22;
+const size_t capacity = 1024;
+const size_t batch = 32;
+
+struct locked_queue {
+    std::deque<size_t> items;
+    akl::mutex mut;
+
+    bool try_push(size_t v) {
+        mut.lock();
+        bool ok = items.size() < capacity;
+        if (ok) {
+            items.push_back(v);
+        }
+        mut.unlock();
+        return ok;
+    }
+
+    bool try_pop(size_t& v) {
+        mut.lock();
+        bool ok = !items.empty();
+        if (ok) {
+            v = items.front();
+            items.pop_front();
+        }
+        mut.unlock();
+        return ok;
+    }
+};
+
+struct single_ops {
+    template <typename Queue>
+    static size_t push(Queue& q, const size_t* items, size_t) {
+        return q.try_push(items[0]) ? 1 : 0;
+    }
+
+    template <typename Queue>
+    static size_t pop(Queue& q, size_t* out, size_t) {
+        return q.try_pop(out[0]) ? 1 : 0;
+    }
+};
+
+struct batch_ops {
+    template <typename Queue>
+    static size_t push(Queue& q, const size_t* items, size_t n) {
+        return q.try_push_batch(items, n);
+    }
+
+    template <typename Queue>
+    static size_t pop(Queue& q, size_t* out, size_t n) {
+        return q.try_pop_batch(out, n);
+    }
+};
+
+template <typename Queue, typename Ops>
+double run(Queue& q, size_t producers, size_t consumers) {
+    size_t per_producer = total_items / producers;
+    size_t total = per_producer * producers;
+    akl::atomic<size_t> consumed;
+    std::vector<std::thread> threads;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&q, per_producer] {
+            size_t items[batch];
+            for (size_t i = 0; i < batch; ++i) {
+                items[i] = i;
+            }
+            size_t sent = 0;
+            while (sent < per_producer) {
+                size_t n = Ops::push(q, items, akl::min(batch, per_producer - sent));
+                if (n == 0) {
+                    std::this_thread::yield();
+                }
+                sent += n;
+            }
+        });
+    }
+    for (size_t c = 0; c < consumers; ++c) {
+        threads.emplace_back([&q, &consumed, total] {
+            size_t out[batch];
+            while (consumed.load_acquire() < total) {
+                size_t n = Ops::pop(q, out, batch);
+                if (n == 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                consumed.inc_ret_last(n);
+            }
+        });
+    }
+    for (auto& thr : threads) {
+        thr.join();
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    return double(total) / seconds / 1e6;
+}
+
+}  // namespace
+
+int main() {
+    const size_t counts[] = {1, 2, 4};
+    printf("%10s %10s %16s %16s %16s\n", "producers", "consumers", "mpmc Mops/s", "batch Mops/s",
+           "mutex Mops/s");
+    for (size_t p : counts) {
+        for (size_t c : counts) {
+            akl::mpmc_queue<size_t> single(capacity);
+            akl::mpmc_queue<size_t> batched(capacity);
+            locked_queue locked;
+            double lockfree = run<akl::mpmc_queue<size_t>, single_ops>(single, p, c);
+            double batch_rate = run<akl::mpmc_queue<size_t>, batch_ops>(batched, p, c);
+            double mutex_rate = run<locked_queue, single_ops>(locked, p, c);
+            printf("%10zu %10zu %16.1f %16.1f %16.1f\n", p, c, lockfree, batch_rate, mutex_rate);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "akl/parallel_for.hpp"
+
+/* scaling of parallel_for and parallel_reduce over pool sizes: a memory
+ * bound stream triad and sum, and a compute bound per element kernel,
+ * each against the plain sequential loop */
+
+namespace {
+
+const size_t stream_len = size_t(1) << 23;
+const size_t compute_len = size_t(1) << 16;
+const size_t stream_grain = 16384;
+const size_t compute_grain = 64;
+const int repeats = 5;
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//! best of "repeats" runs, in milliseconds
+template <typename Run>
+double best_ms(Run run) {
+    double best = 1e30;
+    for (int r = 0; r < repeats; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        double ms = seconds_since(start) * 1e3;
+        best = ms < best ? ms : best;
+    }
+    return best;
+}
+
+//! a few hundred flops with a data dependent result
+inline double heavy(size_t i) {
+    double x = double(i) * 1e-3;
+    for (int k = 0; k < 200; ++k) {
+        x = std::sin(x) * 0.5 + std::sqrt(x + 1.0);
+    }
+    return x;
+}
+
+}  // namespace
+
+int main() {
+    std::vector<double> a(stream_len), b(stream_len, 1.0), c(stream_len, 2.0);
+    std::vector<double> out(compute_len);
+    double* pa = a.data();
+    const double* pb = b.data();
+    const double* pc = c.data();
+    double* po = out.data();
+
+    double seq_triad = best_ms([&] {
+        for (size_t i = 0; i < stream_len; ++i) {
+            pa[i] = pb[i] + 3.0 * pc[i];
+        }
+    });
+    volatile double seq_sum_result = 0;
+    double seq_sum = best_ms([&] {
+        double s = 0;
+        for (size_t i = 0; i < stream_len; ++i) {
+            s += pa[i];
+        }
+        seq_sum_result = s;
+    });
+    double seq_compute = best_ms([&] {
+        for (size_t i = 0; i < compute_len; ++i) {
+            po[i] = heavy(i);
+        }
+    });
+
+    printf("sequential: triad %.2f ms, sum %.2f ms, compute %.2f ms\n\n", seq_triad, seq_sum, seq_compute);
+    printf("%8s %12s %9s %12s %9s %12s %9s\n", "threads", "triad ms", "speedup", "sum ms", "speedup", "compute ms",
+           "speedup");
+
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    for (size_t t = 1; t <= max_threads; t *= 2) {
+        akl::thread_pool pool(t);
+        double triad = best_ms([&] {
+            akl::parallel_for(pool, size_t(0), stream_len, stream_grain,
+                              [=](size_t i) { pa[i] = pb[i] + 3.0 * pc[i]; });
+        });
+        volatile double sum_result = 0;
+        double sum = best_ms([&] {
+            sum_result = akl::parallel_reduce(
+                pool, size_t(0), stream_len, stream_grain, 0.0, [=](size_t i, double& acc) { acc += pa[i]; },
+                [](double x, double y) { return x + y; });
+        });
+        double compute = best_ms([&] {
+            akl::parallel_for(pool, size_t(0), compute_len, compute_grain, [=](size_t i) { po[i] = heavy(i); });
+        });
+        printf("%8zu %12.2f %9.2f %12.2f %9.2f %12.2f %9.2f\n", t, triad, seq_triad / triad, sum, seq_sum / sum,
+               compute, seq_compute / compute);
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "akl/atomic.hpp"
+#include "akl/thread_pool.hpp"
+
+/* task latency while an autoscaler keeps resizing the pool: a steady
+ * stream of tasks from an outside thread, timed from the intended launch
+ * until the task starts, with no resizing, with thread_pool::resize(),
+ * and with the previous stop-everything resize (join the pool, destroy
+ * it and start a new one of the new size) */
+
+namespace {
+
+const size_t samples_per_run = 20000;
+const auto launch_interval = std::chrono::microseconds(20);
+const auto resize_interval = std::chrono::microseconds(500);
+
+akl::atomic<int> sink;
+
+//! a few microseconds of work per task, so resizes find work in flight
+inline void task_work() {
+    unsigned x = 1;
+    for (int i = 0; i < 1024; ++i) {
+        x = x * 1664525u + 1013904223u;
+    }
+    if (x == 0) {
+        sink.inc();
+    }
+}
+
+enum resize_mode { no_resize, incremental_resize, rebuild_resize };
+
+struct result {
+    double median;
+    double p99;
+    double max;
+    size_t resizes;
+};
+
+result run(resize_mode mode, size_t max_threads) {
+    std::unique_ptr<akl::thread_pool> pool(new akl::thread_pool(max_threads, false, max_threads));
+    std::mutex pool_lock;
+    std::vector<double> samples(samples_per_run);
+    std::atomic<bool> done(false);
+    size_t resizes = 0;
+
+    std::thread resizer([&] {
+        size_t n = max_threads;
+        while (mode != no_resize && !done.load()) {
+            std::this_thread::sleep_for(resize_interval);
+            n = n > 1 ? n / 2 : max_threads;
+            if (mode == incremental_resize) {
+                pool->resize(n);
+            } else {
+                std::lock_guard<std::mutex> lock(pool_lock);
+                pool->join();
+                pool.reset(new akl::thread_pool(n, false, max_threads));
+            }
+            ++resizes;
+        }
+    });
+
+    auto next = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < samples_per_run; ++i) {
+        while (std::chrono::steady_clock::now() < next) {
+            std::this_thread::yield();
+        }
+        auto submitted = next;
+        next += launch_interval;
+        double* out = &samples[i];
+        std::lock_guard<std::mutex> lock(pool_lock);
+        pool->launch([submitted, out] {
+            *out = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - submitted).count();
+            task_work();
+        });
+    }
+    done.store(true);
+    resizer.join();
+    pool->join();
+
+    std::sort(samples.begin(), samples.end());
+    result r = {samples[samples.size() / 2], samples[samples.size() * 99 / 100], samples.back(), resizes};
+    return r;
+}
+
+}  // namespace
+
+int main() {
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    const char* names[] = {"steady", "resize()", "rebuild"};
+    printf("%10s %10s %12s %12s %12s %10s\n", "resizing", "threads", "p50 us", "p99 us", "max us", "resizes");
+    for (int mode = no_resize; mode <= rebuild_resize; ++mode) {
+        result r = run((resize_mode)mode, max_threads);
+        printf("%10s %10zu %12.1f %12.1f %12.1f %10zu\n", names[mode], max_threads, r.median, r.p99, r.max, r.resizes);
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "akl/mpmc_queue.hpp"
+#include "akl/spsc_ring.hpp"
+
+/* one producer, one consumer: throughput of spsc_ring with single items,
+ * batches and in-place reserve/commit against mpmc_queue, then the round
+ * trip latency of a ping-pong over two rings */
+
+namespace {
+
+const size_t total_items = size_t(1) << 24;
+const size_t capacity = 4096;
+const size_t batch = 64;
+const size_t round_trips = 100000;
+
+template <typename Queue>
+void push_one(Queue& q, size_t v) {
+    while (!q.try_push(v)) {
+        std::this_thread::yield();
+    }
+}
+
+template <typename Queue>
+size_t pop_one(Queue& q) {
+    size_t v;
+    while (!q.try_pop(v)) {
+        std::this_thread::yield();
+    }
+    return v;
+}
+
+template <typename Produce, typename Consume>
+double throughput(Produce produce, Consume consume) {
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer(produce);
+    size_t sum = consume();
+    producer.join();
+    auto stop = std::chrono::steady_clock::now();
+
+    if (sum != total_items * (total_items - 1) / 2) {
+        printf("checksum mismatch\n");
+    }
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    return double(total_items) / seconds / 1e6;
+}
+
+template <typename Queue>
+double run_single() {
+    Queue q(capacity);
+    return throughput(
+        [&q] {
+            for (size_t i = 0; i < total_items; ++i) {
+                push_one(q, i);
+            }
+        },
+        [&q] {
+            size_t sum = 0;
+            for (size_t i = 0; i < total_items; ++i) {
+                sum += pop_one(q);
+            }
+            return sum;
+        });
+}
+
+template <typename Queue>
+double run_batch() {
+    Queue q(capacity);
+    return throughput(
+        [&q] {
+            size_t items[batch];
+            size_t sent = 0;
+            while (sent < total_items) {
+                size_t n = std::min(batch, total_items - sent);
+                for (size_t i = 0; i < n; ++i) {
+                    items[i] = sent + i;
+                }
+                size_t pushed = q.try_push_batch(items, n);
+                if (pushed == 0) {
+                    std::this_thread::yield();
+                }
+                sent += pushed;
+            }
+        },
+        [&q] {
+            size_t out[batch];
+            size_t sum = 0;
+            size_t received = 0;
+            while (received < total_items) {
+                size_t n = q.try_pop_batch(out, batch);
+                if (n == 0) {
+                    std::this_thread::yield();
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    sum += out[i];
+                }
+                received += n;
+            }
+            return sum;
+        });
+}
+
+double run_in_place() {
+    akl::spsc_ring<size_t> q(capacity);
+    return throughput(
+        [&q] {
+            size_t sent = 0;
+            while (sent < total_items) {
+                size_t n = std::min(batch, total_items - sent);
+                size_t* slots = q.reserve(n);
+                if (n == 0) {
+                    std::this_thread::yield();
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    slots[i] = sent + i;
+                }
+                q.commit(n);
+                sent += n;
+            }
+        },
+        [&q] {
+            size_t sum = 0;
+            size_t received = 0;
+            while (received < total_items) {
+                size_t n = batch;
+                const size_t* items = q.peek(n);
+                if (n == 0) {
+                    std::this_thread::yield();
+                }
+                for (size_t i = 0; i < n; ++i) {
+                    sum += items[i];
+                }
+                q.consume(n);
+                received += n;
+            }
+            return sum;
+        });
+}
+
+template <typename Queue>
+void latency(const char* name) {
+    Queue ping(capacity);
+    Queue pong(capacity);
+    std::vector<double> samples(round_trips);
+
+    std::thread echo([&ping, &pong] {
+        for (size_t i = 0; i < round_trips; ++i) {
+            push_one(pong, pop_one(ping));
+        }
+    });
+    for (size_t i = 0; i < round_trips; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        push_one(ping, i);
+        pop_one(pong);
+        auto stop = std::chrono::steady_clock::now();
+        samples[i] = std::chrono::duration<double, std::nano>(stop - start).count();
+    }
+    echo.join();
+
+    std::sort(samples.begin(), samples.end());
+    printf("%-12s %12.0f %12.0f %12.0f\n", name, samples[round_trips / 2],
+           samples[round_trips * 99 / 100], samples[round_trips - 1]);
+}
+
+}  // namespace
+
+int main() {
+    printf("%-24s %12s\n", "throughput", "Mops/s");
+    printf("%-24s %12.1f\n", "spsc single", run_single<akl::spsc_ring<size_t>>());
+    printf("%-24s %12.1f\n", "spsc batch", run_batch<akl::spsc_ring<size_t>>());
+    printf("%-24s %12.1f\n", "spsc reserve/commit", run_in_place());
+    printf("%-24s %12.1f\n", "mpmc single", run_single<akl::mpmc_queue<size_t>>());
+    printf("%-24s %12.1f\n", "mpmc batch", run_batch<akl::mpmc_queue<size_t>>());
+
+    printf("\n%-12s %12s %12s %12s\n", "round trip", "p50 ns", "p99 ns", "max ns");
+    latency<akl::spsc_ring<size_t>>("spsc");
+    latency<akl::mpmc_queue<size_t>>("mpmc");
+    return 0;
+}
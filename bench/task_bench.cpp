@@ -0,0 +1,133 @@
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "akl/atomic.hpp"
+#include "akl/async_mutex.hpp"
+#include "akl/task.hpp"
+#include "akl/thread_pool.hpp"
+
+/* switching cost of akl::task coroutines: awaiting a child task
+ * (symmetric transfer plus a pooled frame), hopping onto the pool with
+ * schedule_on(), and passing an async_mutex between coroutines, against
+ * the thread_pool::launch plus join round trip that the same sequential
+ * steps cost without coroutines */
+
+namespace {
+
+const size_t steps = size_t(1) << 16;
+const size_t streams = 64;
+
+akl::atomic<int> sink;
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+akl::task<size_t> child(size_t i) {
+    co_return i + 1;
+}
+
+akl::task<size_t> await_chain() {
+    size_t sum = 0;
+    for (size_t i = 0; i < steps; ++i) {
+        sum += co_await child(i);
+    }
+    co_return sum;
+}
+
+akl::task<void> hop_chain(akl::thread_pool& pool, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        co_await akl::schedule_on(pool);
+    }
+    sink.inc();
+}
+
+//! "streams" coroutines hopping at once, awaited in turn
+akl::task<void> hop_streams(akl::thread_pool& pool) {
+    std::vector<akl::task<void>> running;
+    for (size_t s = 0; s < streams; ++s) {
+        running.push_back(hop_chain(pool, steps / streams));
+    }
+    for (auto& t : running) {
+        co_await t;
+    }
+}
+
+akl::task<void> locker(akl::thread_pool& pool, akl::async_mutex& mut, size_t& counter, size_t count) {
+    co_await akl::schedule_on(pool);
+    for (size_t i = 0; i < count; ++i) {
+        akl::async_mutex_lock guard = co_await mut.scoped_lock();
+        ++counter;
+    }
+}
+
+akl::task<void> lock_streams(akl::thread_pool& pool, akl::async_mutex& mut, size_t& counter) {
+    std::vector<akl::task<void>> running;
+    for (size_t s = 0; s < streams; ++s) {
+        running.push_back(locker(pool, mut, counter, steps / streams));
+    }
+    for (auto& t : running) {
+        co_await t;
+    }
+}
+
+//! ns per co_await of a child task that returns at once
+double run_await() {
+    auto start = std::chrono::steady_clock::now();
+    size_t sum = akl::sync_wait(await_chain());
+    double ns = seconds_since(start) * 1e9 / steps;
+    return sum ? ns : 0;
+}
+
+//! ns per schedule_on() hop of one coroutine
+double run_hop(akl::thread_pool& pool) {
+    auto start = std::chrono::steady_clock::now();
+    akl::sync_wait(hop_chain(pool, steps));
+    return seconds_since(start) * 1e9 / steps;
+}
+
+//! ns per hop, "streams" coroutines hopping concurrently
+double run_hop_streams(akl::thread_pool& pool) {
+    auto start = std::chrono::steady_clock::now();
+    akl::sync_wait(hop_streams(pool));
+    return seconds_since(start) * 1e9 / steps;
+}
+
+//! ns per locked increment, "streams" coroutines on one async_mutex
+double run_lock(akl::thread_pool& pool) {
+    akl::async_mutex mut;
+    size_t counter = 0;
+    auto start = std::chrono::steady_clock::now();
+    akl::sync_wait(lock_streams(pool, mut, counter));
+    double ns = seconds_since(start) * 1e9 / steps;
+    return counter == steps ? ns : 0;
+}
+
+//! ns per sequential step run as launch() followed by join()
+double run_launch_join(akl::thread_pool& pool) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < steps; ++i) {
+        pool.launch([] { sink.inc(); });
+        pool.join();
+    }
+    return seconds_since(start) * 1e9 / steps;
+}
+
+}  // namespace
+
+int main() {
+    printf("co_await of a ready child task: %.1f ns\n", run_await());
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    printf("%8s %14s %14s %14s %14s\n", "threads", "hop ns", "64 hops ns", "mutex ns", "launch+join ns");
+    for (size_t t = 1; t <= max_threads; t *= 2) {
+        akl::thread_pool pool(t);
+        printf("%8zu %14.1f %14.1f %14.1f %14.1f\n", t, run_hop(pool), run_hop_streams(pool), run_lock(pool),
+               run_launch_join(pool));
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "akl/atomic.hpp"
+#include "akl/task_graph.hpp"
+#include "akl/thread_pool.hpp"
+
+/* running a layered DAG of uneven tasks: akl::task_graph, which starts
+ * every node once its own predecessors are done, against rounds of
+ * thread_pool::launch and join, one round per layer, where each round
+ * waits for its slowest task. The critical path printed first is the work
+ * of the slowest dependency chain, the best any schedule can do */
+
+namespace {
+
+const size_t width = 64;
+const size_t depth = 64;
+const size_t chain_length = 4096;
+const int repeats = 5;
+
+akl::atomic<long> sink;
+
+//! "units" of roughly 50 ns of arithmetic
+void work(unsigned units) {
+    unsigned long x = units;
+    for (unsigned i = 0; i < units * 16; ++i) {
+        x = x * 6364136223846793005UL + 1442695040888963407UL;
+    }
+    sink.inc((long)(x & 1));
+}
+
+//! work of node (layer, i), between 1 and 32 units, fixed per node
+unsigned node_units(size_t layer, size_t i) {
+    unsigned long h = (layer * 131 + i) * 0x9e3779b97f4a7c15UL;
+    return 1 + (unsigned)((h >> 40) % 32);
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//! node (l, i) needs (l - 1, i) and (l - 1, i + 1 mod width)
+void build_layers(akl::task_graph& graph) {
+    for (size_t l = 0; l < depth; ++l) {
+        for (size_t i = 0; i < width; ++i) {
+            unsigned units = node_units(l, i);
+            graph.add([units] { work(units); });
+            if (l > 0) {
+                graph.precede((l - 1) * width + i, l * width + i);
+                graph.precede((l - 1) * width + (i + 1) % width, l * width + i);
+            }
+        }
+    }
+}
+
+//! ms of work on the slowest path through the layers, run sequentially
+double critical_path_ms() {
+    std::vector<unsigned> path(width, 0);
+    std::vector<unsigned> next(width);
+    for (size_t l = 0; l < depth; ++l) {
+        for (size_t i = 0; i < width; ++i) {
+            unsigned before = l ? std::max(path[i], path[(i + 1) % width]) : 0;
+            next[i] = before + node_units(l, i);
+        }
+        path.swap(next);
+    }
+    unsigned units = 0;
+    for (unsigned p : path) {
+        units = std::max(units, p);
+    }
+    auto start = std::chrono::steady_clock::now();
+    work(units);
+    return seconds_since(start) * 1e3;
+}
+
+double layers_graph(akl::thread_pool& pool, akl::task_graph& graph) {
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        graph.run(pool);
+    }
+    return seconds_since(start) * 1e3 / repeats;
+}
+
+double layers_rounds(akl::thread_pool& pool) {
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        for (size_t l = 0; l < depth; ++l) {
+            for (size_t i = 0; i < width; ++i) {
+                unsigned units = node_units(l, i);
+                pool.launch([units] { work(units); });
+            }
+            pool.join();
+        }
+    }
+    return seconds_since(start) * 1e3 / repeats;
+}
+
+//! us per step of a chain of tiny dependent tasks
+double chain_graph(akl::thread_pool& pool) {
+    akl::task_graph graph;
+    for (size_t i = 0; i < chain_length; ++i) {
+        graph.add([] { work(1); });
+        if (i > 0) {
+            graph.precede(i - 1, i);
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    graph.run(pool);
+    return seconds_since(start) * 1e6 / chain_length;
+}
+
+double chain_rounds(akl::thread_pool& pool) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < chain_length; ++i) {
+        pool.launch([] { work(1); });
+        pool.join();
+    }
+    return seconds_since(start) * 1e6 / chain_length;
+}
+
+}  // namespace
+
+int main() {
+    akl::task_graph layers;
+    build_layers(layers);
+    printf("%zu x %zu layered DAG, critical path %.2f ms\n", depth, width, critical_path_ms());
+
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    printf("%8s %14s %14s %14s %14s\n", "threads", "graph ms", "rounds ms", "chain graph", "chain rounds");
+    printf("%8s %14s %14s %14s %14s\n", "", "", "", "us/step", "us/step");
+    for (size_t t = 1; t <= max_threads; t *= 2) {
+        akl::thread_pool pool(t);
+        printf("%8zu %14.2f %14.2f %14.2f %14.2f\n", t, layers_graph(pool, layers), layers_rounds(pool),
+               chain_graph(pool), chain_rounds(pool));
+    }
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include <pthread.h>
+
+#include <any>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "akl/thread_local_slot.hpp"
+
+/* per-thread counters bumped through akl::thread_local_slot against the
+ * previous thread::get_local(id) path (a pthread key leading to an
+ * unordered_map from slot id to a type erased any, rebuilt here on std
+ * types since the old header needs boost), and against a plain
+ * thread_local array as the floor */
+
+namespace {
+
+const size_t accesses_per_thread = size_t(1) << 24;
+
+//! the previous tls_data: one map per thread behind a pthread key
+class map_tls {
+    pthread_key_t key;
+
+    static void destroy(void* p) {
+        delete static_cast<std::unordered_map<size_t, std::any>*>(p);
+    }
+
+public:
+    map_tls() {
+        pthread_key_create(&key, &map_tls::destroy);
+    }
+
+    ~map_tls() {
+        pthread_key_delete(key);
+    }
+
+    std::any& get_local(size_t id) {
+        auto* data = static_cast<std::unordered_map<size_t, std::any>*>(pthread_getspecific(key));
+        if (!data) {
+            data = new std::unordered_map<size_t, std::any>();
+            pthread_setspecific(key, data);
+        }
+        return (*data)[id];
+    }
+};
+
+thread_local long native_counters[64];
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//! ns per access, every thread cycling over "slots" counters, a power of two
+template <typename Body>
+double run(size_t threads, Body body) {
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back(body);
+    }
+    for (auto& thr : workers) {
+        thr.join();
+    }
+    return seconds_since(start) * 1e9 / double(accesses_per_thread);
+}
+
+double run_slots(size_t threads, size_t slots) {
+    std::vector<std::unique_ptr<akl::thread_local_slot<long>>> counters;
+    for (size_t s = 0; s < slots; ++s) {
+        counters.emplace_back(new akl::thread_local_slot<long>(0));
+    }
+    return run(threads, [&counters, slots] {
+        for (size_t i = 0; i < accesses_per_thread; ++i) {
+            ++*counters[i & (slots - 1)]->local();
+        }
+    });
+}
+
+double run_map(size_t threads, size_t slots) {
+    map_tls tls;
+    return run(threads, [&tls, slots] {
+        for (size_t s = 0; s < slots; ++s) {
+            tls.get_local(s) = 0L;
+        }
+        for (size_t i = 0; i < accesses_per_thread; ++i) {
+            ++std::any_cast<long&>(tls.get_local(i & (slots - 1)));
+        }
+    });
+}
+
+double run_native(size_t threads, size_t slots) {
+    return run(threads, [slots] {
+        for (size_t i = 0; i < accesses_per_thread; ++i) {
+            ++native_counters[i & (slots - 1)];
+        }
+    });
+}
+
+}  // namespace
+
+int main() {
+    const size_t slot_counts[] = {1, 8, 64};
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    printf("%8s %8s %14s %14s %14s\n", "slots", "threads", "slot ns/op", "map ns/op", "native ns/op");
+    for (size_t slots : slot_counts) {
+        for (size_t t = 1; t <= max_threads; t *= 2) {
+            printf("%8zu %8zu %14.2f %14.2f %14.2f\n", slots, t, run_slots(t, slots), run_map(t, slots),
+                   run_native(t, slots));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "akl/atomic.hpp"
+#include "akl/thread_pool.hpp"
+
+/* task throughput and wakeup latency: the work stealing akl::thread_pool
+ * against the previous design (one std::function queue under a mutex and
+ * condition variable, with a global inserted/completed pair for join),
+ * rebuilt here on std primitives since the old header needs boost */
+
+namespace {
+
+class shared_queue_pool {
+    std::mutex mut;
+    std::condition_variable task_ready;
+    std::condition_variable all_done;
+    std::deque<std::function<void()>> queue;
+    std::vector<std::thread> threads;
+    size_t tasks_inserted = 0;
+    size_t tasks_completed = 0;
+    bool waiting_on_join = false;
+    bool stopping = false;
+
+    void wait_for_task() {
+        std::unique_lock<std::mutex> lock(mut);
+        while (true) {
+            while (queue.empty() && !stopping) {
+                task_ready.wait(lock);
+            }
+            if (queue.empty()) {
+                return;
+            }
+            std::function<void()> task = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+            ++tasks_completed;
+            if (waiting_on_join && tasks_completed == tasks_inserted) {
+                all_done.notify_one();
+            }
+        }
+    }
+
+public:
+    explicit shared_queue_pool(size_t nthreads) {
+        for (size_t i = 0; i < nthreads; ++i) {
+            threads.emplace_back([this] { wait_for_task(); });
+        }
+    }
+
+    ~shared_queue_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mut);
+            stopping = true;
+        }
+        task_ready.notify_all();
+        for (auto& thr : threads) {
+            thr.join();
+        }
+    }
+
+    void launch(const std::function<void()>& fn) {
+        std::lock_guard<std::mutex> lock(mut);
+        ++tasks_inserted;
+        queue.push_back(fn);
+        task_ready.notify_one();
+    }
+
+    void join() {
+        std::unique_lock<std::mutex> lock(mut);
+        waiting_on_join = true;
+        while (tasks_completed != tasks_inserted) {
+            all_done.wait(lock);
+        }
+        waiting_on_join = false;
+    }
+};
+
+const size_t flat_tasks = size_t(1) << 17;
+const size_t nested_roots = 64;
+const size_t nested_children = 2048;
+const size_t latency_samples = 2000;
+
+akl::atomic<int> sink;
+
+//! a few hundred nanoseconds of work per task
+inline void small_work() {
+    unsigned x = 1;
+    for (int i = 0; i < 64; ++i) {
+        x = x * 1664525u + 1013904223u;
+    }
+    if (x == 0) {
+        sink.inc();
+    }
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//! all tasks submitted by one outside thread
+template <typename Pool>
+double run_flat(size_t threads) {
+    Pool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < flat_tasks; ++i) {
+        pool.launch([] { small_work(); });
+    }
+    pool.join();
+    return double(flat_tasks) / seconds_since(start) / 1e6;
+}
+
+//! each root task launches its children from inside the pool
+template <typename Pool>
+double run_nested(size_t threads) {
+    Pool pool(threads);
+    Pool* p = &pool;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < nested_roots; ++i) {
+        pool.launch([p] {
+            for (size_t c = 0; c < nested_children; ++c) {
+                p->launch([] { small_work(); });
+            }
+        });
+    }
+    pool.join();
+    return double(nested_roots * (nested_children + 1)) / seconds_since(start) / 1e6;
+}
+
+//! time from launch() on an idle pool until the task starts, in microseconds
+template <typename Pool>
+void run_latency(size_t threads, double& median, double& p99) {
+    Pool pool(threads);
+    std::vector<double> samples;
+    for (size_t i = 0; i < latency_samples; ++i) {
+        // let the workers park
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        auto submitted = std::chrono::steady_clock::now();
+        double* out = &samples.emplace_back();
+        pool.launch([submitted, out] {
+            *out = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - submitted).count();
+        });
+        pool.join();
+    }
+    std::sort(samples.begin(), samples.end());
+    median = samples[samples.size() / 2];
+    p99 = samples[samples.size() * 99 / 100];
+}
+
+}  // namespace
+
+int main() {
+    size_t max_threads = std::thread::hardware_concurrency();
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    printf("%8s %16s %16s %16s %16s\n", "threads", "flat stealing", "flat shared", "nested stealing",
+           "nested shared");
+    printf("%8s %16s %16s %16s %16s\n", "", "Mtasks/s", "Mtasks/s", "Mtasks/s", "Mtasks/s");
+    for (size_t t = 1; t <= max_threads; t *= 2) {
+        double flat_ws = run_flat<akl::thread_pool>(t);
+        double flat_sq = run_flat<shared_queue_pool>(t);
+        double nested_ws = run_nested<akl::thread_pool>(t);
+        double nested_sq = run_nested<shared_queue_pool>(t);
+        printf("%8zu %16.2f %16.2f %16.2f %16.2f\n", t, flat_ws, flat_sq, nested_ws, nested_sq);
+    }
+
+    printf("\n%8s %16s %16s %16s %16s\n", "threads", "stealing p50 us", "stealing p99 us", "shared p50 us",
+           "shared p99 us");
+    for (size_t t = 1; t <= max_threads; t *= 2) {
+        double ws50, ws99, sq50, sq99;
+        run_latency<akl::thread_pool>(t, ws50, ws99);
+        run_latency<shared_queue_pool>(t, sq50, sq99);
+        printf("%8zu %16.1f %16.1f %16.1f %16.1f\n", t, ws50, ws99, sq50, sq99);
+    }
+    return 0;
+}
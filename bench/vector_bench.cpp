@@ -0,0 +1,67 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "akl/vector.hpp"
+
+/* push_back throughput of akl::vector and akl::small_vector against
+ * std::vector, for trivially relocatable and non-trivial elements */
+
+namespace {
+
+template <typename Fn>
+double mops(size_t ops, Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto stop = std::chrono::steady_clock::now();
+    return double(ops) / std::chrono::duration<double>(stop - start).count() / 1e6;
+}
+
+template <typename Vec, typename Make>
+double fill(size_t rounds, size_t len, Make make) {
+    size_t sink = 0;
+    double rate = mops(rounds * len, [&] {
+        for (size_t r = 0; r < rounds; ++r) {
+            Vec v;
+            for (size_t i = 0; i < len; ++i) {
+                v.push_back(make(i));
+            }
+            sink += v.size();
+        }
+    });
+    __asm__ volatile("" : : "r"(sink));
+    return rate;
+}
+
+size_t make_int(size_t i) {
+    return i;
+}
+
+std::string make_string(size_t i) {
+    // longer than the SSO buffer, so every element owns a heap block
+    return std::string(24, char('a' + i % 26));
+}
+
+}  // namespace
+
+int main() {
+    printf("%10s %10s %14s %14s %14s\n", "element", "length", "std Mops/s", "akl Mops/s", "small Mops/s");
+
+    const size_t lengths[] = {8, 64, 1024, 1 << 20};
+    for (size_t len : lengths) {
+        size_t rounds = (size_t(16) << 20) / len;
+        double std_rate = fill<std::vector<size_t>>(rounds, len, make_int);
+        double akl_rate = fill<akl::vector<size_t>>(rounds, len, make_int);
+        double small_rate = fill<akl::small_vector<size_t, 16>>(rounds, len, make_int);
+        printf("%10s %10zu %14.1f %14.1f %14.1f\n", "size_t", len, std_rate, akl_rate, small_rate);
+    }
+    for (size_t len : lengths) {
+        size_t rounds = (size_t(2) << 20) / len;
+        double std_rate = fill<std::vector<std::string>>(rounds, len, make_string);
+        double akl_rate = fill<akl::vector<std::string>>(rounds, len, make_string);
+        double small_rate = fill<akl::small_vector<std::string, 16>>(rounds, len, make_string);
+        printf("%10s %10zu %14.1f %14.1f %14.1f\n", "string", len, std_rate, akl_rate, small_rate);
+    }
+    return 0;
+}
@@ -1,83 +1,107 @@
 #include <linux/kernel.h>
-#include <linux/slab.h>
-#include <linux/string.h>
 #include <linux/atomic.h>
+#include <linux/version.h>
+#include <linux/rcupdate.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/wait_bit.h>
+#include <linux/cpumask.h>
+#include <linux/topology.h>
+#include <linux/cacheinfo.h>
+#include <linux/smp.h>
 
 #include "akl/kern_lib.h"
 
-/* memory */
+/* atomic */
 
-void akl_cmemset(void *dst, int c, unsigned int len)
+int akl_atomic_xchg(akl_atomic_t* v, int new_val)
 {
-    memset(dst, c, len);
+    return atomic_xchg((atomic_t *)v, new_val);
 }
 
-void *akl_cmemcpy(void *dst, void *src, unsigned int len)
+akl_atomic_float_t akl_atomic_xchg_float(akl_atomic_float_t* v, akl_atomic_float_t new_val)
 {
-    memcpy(dst, src, len);
-    return dst;
+    akl_u32* p = (akl_u32*)v;
+	akl_u32 res = atomic_xchg((atomic_t *)p, new_val.u);
+    return *(akl_atomic_float_t*)&res;
 }
 
-void *akl_cmemmove(void *dst, void *src, unsigned int len)
+akl_atomic_double_t akl_atomic_xchg_double(akl_atomic_double_t* v, akl_atomic_double_t new_val)
 {
-    memmove(dst, src, len);
-    return dst;
+    akl_u64* p = (akl_u64*)v;
+	akl_u64 res = atomic64_xchg((atomic64_t *)p, new_val.u);
+    return *(akl_atomic_double_t*)&res;
 }
 
-int akl_cmemcmp(void *p1, void *p2, unsigned int len)
+int akl_atomic_cmpxchg(akl_atomic_t *v, int old_val, int new_val)
 {
-    return memcmp(p1, p2, len);
+    return atomic_cmpxchg((atomic_t *)v, old_val, new_val);
 }
 
-void *akl_cmalloc(unsigned int size)
+int akl_atomic_add_return(int add_val, akl_atomic_t* v)
 {
-    return kmalloc(size, GFP_ATOMIC);
+    return atomic_add_return(add_val, (atomic_t *)v);
 }
 
-void *akl_crealloc(void *mem, unsigned int size)
+int akl_atomic_sub_return(int sub_val, akl_atomic_t* v)
 {
-    return krealloc(mem, size, GFP_ATOMIC);
+    return atomic_sub_return(sub_val, (atomic_t *)v);
 }
 
-void akl_cfree(void *mem)
+int akl_atomic_read_acquire(akl_atomic_t* v)
 {
-    kfree(mem);
+    return atomic_read_acquire((atomic_t *)v);
 }
 
-/* atomic */
+void akl_atomic_set_release(akl_atomic_t* v, int i)
+{
+    atomic_set_release((atomic_t *)v, i);
+}
 
-int akl_atomic_xchg(akl_atomic_t* v, int new_val)
+akl_u64 akl_atomic64_xchg(akl_atomic64_t* v, akl_u64 new_val)
 {
-    return atomic_xchg((atomic_t *)v, new_val);
+    return atomic64_xchg((atomic64_t *)v, new_val);
 }
 
-akl_atomic_float_t akl_atomic_xchg_float(akl_atomic_float_t* v, akl_atomic_float_t new_val)
+akl_u64 akl_atomic64_cmpxchg(akl_atomic64_t* v, akl_u64 old_val, akl_u64 new_val)
 {
-    akl_u32* p = (akl_u32*)v;
-	akl_u32 res = atomic_xchg((atomic_t *)p, new_val.u);
-    return *(akl_atomic_float_t*)&res;
+    return atomic64_cmpxchg((atomic64_t *)v, old_val, new_val);
 }
 
-akl_atomic_double_t akl_atomic_xchg_double(akl_atomic_double_t* v, akl_atomic_double_t new_val)
+akl_u64 akl_atomic64_add_return(akl_u64 add_val, akl_atomic64_t* v)
 {
-    akl_u64* p = (akl_u64*)v;
-	akl_u64 res = atomic64_xchg((atomic64_t *)p, new_val.u);
-    return *(akl_atomic_double_t*)&res;
+    return atomic64_add_return(add_val, (atomic64_t *)v);
 }
 
-int akl_atomic_cmpxchg(akl_atomic_t *v, int old_val, int new_val)
+akl_u64 akl_atomic64_sub_return(akl_u64 sub_val, akl_atomic64_t* v)
 {
-    return atomic_cmpxchg((atomic_t *)v, old_val, new_val);
+    return atomic64_sub_return(sub_val, (atomic64_t *)v);
 }
 
-int akl_atomic_add_return(int add_val, akl_atomic_t* v)
+akl_u64 akl_atomic64_read_acquire(akl_atomic64_t* v)
 {
-    return atomic_add_return(add_val, (atomic_t *)v);
+    return atomic64_read_acquire((atomic64_t *)v);
 }
 
-int akl_atomic_sub_return(int sub_val, akl_atomic_t* v)
+void akl_atomic64_set_release(akl_atomic64_t* v, akl_u64 i)
 {
-    return atomic_sub_return(sub_val, (atomic_t *)v);
+    atomic64_set_release((atomic64_t *)v, i);
+}
+
+int akl_atomic128_cmpxchg(akl_u128_t* v, akl_u128_t old_val, akl_u128_t new_val)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+    u128 old = ((u128)old_val.hi << 64) | old_val.lo;
+    u128 new = ((u128)new_val.hi << 64) | new_val.lo;
+    return try_cmpxchg128((u128 *)v, &old, new);
+#else
+    return cmpxchg_double(&v->lo, &v->hi, old_val.lo, old_val.hi, new_val.lo, new_val.hi);
+#endif
+}
+
+void akl_smp_mb(void)
+{
+    smp_mb();
 }
 
 int akl_atomic_cmpxchg_float(akl_atomic_float_t* ptr, akl_atomic_float_t oldv, akl_atomic_float_t newv) {
@@ -91,3 +115,109 @@ int akl_atomic_cmpxchg_double(akl_atomic_double_t* ptr, akl_atomic_double_t oldv
     akl_u64 prev = atomic64_cmpxchg((atomic64_t*)p, oldv.u, newv.u);
     return prev == oldv.u;
 }
+
+/* rcu */
+
+struct akl_rcu_node {
+    struct rcu_head head;
+    void* ptr;
+    void (*deleter)(void*);
+};
+
+void akl_rcu_read_lock(void)
+{
+    rcu_read_lock();
+}
+
+void akl_rcu_read_unlock(void)
+{
+    rcu_read_unlock();
+}
+
+static void akl_rcu_callback(struct rcu_head* head)
+{
+    struct akl_rcu_node* node = container_of(head, struct akl_rcu_node, head);
+    node->deleter(node->ptr);
+    kfree(node);
+}
+
+int akl_call_rcu(void* ptr, void (*deleter)(void*))
+{
+    struct akl_rcu_node* node = kmalloc(sizeof(*node), GFP_ATOMIC);
+    if (!node)
+        return -1;
+    node->ptr = ptr;
+    node->deleter = deleter;
+    call_rcu(&node->head, akl_rcu_callback);
+    return 0;
+}
+
+void akl_synchronize_rcu(void)
+{
+    synchronize_rcu();
+}
+
+void akl_rcu_barrier(void)
+{
+    rcu_barrier();
+}
+
+void akl_wait_var_event(volatile int* var, int expected)
+{
+    /* TASK_IDLE: idle pool workers sleep here for long, which must trip
+     * neither the hung task check nor the load average */
+    if (READ_ONCE(*var) != expected)
+        return;
+    (void)___wait_var_event((void*)var, READ_ONCE(*var) != expected,
+                            TASK_IDLE, 0, 0, schedule());
+}
+
+void akl_wake_up_var(volatile int* var)
+{
+    wake_up_var((void*)var);
+}
+
+void akl_cond_resched(void)
+{
+    cond_resched();
+}
+
+int akl_next_online_cpu(int cpu)
+{
+    unsigned int next = cpumask_next(cpu, cpu_online_mask);
+
+    return next < nr_cpu_ids ? (int)next : -1;
+}
+
+void akl_cpu_topology(int cpu, int* package, int* core, int* llc)
+{
+    *package = topology_physical_package_id(cpu);
+    *core = cpumask_first(topology_sibling_cpumask(cpu));
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 13, 0)
+    *llc = get_cpu_cacheinfo_id(cpu, 3);
+    if (*llc < 0)
+        *llc = *package;
+#else
+    *llc = *package;
+#endif
+}
+
+int akl_nr_cpu_ids(void)
+{
+    return nr_cpu_ids;
+}
+
+int akl_cpu_id(void)
+{
+    return raw_smp_processor_id();
+}
+
+int akl_get_cpu(void)
+{
+    return get_cpu();
+}
+
+void akl_put_cpu(void)
+{
+    put_cpu();
+}
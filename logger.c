@@ -13,7 +13,7 @@ void akl_kern_log(const char* fmt, ...) {
 #ifdef __KERNEL__
     vprintk(fmt, args);
 #else
-    printf(fmt, args);
+    vprintf(fmt, args);
 #endif
 
     va_end(args);
@@ -0,0 +1,662 @@
+#include "akl/alloc_profile.h"
+#include "akl/kern_lib.h"
+
+#ifdef __KERNEL_MODULE__
+#include <linux/slab.h>
+#include <linux/string.h>
+#else
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define AKL_MEM_X86 1
+#endif
+#endif
+
+#ifdef __KERNEL_MODULE__
+
+/* the kernel already ships tuned string routines, and vector registers
+ * are not usable here without kernel_fpu_begin() */
+
+void akl_memset(void* dst, int c, size_t len) {
+    memset(dst, c, len);
+}
+
+void* akl_cmemcpy(void* dst, const void* src, size_t len) {
+    return memcpy(dst, src, len);
+}
+
+void* akl_cmemmove(void* dst, const void* src, size_t len) {
+    return memmove(dst, src, len);
+}
+
+int akl_cmemcmp(const void* p1, const void* p2, size_t len) {
+    return memcmp(p1, p2, len);
+}
+
+#else
+
+/* small sizes: overlapping scalar moves, shared by every kernel */
+
+static inline void akl_mem_copy_small(unsigned char* d, const unsigned char* s, size_t len) {
+    if (len >= 8) {
+        akl_u64 head, tail;
+        __builtin_memcpy(&head, s, 8);
+        __builtin_memcpy(&tail, s + len - 8, 8);
+        __builtin_memcpy(d, &head, 8);
+        __builtin_memcpy(d + len - 8, &tail, 8);
+    } else if (len >= 4) {
+        akl_u32 head, tail;
+        __builtin_memcpy(&head, s, 4);
+        __builtin_memcpy(&tail, s + len - 4, 4);
+        __builtin_memcpy(d, &head, 4);
+        __builtin_memcpy(d + len - 4, &tail, 4);
+    } else if (len > 0) {
+        unsigned char first = s[0];
+        unsigned char mid = s[len / 2];
+        unsigned char last = s[len - 1];
+        d[0] = first;
+        d[len / 2] = mid;
+        d[len - 1] = last;
+    }
+}
+
+static inline void akl_mem_set_small(unsigned char* d, unsigned char c, size_t len) {
+    akl_u64 v = 0x0101010101010101ull * c;
+    if (len >= 8) {
+        __builtin_memcpy(d, &v, 8);
+        __builtin_memcpy(d + len - 8, &v, 8);
+    } else if (len >= 4) {
+        __builtin_memcpy(d, &v, 4);
+        __builtin_memcpy(d + len - 4, &v, 4);
+    } else if (len > 0) {
+        d[0] = c;
+        d[len / 2] = c;
+        d[len - 1] = c;
+    }
+}
+
+static inline int akl_mem_cmp_bytes(const unsigned char* a, const unsigned char* b, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (a[i] != b[i]) {
+            return (int)a[i] - (int)b[i];
+        }
+    }
+    return 0;
+}
+
+/* portable kernels */
+
+static void akl_memset_scalar(void* dst, int c, size_t len) {
+    memset(dst, c, len);
+}
+
+static void* akl_memcpy_scalar(void* dst, const void* src, size_t len) {
+    return memcpy(dst, src, len);
+}
+
+static void* akl_memmove_scalar(void* dst, const void* src, size_t len) {
+    return memmove(dst, src, len);
+}
+
+static int akl_memcmp_scalar(const void* p1, const void* p2, size_t len) {
+    return memcmp(p1, p2, len);
+}
+
+#ifdef AKL_MEM_X86
+
+//! Copies above this size bypass the cache with non-temporal stores
+static size_t akl_mem_nt_threshold = (size_t)8 << 20;
+
+/* SSE2 kernels */
+
+static void akl_memset_sse2(void* dst, int c, size_t len) {
+    unsigned char* d = (unsigned char*)dst;
+    if (len < 16) {
+        akl_mem_set_small(d, (unsigned char)c, len);
+        return;
+    }
+    __m128i v = _mm_set1_epi8((char)c);
+    _mm_storeu_si128((__m128i*)d, v);
+    _mm_storeu_si128((__m128i*)(d + len - 16), v);
+    if (len <= 32) {
+        return;
+    }
+    unsigned char* p = (unsigned char*)(((uintptr_t)d + 16) & ~(uintptr_t)15);
+    unsigned char* end = d + len - 16;
+    if (len >= akl_mem_nt_threshold) {
+        for (; p < end; p += 16) {
+            _mm_stream_si128((__m128i*)p, v);
+        }
+        _mm_sfence();
+    } else {
+        for (; p < end; p += 16) {
+            _mm_store_si128((__m128i*)p, v);
+        }
+    }
+}
+
+/* forward copy that tolerates dst < src overlap: head and tail are loaded
+ * before anything is written and every loop step loads before it stores */
+static void akl_copy_fwd_sse2(unsigned char* d, const unsigned char* s, size_t len, int nt) {
+    __m128i head = _mm_loadu_si128((const __m128i*)s);
+    __m128i tail = _mm_loadu_si128((const __m128i*)(s + len - 16));
+    size_t skip = 16 - ((uintptr_t)d & 15);
+    unsigned char* p = d + skip;
+    const unsigned char* q = s + skip;
+    size_t left = len - skip;
+    if (nt) {
+        for (; left > 64; left -= 64, p += 64, q += 64) {
+            __m128i a = _mm_loadu_si128((const __m128i*)q);
+            __m128i b = _mm_loadu_si128((const __m128i*)(q + 16));
+            __m128i e = _mm_loadu_si128((const __m128i*)(q + 32));
+            __m128i f = _mm_loadu_si128((const __m128i*)(q + 48));
+            _mm_stream_si128((__m128i*)p, a);
+            _mm_stream_si128((__m128i*)(p + 16), b);
+            _mm_stream_si128((__m128i*)(p + 32), e);
+            _mm_stream_si128((__m128i*)(p + 48), f);
+        }
+        _mm_sfence();
+    }
+    for (; left > 64; left -= 64, p += 64, q += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*)q);
+        __m128i b = _mm_loadu_si128((const __m128i*)(q + 16));
+        __m128i e = _mm_loadu_si128((const __m128i*)(q + 32));
+        __m128i f = _mm_loadu_si128((const __m128i*)(q + 48));
+        _mm_store_si128((__m128i*)p, a);
+        _mm_store_si128((__m128i*)(p + 16), b);
+        _mm_store_si128((__m128i*)(p + 32), e);
+        _mm_store_si128((__m128i*)(p + 48), f);
+    }
+    for (; left > 16; left -= 16, p += 16, q += 16) {
+        _mm_store_si128((__m128i*)p, _mm_loadu_si128((const __m128i*)q));
+    }
+    _mm_storeu_si128((__m128i*)d, head);
+    _mm_storeu_si128((__m128i*)(d + len - 16), tail);
+}
+
+//! mirror of akl_copy_fwd_sse2 for dst > src overlap
+static void akl_copy_bwd_sse2(unsigned char* d, const unsigned char* s, size_t len) {
+    __m128i head = _mm_loadu_si128((const __m128i*)s);
+    __m128i tail = _mm_loadu_si128((const __m128i*)(s + len - 16));
+    size_t skip = (uintptr_t)(d + len) & 15;
+    if (skip == 0) {
+        skip = 16;
+    }
+    unsigned char* p = d + len - skip;
+    const unsigned char* q = s + len - skip;
+    size_t left = len - skip;
+    for (; left > 64; left -= 64) {
+        p -= 64;
+        q -= 64;
+        __m128i a = _mm_loadu_si128((const __m128i*)(q + 48));
+        __m128i b = _mm_loadu_si128((const __m128i*)(q + 32));
+        __m128i e = _mm_loadu_si128((const __m128i*)(q + 16));
+        __m128i f = _mm_loadu_si128((const __m128i*)q);
+        _mm_store_si128((__m128i*)(p + 48), a);
+        _mm_store_si128((__m128i*)(p + 32), b);
+        _mm_store_si128((__m128i*)(p + 16), e);
+        _mm_store_si128((__m128i*)p, f);
+    }
+    for (; left > 16; left -= 16) {
+        p -= 16;
+        q -= 16;
+        _mm_store_si128((__m128i*)p, _mm_loadu_si128((const __m128i*)q));
+    }
+    _mm_storeu_si128((__m128i*)d, head);
+    _mm_storeu_si128((__m128i*)(d + len - 16), tail);
+}
+
+static void* akl_memcpy_sse2(void* dst, const void* src, size_t len) {
+    unsigned char* d = (unsigned char*)dst;
+    const unsigned char* s = (const unsigned char*)src;
+    if (len < 16) {
+        akl_mem_copy_small(d, s, len);
+    } else if (len <= 32) {
+        __m128i head = _mm_loadu_si128((const __m128i*)s);
+        __m128i tail = _mm_loadu_si128((const __m128i*)(s + len - 16));
+        _mm_storeu_si128((__m128i*)d, head);
+        _mm_storeu_si128((__m128i*)(d + len - 16), tail);
+    } else {
+        akl_copy_fwd_sse2(d, s, len, len >= akl_mem_nt_threshold);
+    }
+    return dst;
+}
+
+static void* akl_memmove_sse2(void* dst, const void* src, size_t len) {
+    unsigned char* d = (unsigned char*)dst;
+    const unsigned char* s = (const unsigned char*)src;
+    if (len <= 32) {
+        return akl_memcpy_sse2(dst, src, len);
+    }
+    if ((uintptr_t)d - (uintptr_t)s < len) {
+        akl_copy_bwd_sse2(d, s, len);
+    } else {
+        /* streaming only pays off when source and destination are disjoint */
+        int disjoint = (uintptr_t)s - (uintptr_t)d >= len;
+        akl_copy_fwd_sse2(d, s, len, disjoint && len >= akl_mem_nt_threshold);
+    }
+    return dst;
+}
+
+static int akl_memcmp_sse2(const void* p1, const void* p2, size_t len) {
+    const unsigned char* a = (const unsigned char*)p1;
+    const unsigned char* b = (const unsigned char*)p2;
+    if (len < 16) {
+        return akl_mem_cmp_bytes(a, b, len);
+    }
+    size_t i = 0;
+    for (;; i += 16) {
+        if (i + 16 > len) {
+            /* overlapping last block, bytes before it already compared equal */
+            i = len - 16;
+        }
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ 0xffffu;
+        if (mask) {
+            size_t at = i + __builtin_ctz(mask);
+            return (int)a[at] - (int)b[at];
+        }
+        if (i + 16 == len) {
+            return 0;
+        }
+    }
+}
+
+/* AVX2 kernels */
+
+__attribute__((target("avx2"))) static void akl_memset_avx2(void* dst, int c, size_t len) {
+    unsigned char* d = (unsigned char*)dst;
+    if (len < 32) {
+        akl_memset_sse2(dst, c, len);
+        return;
+    }
+    __m256i v = _mm256_set1_epi8((char)c);
+    _mm256_storeu_si256((__m256i*)d, v);
+    _mm256_storeu_si256((__m256i*)(d + len - 32), v);
+    if (len <= 64) {
+        return;
+    }
+    unsigned char* p = (unsigned char*)(((uintptr_t)d + 32) & ~(uintptr_t)31);
+    unsigned char* end = d + len - 32;
+    if (len >= akl_mem_nt_threshold) {
+        for (; p < end; p += 32) {
+            _mm256_stream_si256((__m256i*)p, v);
+        }
+        _mm_sfence();
+    } else {
+        for (; p < end; p += 32) {
+            _mm256_store_si256((__m256i*)p, v);
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static void akl_copy_fwd_avx2(
+    unsigned char* d, const unsigned char* s, size_t len, int nt
+) {
+    __m256i head = _mm256_loadu_si256((const __m256i*)s);
+    __m256i tail = _mm256_loadu_si256((const __m256i*)(s + len - 32));
+    size_t skip = 32 - ((uintptr_t)d & 31);
+    unsigned char* p = d + skip;
+    const unsigned char* q = s + skip;
+    size_t left = len - skip;
+    if (nt) {
+        for (; left > 128; left -= 128, p += 128, q += 128) {
+            __m256i a = _mm256_loadu_si256((const __m256i*)q);
+            __m256i b = _mm256_loadu_si256((const __m256i*)(q + 32));
+            __m256i e = _mm256_loadu_si256((const __m256i*)(q + 64));
+            __m256i f = _mm256_loadu_si256((const __m256i*)(q + 96));
+            _mm256_stream_si256((__m256i*)p, a);
+            _mm256_stream_si256((__m256i*)(p + 32), b);
+            _mm256_stream_si256((__m256i*)(p + 64), e);
+            _mm256_stream_si256((__m256i*)(p + 96), f);
+        }
+        _mm_sfence();
+    }
+    for (; left > 128; left -= 128, p += 128, q += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)q);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(q + 32));
+        __m256i e = _mm256_loadu_si256((const __m256i*)(q + 64));
+        __m256i f = _mm256_loadu_si256((const __m256i*)(q + 96));
+        _mm256_store_si256((__m256i*)p, a);
+        _mm256_store_si256((__m256i*)(p + 32), b);
+        _mm256_store_si256((__m256i*)(p + 64), e);
+        _mm256_store_si256((__m256i*)(p + 96), f);
+    }
+    for (; left > 32; left -= 32, p += 32, q += 32) {
+        _mm256_store_si256((__m256i*)p, _mm256_loadu_si256((const __m256i*)q));
+    }
+    _mm256_storeu_si256((__m256i*)d, head);
+    _mm256_storeu_si256((__m256i*)(d + len - 32), tail);
+}
+
+__attribute__((target("avx2"))) static void akl_copy_bwd_avx2(
+    unsigned char* d, const unsigned char* s, size_t len
+) {
+    __m256i head = _mm256_loadu_si256((const __m256i*)s);
+    __m256i tail = _mm256_loadu_si256((const __m256i*)(s + len - 32));
+    size_t skip = (uintptr_t)(d + len) & 31;
+    if (skip == 0) {
+        skip = 32;
+    }
+    unsigned char* p = d + len - skip;
+    const unsigned char* q = s + len - skip;
+    size_t left = len - skip;
+    for (; left > 128; left -= 128) {
+        p -= 128;
+        q -= 128;
+        __m256i a = _mm256_loadu_si256((const __m256i*)(q + 96));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(q + 64));
+        __m256i e = _mm256_loadu_si256((const __m256i*)(q + 32));
+        __m256i f = _mm256_loadu_si256((const __m256i*)q);
+        _mm256_store_si256((__m256i*)(p + 96), a);
+        _mm256_store_si256((__m256i*)(p + 64), b);
+        _mm256_store_si256((__m256i*)(p + 32), e);
+        _mm256_store_si256((__m256i*)p, f);
+    }
+    for (; left > 32; left -= 32) {
+        p -= 32;
+        q -= 32;
+        _mm256_store_si256((__m256i*)p, _mm256_loadu_si256((const __m256i*)q));
+    }
+    _mm256_storeu_si256((__m256i*)d, head);
+    _mm256_storeu_si256((__m256i*)(d + len - 32), tail);
+}
+
+__attribute__((target("avx2"))) static void* akl_memcpy_avx2(void* dst, const void* src, size_t len) {
+    unsigned char* d = (unsigned char*)dst;
+    const unsigned char* s = (const unsigned char*)src;
+    if (len <= 32) {
+        akl_memcpy_sse2(dst, src, len);
+    } else if (len <= 64) {
+        __m256i head = _mm256_loadu_si256((const __m256i*)s);
+        __m256i tail = _mm256_loadu_si256((const __m256i*)(s + len - 32));
+        _mm256_storeu_si256((__m256i*)d, head);
+        _mm256_storeu_si256((__m256i*)(d + len - 32), tail);
+    } else {
+        akl_copy_fwd_avx2(d, s, len, len >= akl_mem_nt_threshold);
+    }
+    return dst;
+}
+
+__attribute__((target("avx2"))) static void* akl_memmove_avx2(void* dst, const void* src, size_t len) {
+    unsigned char* d = (unsigned char*)dst;
+    const unsigned char* s = (const unsigned char*)src;
+    if (len <= 64) {
+        return akl_memcpy_avx2(dst, src, len);
+    }
+    if ((uintptr_t)d - (uintptr_t)s < len) {
+        akl_copy_bwd_avx2(d, s, len);
+    } else {
+        int disjoint = (uintptr_t)s - (uintptr_t)d >= len;
+        akl_copy_fwd_avx2(d, s, len, disjoint && len >= akl_mem_nt_threshold);
+    }
+    return dst;
+}
+
+__attribute__((target("avx2"))) static int akl_memcmp_avx2(const void* p1, const void* p2, size_t len) {
+    const unsigned char* a = (const unsigned char*)p1;
+    const unsigned char* b = (const unsigned char*)p2;
+    if (len < 32) {
+        return akl_memcmp_sse2(p1, p2, len);
+    }
+    size_t i = 0;
+    for (;; i += 32) {
+        if (i + 32 > len) {
+            i = len - 32;
+        }
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+        if (mask) {
+            size_t at = i + __builtin_ctz(mask);
+            return (int)a[at] - (int)b[at];
+        }
+        if (i + 32 == len) {
+            return 0;
+        }
+    }
+}
+
+/* CPUID probing */
+
+static int akl_cpu_has_avx2(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    /* the OS must save the ymm state, otherwise AVX faults */
+    if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) {
+        return 0;
+    }
+    unsigned int xcr0_lo, xcr0_hi;
+    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 0x6) != 0x6) {
+        return 0;
+    }
+    if (__get_cpuid_max(0, NULL) < 7) {
+        return 0;
+    }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & bit_AVX2) != 0;
+}
+
+static int akl_cpu_has_sse2(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+    return (edx & bit_SSE2) != 0;
+}
+
+//! Walks the deterministic cache parameters leaf, returns the largest cache
+static size_t akl_cpu_llc_size(void) {
+    unsigned int eax, ebx, ecx, edx;
+    unsigned int leaf = 4;
+    __cpuid(0, eax, ebx, ecx, edx);
+    /* "AuthenticAMD" and "HygonGenuine" report caches in an extended leaf */
+    if (ebx == 0x68747541 || ebx == 0x6f677948) {
+        if (__get_cpuid_max(0x80000000, NULL) < 0x8000001d) {
+            return 0;
+        }
+        leaf = 0x8000001d;
+    } else if (eax < 4) {
+        return 0;
+    }
+
+    size_t llc = 0;
+    for (unsigned int sub = 0; sub < 16; ++sub) {
+        __cpuid_count(leaf, sub, eax, ebx, ecx, edx);
+        if ((eax & 0x1f) == 0) {
+            break;
+        }
+        size_t ways = ((ebx >> 22) & 0x3ff) + 1;
+        size_t partitions = ((ebx >> 12) & 0x3ff) + 1;
+        size_t line = (ebx & 0xfff) + 1;
+        size_t sets = (size_t)ecx + 1;
+        size_t size = ways * partitions * line * sets;
+        if (size > llc) {
+            llc = size;
+        }
+    }
+    return llc;
+}
+
+#endif  // AKL_MEM_X86
+
+/* runtime dispatch: every entry starts at a resolver that installs the
+ * best kernel for this cpu on first use */
+
+static void akl_mem_resolve(void);
+
+static void akl_memset_init(void* dst, int c, size_t len);
+static void* akl_memcpy_init(void* dst, const void* src, size_t len);
+static void* akl_memmove_init(void* dst, const void* src, size_t len);
+static int akl_memcmp_init(const void* p1, const void* p2, size_t len);
+
+static void (*volatile akl_memset_impl)(void*, int, size_t) = akl_memset_init;
+static void* (*volatile akl_memcpy_impl)(void*, const void*, size_t) = akl_memcpy_init;
+static void* (*volatile akl_memmove_impl)(void*, const void*, size_t) = akl_memmove_init;
+static int (*volatile akl_memcmp_impl)(const void*, const void*, size_t) = akl_memcmp_init;
+
+static void akl_mem_resolve(void) {
+    /* racing resolvers all store the same values, so no lock is needed */
+    void (*set)(void*, int, size_t) = akl_memset_scalar;
+    void* (*cpy)(void*, const void*, size_t) = akl_memcpy_scalar;
+    void* (*mov)(void*, const void*, size_t) = akl_memmove_scalar;
+    int (*cmp)(const void*, const void*, size_t) = akl_memcmp_scalar;
+#ifdef AKL_MEM_X86
+    size_t llc = akl_cpu_llc_size();
+    if (llc != 0) {
+        akl_mem_nt_threshold = llc;
+    }
+    if (akl_cpu_has_avx2()) {
+        set = akl_memset_avx2;
+        cpy = akl_memcpy_avx2;
+        mov = akl_memmove_avx2;
+        cmp = akl_memcmp_avx2;
+    } else if (akl_cpu_has_sse2()) {
+        set = akl_memset_sse2;
+        cpy = akl_memcpy_sse2;
+        mov = akl_memmove_sse2;
+        cmp = akl_memcmp_sse2;
+    }
+#endif
+    akl_memset_impl = set;
+    akl_memcpy_impl = cpy;
+    akl_memmove_impl = mov;
+    akl_memcmp_impl = cmp;
+}
+
+static void akl_memset_init(void* dst, int c, size_t len) {
+    akl_mem_resolve();
+    akl_memset_impl(dst, c, len);
+}
+
+static void* akl_memcpy_init(void* dst, const void* src, size_t len) {
+    akl_mem_resolve();
+    return akl_memcpy_impl(dst, src, len);
+}
+
+static void* akl_memmove_init(void* dst, const void* src, size_t len) {
+    akl_mem_resolve();
+    return akl_memmove_impl(dst, src, len);
+}
+
+static int akl_memcmp_init(const void* p1, const void* p2, size_t len) {
+    akl_mem_resolve();
+    return akl_memcmp_impl(p1, p2, len);
+}
+
+void akl_memset(void* dst, int c, size_t len) {
+    akl_memset_impl(dst, c, len);
+}
+
+void* akl_cmemcpy(void* dst, const void* src, size_t len) {
+    return akl_memcpy_impl(dst, src, len);
+}
+
+void* akl_cmemmove(void* dst, const void* src, size_t len) {
+    return akl_memmove_impl(dst, src, len);
+}
+
+int akl_cmemcmp(const void* p1, const void* p2, size_t len) {
+    return akl_memcmp_impl(p1, p2, len);
+}
+
+#endif
+
+/* allocation */
+
+#ifdef __KERNEL_MODULE__
+static inline void* akl_backend_malloc(size_t size) {
+    return kmalloc(size, GFP_ATOMIC);
+}
+
+static inline void* akl_backend_realloc(void* mem, size_t size) {
+    return krealloc(mem, size, GFP_ATOMIC);
+}
+
+static inline void akl_backend_free(void* mem) {
+    kfree(mem);
+}
+#else
+static inline void* akl_backend_malloc(size_t size) {
+    return malloc(size);
+}
+
+static inline void* akl_backend_realloc(void* mem, size_t size) {
+    return realloc(mem, size);
+}
+
+static inline void akl_backend_free(void* mem) {
+    free(mem);
+}
+#endif
+
+#ifdef AKL_ALLOC_PROFILE
+
+/* profiled blocks remember their size in a header, 16 bytes keep the
+ * returned pointer aligned the way the backend aligns its blocks */
+#define AKL_ALLOC_HEADER 16
+
+void* akl_cmalloc_from(size_t size, void* site) {
+    unsigned char* raw = (unsigned char*)akl_backend_malloc(size + AKL_ALLOC_HEADER);
+    if (!raw) {
+        return NULL;
+    }
+    *(size_t*)raw = size;
+    akl_alloc_profile_on_alloc(size, site);
+    return raw + AKL_ALLOC_HEADER;
+}
+
+void* akl_cmalloc(size_t size) {
+    return akl_cmalloc_from(size, __builtin_return_address(0));
+}
+
+void* akl_crealloc(void* mem, size_t size) {
+    if (!mem) {
+        return akl_cmalloc_from(size, __builtin_return_address(0));
+    }
+    if (size == 0) {
+        akl_cfree(mem);
+        return NULL;
+    }
+    unsigned char* raw = (unsigned char*)mem - AKL_ALLOC_HEADER;
+    size_t old_size = *(size_t*)raw;
+    raw = (unsigned char*)akl_backend_realloc(raw, size + AKL_ALLOC_HEADER);
+    if (!raw) {
+        return NULL;
+    }
+    *(size_t*)raw = size;
+    akl_alloc_profile_on_free(old_size);
+    akl_alloc_profile_on_alloc(size, __builtin_return_address(0));
+    return raw + AKL_ALLOC_HEADER;
+}
+
+void akl_cfree(void* mem) {
+    if (!mem) {
+        return;
+    }
+    unsigned char* raw = (unsigned char*)mem - AKL_ALLOC_HEADER;
+    akl_alloc_profile_on_free(*(size_t*)raw);
+    akl_backend_free(raw);
+}
+
+#else
+
+void* akl_cmalloc(size_t size) {
+    return akl_backend_malloc(size);
+}
+
+void* akl_crealloc(void* mem, size_t size) {
+    return akl_backend_realloc(mem, size);
+}
+
+void akl_cfree(void* mem) {
+    akl_backend_free(mem);
+}
+
+#endif
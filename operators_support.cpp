@@ -1,14 +1,22 @@
+#include "akl/alloc_profile.h"
 #include "akl/kern_lib.h"
 #include "akl/logger.h"
 
 #include <cstddef>
 
+#ifdef AKL_ALLOC_PROFILE
+// attribute allocations to the caller of new, not to this file
+#define AKL_NEW_ALLOC(sz) akl_cmalloc_from(sz, __builtin_return_address(0))
+#else
+#define AKL_NEW_ALLOC(sz) akl_cmalloc(sz)
+#endif
+
 void* operator new(size_t sz) throw() {
-    return akl_cmalloc(sz);
+    return AKL_NEW_ALLOC(sz);
 }
 
 void* operator new[](size_t sz) throw() {
-    return akl_cmalloc(sz);
+    return AKL_NEW_ALLOC(sz);
 }
 
 void operator delete(void* p) {
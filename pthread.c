@@ -1,15 +1,40 @@
+#ifndef __KERNEL_MODULE__
+/* cpu_set_t and pthread_attr_setaffinity_np */
+#define _GNU_SOURCE
+#endif
+
 #include "akl/pthread.h"
+#include "akl/kern_lib.h"
 
 #ifdef __KERNEL_MODULE__
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/err.h>
+#include <linux/hash.h>
+#include <linux/kthread.h>
 #include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/sched/task.h>
+#include <linux/wait.h>
 #else
 #include <assert.h>
+#include <linux/futex.h>
 #include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef __KERNEL_MODULE__
+_Static_assert(sizeof(struct mutex) <= sizeof(akl_pthread_mutex_t), "akl_pthread_mutex_t is too small");
+_Static_assert(sizeof(wait_queue_head_t) <= sizeof(akl_wait_queue_t), "akl_wait_queue_t is too small");
+#else
+_Static_assert(sizeof(pthread_mutex_t) <= sizeof(akl_pthread_mutex_t), "akl_pthread_mutex_t is too small");
 #endif
 
 int akl_pthread_mutex_init(akl_pthread_mutex_t* mutex, void*) {
 #ifdef __KERNEL_MODULE__
-    mutex_init((struct mutex*)&mutex);
+    mutex_init((struct mutex*)mutex);
     return 0;
 #else
     return pthread_mutex_init((pthread_mutex_t*)mutex, NULL);
@@ -18,35 +43,243 @@ int akl_pthread_mutex_init(akl_pthread_mutex_t* mutex, void*) {
 
 int akl_pthread_mutex_destroy(akl_pthread_mutex_t* mutex) {
 #ifdef __KERNEL_MODULE__
-    mutex_destroy((struct mutex*)&mutex);
+    mutex_destroy((struct mutex*)mutex);
     return 0;
 #else
-    return pthread_mutex_destroy((pthread_mutex_t*)&mutex);
+    return pthread_mutex_destroy((pthread_mutex_t*)mutex);
 #endif
 }
 
 int akl_pthread_mutex_lock(akl_pthread_mutex_t* mutex) {
 #ifdef __KERNEL_MODULE__
-    mutex_lock((struct mutex*)&mutex);
+    mutex_lock((struct mutex*)mutex);
     return 0;
 #else
-    return pthread_mutex_lock((pthread_mutex_t*)&mutex);
+    return pthread_mutex_lock((pthread_mutex_t*)mutex);
 #endif
 }
 
 int akl_pthread_mutex_unlock(akl_pthread_mutex_t* mutex) {
 #ifdef __KERNEL_MODULE__
-    mutex_unlock((struct mutex*)&mutex);
+    mutex_unlock((struct mutex*)mutex);
     return 0;
 #else
-    return pthread_mutex_unlock((pthread_mutex_t*)&mutex);
+    return pthread_mutex_unlock((pthread_mutex_t*)mutex);
 #endif
 }
 
 int akl_pthread_mutex_trylock(akl_pthread_mutex_t* mutex) {
 #ifdef __KERNEL_MODULE__
-    return mutex_trylock((struct mutex*)&mutex) ? 0 : 1;
+    return mutex_trylock((struct mutex*)mutex) ? 0 : 1;
+#else
+    return pthread_mutex_trylock((pthread_mutex_t*)mutex);
+#endif
+}
+
+/* threads */
+
+struct akl_thread {
+    void (*fn)(void*);
+    void* arg;
+#ifdef __KERNEL_MODULE__
+    struct task_struct* task;
+    /* completed once the thread knows whether it has a slot */
+    struct completion started;
+    int has_slot;
+    /* completed once fn has returned, see akl_thread_join() */
+    struct completion done;
+#else
+    pthread_t thread;
+#endif
+};
+
+#ifdef __KERNEL_MODULE__
+
+/* akl_thread_slot() storage: the threads of akl_thread_create claim an
+ * entry near the hash of their task_struct, others find none */
+#define AKL_THREAD_TABLE_BITS 10
+#define AKL_THREAD_PROBES 16
+#define AKL_THREAD_FREED ((struct task_struct*)1)
+
+struct akl_thread_entry {
+    struct task_struct* task;
+    void* slot;
+};
+
+static struct akl_thread_entry akl_thread_table[1 << AKL_THREAD_TABLE_BITS];
+
+static struct akl_thread_entry* akl_thread_entry_at(unsigned int hash, unsigned int probe) {
+    return &akl_thread_table[(hash + probe) & ((1 << AKL_THREAD_TABLE_BITS) - 1)];
+}
+
+/* NULL if all the probes of the calling thread are taken */
+static struct akl_thread_entry* akl_thread_claim(void) {
+    unsigned int hash = hash_ptr(current, AKL_THREAD_TABLE_BITS);
+    unsigned int i;
+    for (i = 0; i < AKL_THREAD_PROBES; ++i) {
+        struct akl_thread_entry* e = akl_thread_entry_at(hash, i);
+        struct task_struct* task = READ_ONCE(e->task);
+        if ((task == NULL || task == AKL_THREAD_FREED) && cmpxchg(&e->task, task, current) == task) {
+            e->slot = NULL;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static int akl_kthread_entry(void* data) {
+    struct akl_thread* t = (struct akl_thread*)data;
+    struct akl_thread_entry* e = akl_thread_claim();
+    t->has_slot = e != NULL;
+    complete(&t->started);
+    /* without a slot fn is not run, akl_thread_create() fails instead */
+    if (e) {
+        t->fn(t->arg);
+        /* a freed entry keeps later probes going, only a never used one ends them */
+        smp_store_release(&e->task, AKL_THREAD_FREED);
+    }
+    complete(&t->done);
+    return 0;
+}
+
+#else
+
+static void* akl_pthread_entry(void* data) {
+    struct akl_thread* t = (struct akl_thread*)data;
+    t->fn(t->arg);
+    return NULL;
+}
+
+static void akl_cpu_set(cpu_set_t* set, int cpu) {
+    CPU_ZERO(set);
+    if (cpu >= 0) {
+        CPU_SET(cpu, set);
+    } else {
+        for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, set);
+        }
+    }
+}
+
+#endif
+
+akl_thread_t* akl_thread_create(void (*fn)(void*), void* arg, int cpu) {
+    akl_thread_t* t = (akl_thread_t*)akl_cmalloc(sizeof(akl_thread_t));
+    if (!t) {
+        return NULL;
+    }
+    t->fn = fn;
+    t->arg = arg;
+#ifdef __KERNEL_MODULE__
+    init_completion(&t->started);
+    init_completion(&t->done);
+    if (cpu >= 0) {
+        t->task = kthread_create_on_cpu(akl_kthread_entry, t, cpu, "akl/%u");
+    } else {
+        t->task = kthread_create(akl_kthread_entry, t, "akl");
+    }
+    if (IS_ERR(t->task)) {
+        akl_cfree(t);
+        return NULL;
+    }
+    /* kthread_stop() in akl_thread_join() needs the task after it exited */
+    get_task_struct(t->task);
+    wake_up_process(t->task);
+    /* akl_thread_slot() must work in every thread this returns */
+    wait_for_completion(&t->started);
+    if (!t->has_slot) {
+        akl_thread_join(t);
+        return NULL;
+    }
+    return t;
+#else
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (cpu >= 0) {
+        /* pinned before it runs, so its first touches land on its node */
+        cpu_set_t set;
+        akl_cpu_set(&set, cpu);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+    int error = pthread_create(&t->thread, &attr, akl_pthread_entry, t);
+    pthread_attr_destroy(&attr);
+    if (error) {
+        akl_cfree(t);
+        return NULL;
+    }
+    return t;
+#endif
+}
+
+void akl_thread_join(akl_thread_t* thread) {
+#ifdef __KERNEL_MODULE__
+    /* kthread_stop() before the thread ran would skip fn altogether */
+    wait_for_completion(&thread->done);
+    kthread_stop(thread->task);
+    put_task_struct(thread->task);
+#else
+    pthread_join(thread->thread, NULL);
+#endif
+    akl_cfree(thread);
+}
+
+int akl_thread_set_cpu(akl_thread_t* thread, int cpu) {
+#ifdef __KERNEL_MODULE__
+    return set_cpus_allowed_ptr(thread->task, cpu >= 0 ? cpumask_of(cpu) : cpu_possible_mask);
+#else
+    cpu_set_t set;
+    akl_cpu_set(&set, cpu);
+    return pthread_setaffinity_np(thread->thread, sizeof(set), &set);
+#endif
+}
+
+void** akl_thread_slot(void) {
+#ifdef __KERNEL_MODULE__
+    unsigned int hash = hash_ptr(current, AKL_THREAD_TABLE_BITS);
+    unsigned int i;
+    for (i = 0; i < AKL_THREAD_PROBES; ++i) {
+        struct akl_thread_entry* e = akl_thread_entry_at(hash, i);
+        struct task_struct* task = READ_ONCE(e->task);
+        if (task == current) {
+            return &e->slot;
+        }
+        if (task == NULL) {
+            break;
+        }
+    }
+    return NULL;
+#else
+    static __thread void* slot;
+    return &slot;
+#endif
+}
+
+/* wait queues */
+
+void akl_wait_queue_init(akl_wait_queue_t* queue) {
+#ifdef __KERNEL_MODULE__
+    init_waitqueue_head((wait_queue_head_t*)queue);
+#else
+    (void)queue;
+#endif
+}
+
+void akl_wait_queue_wait(akl_wait_queue_t* queue, volatile int* word, int expected) {
+#ifdef __KERNEL_MODULE__
+    /* exclusive, so a wake for "count" threads wakes that many */
+    wait_event_idle_exclusive(*(wait_queue_head_t*)queue, READ_ONCE(*word) != expected);
+#else
+    (void)queue;
+    syscall(SYS_futex, (int*)word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+#endif
+}
+
+void akl_wait_queue_wake(akl_wait_queue_t* queue, volatile int* word, int count) {
+#ifdef __KERNEL_MODULE__
+    (void)word;
+    wake_up_nr((wait_queue_head_t*)queue, count);
 #else
-    return pthread_mutex_trylock((pthread_mutex_t*)&mutex);
+    (void)queue;
+    syscall(SYS_futex, (int*)word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
 #endif
 }
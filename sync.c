@@ -1,6 +1,12 @@
 #include "akl/sync.h"
 #include "akl/kern_lib.h"
 
+#ifndef __KERNEL_MODULE__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 int akl_sync_bool_compare_and_swap(volatile int* t, int expected, int desired) {
 #ifdef __KERNEL_MODULE__
     akl_atomic_t* atom = (akl_atomic_t*)t;
@@ -132,6 +138,137 @@ int akl_atomic_compare_and_swap_double(
 #endif
 }
 
+int akl_sync_load_acquire(volatile int* t) {
+#ifdef __KERNEL_MODULE__
+    return akl_atomic_read_acquire((akl_atomic_t*)t);
+#else
+    return __atomic_load_n(t, __ATOMIC_ACQUIRE);
+#endif
+}
+
+void akl_sync_store_release(volatile int* t, int val) {
+#ifdef __KERNEL_MODULE__
+    akl_atomic_set_release((akl_atomic_t*)t, val);
+#else
+    __atomic_store_n(t, val, __ATOMIC_RELEASE);
+#endif
+}
+
+int akl_sync_bool_compare_and_swap_u64(volatile akl_u64* t, akl_u64 expected, akl_u64 desired) {
+#ifdef __KERNEL_MODULE__
+    akl_atomic64_t* atom = (akl_atomic64_t*)t;
+    return akl_atomic64_cmpxchg(atom, expected, desired) == expected;
+#else
+    return __sync_bool_compare_and_swap(t, expected, desired);
+#endif
+}
+
+akl_u64 akl_sync_add_and_fetch_u64(volatile akl_u64* t, akl_u64 val) {
+#ifdef __KERNEL_MODULE__
+    akl_atomic64_t* atom = (akl_atomic64_t*)t;
+    return akl_atomic64_add_return(val, atom);
+#else
+    return __sync_add_and_fetch(t, val);
+#endif
+}
+
+akl_u64 akl_sync_fetch_and_add_u64(volatile akl_u64* t, akl_u64 val) {
+#ifdef __KERNEL_MODULE__
+    akl_atomic64_t* atom = (akl_atomic64_t*)t;
+    return akl_atomic64_add_return(val, atom) - val;
+#else
+    return __sync_fetch_and_add(t, val);
+#endif
+}
+
+akl_u64 akl_sync_sub_and_fetch_u64(volatile akl_u64* t, akl_u64 val) {
+#ifdef __KERNEL_MODULE__
+    akl_atomic64_t* atom = (akl_atomic64_t*)t;
+    return akl_atomic64_sub_return(val, atom);
+#else
+    return __sync_sub_and_fetch(t, val);
+#endif
+}
+
+akl_u64 akl_sync_fetch_and_sub_u64(volatile akl_u64* t, akl_u64 val) {
+#ifdef __KERNEL_MODULE__
+    akl_atomic64_t* atom = (akl_atomic64_t*)t;
+    return akl_atomic64_sub_return(val, atom) + val;
+#else
+    return __sync_fetch_and_sub(t, val);
+#endif
+}
+
+akl_u64 akl_sync_lock_test_and_set_u64(volatile akl_u64* t, akl_u64 val) {
+#ifdef __KERNEL_MODULE__
+    akl_atomic64_t* atom = (akl_atomic64_t*)t;
+    return akl_atomic64_xchg(atom, val);
+#else
+    return __sync_lock_test_and_set(t, val);
+#endif
+}
+
+akl_u64 akl_sync_load_acquire_u64(volatile akl_u64* t) {
+#ifdef __KERNEL_MODULE__
+    return akl_atomic64_read_acquire((akl_atomic64_t*)t);
+#else
+    return __atomic_load_n(t, __ATOMIC_ACQUIRE);
+#endif
+}
+
+void akl_sync_store_release_u64(volatile akl_u64* t, akl_u64 val) {
+#ifdef __KERNEL_MODULE__
+    akl_atomic64_set_release((akl_atomic64_t*)t, val);
+#else
+    __atomic_store_n(t, val, __ATOMIC_RELEASE);
+#endif
+}
+
+int akl_sync_bool_compare_and_swap_u128(volatile akl_u128_t* t, akl_u128_t expected, akl_u128_t desired) {
+#ifdef __KERNEL_MODULE__
+    return akl_atomic128_cmpxchg((akl_u128_t*)t, expected, desired);
+#elif defined(__x86_64__)
+    /* cmpxchg16b directly, __sync on 16 bytes needs -mcx16 or libatomic */
+    unsigned char ok;
+    __asm__ __volatile__("lock cmpxchg16b %1\n\tsete %0"
+                         : "=q"(ok), "+m"(*t), "+a"(expected.lo), "+d"(expected.hi)
+                         : "b"(desired.lo), "c"(desired.hi)
+                         : "memory", "cc");
+    return ok;
+#else
+    typedef unsigned __int128 u128;
+    u128 old = ((u128)expected.hi << 64) | expected.lo;
+    u128 val = ((u128)desired.hi << 64) | desired.lo;
+    return __sync_bool_compare_and_swap((volatile u128*)t, old, val);
+#endif
+}
+
+void akl_sync_wait(volatile int* t, int expected) {
+#ifdef __KERNEL_MODULE__
+    akl_wait_var_event(t, expected);
+#else
+    syscall(SYS_futex, (int*)t, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+#endif
+}
+
+void akl_sync_wake(volatile int* t, int count) {
+#ifdef __KERNEL_MODULE__
+    /* wake_up_var wakes every waiter, they re-check and sleep again */
+    (void)count;
+    akl_wake_up_var(t);
+#else
+    syscall(SYS_futex, (int*)t, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+#endif
+}
+
+void akl_sync_synchronize(void) {
+#ifdef __KERNEL_MODULE__
+    akl_smp_mb();
+#else
+    __sync_synchronize();
+#endif
+}
+
 void akl_atomic_exchange(volatile int* a, int* b) {
     *b = akl_sync_lock_test_and_set(a, *b);
 }